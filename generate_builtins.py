@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+"""Validates the bundled language and theme files and compiles them into C++
+tables (see include/AlteBuiltins.h). Run by CMake at build time; any malformed
+file fails the build with its name and position."""
+
+import argparse
+import glob
+import hashlib
+import json
+import os
+import re
+import subprocess
+import sys
+
+RULE_FIELDS = {
+    "keywords": ["list"],
+    "line_comment": ["start_delimiter"],
+    "multi_line_string": ["start_pattern", "end_pattern"],
+    "multi_line_comment": ["start_pattern", "end_pattern"],
+    "pattern": [],
+}
+REGEX_FIELDS = ["pattern", "start_pattern", "end_pattern"]
+COLOR_RE = re.compile(r"#([0-9a-fA-F]{3}|[0-9a-fA-F]{6}|[0-9a-fA-F]{8})")
+
+# Python re errors for syntax PCRE2 (QRegularExpression) accepts. Only these
+# are let through when no pcre2grep is available to check with.
+PCRE2_ONLY_SYNTAX = [
+    "look-behind requires fixed-width pattern",  # PCRE2 allows alternatives of different lengths
+    "multiple repeat",  # Possessive quantifiers
+    "unknown extension ?>",  # Atomic groups on Python < 3.11
+    "bad escape \\h",
+    "bad escape \\K",
+]
+
+errors = []
+warnings = []
+pcre2grep = None
+
+
+def error(path, message):
+    errors.append("%s: error: %s" % (path, message))
+
+
+def warning(path, message):
+    warnings.append("%s: warning: %s" % (path, message))
+
+
+def load_json(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    try:
+        return data, json.loads(data.decode("utf-8"))
+    except (UnicodeDecodeError, ValueError) as e:
+        error(path, "invalid JSON: %s" % e)
+        return data, None
+
+
+def check_string_list(path, owner, value, what):
+    if not isinstance(value, list) or not all(isinstance(item, str) for item in value):
+        error(path, "%s: '%s' must be an array of strings" % (owner, what))
+        return []
+    return value
+
+
+def check_regex(path, owner, pattern):
+    """Compiles pattern with PCRE2 when pcre2grep is available, otherwise with
+    Python's re, where only the known differences to PCRE2 are forgiven."""
+    if pcre2grep:
+        result = subprocess.run([pcre2grep, "-u", "-e", pattern, os.devnull], capture_output=True, text=True)
+        if result.returncode == 2:
+            error(path, "%s does not compile: %s" % (owner, result.stderr.strip()))
+        return
+    try:
+        re.compile(pattern)
+    except re.error as e:
+        if any(str(e).startswith(known) for known in PCRE2_ONLY_SYNTAX):
+            warning(path, "%s not checked, Python's re does not support it: %s" % (owner, e))
+        else:
+            error(path, "%s does not compile: %s" % (owner, e))
+
+
+def check_rules(path, rules, where):
+    if not isinstance(rules, list):
+        error(path, "%s: 'highlighting_rules' must be an array" % where)
+        return
+    for index, rule in enumerate(rules):
+        owner = "%s rule %d" % (where, index)
+        if not isinstance(rule, dict):
+            error(path, "%s is not an object" % owner)
+            continue
+        owner = "%s ('%s')" % (owner, rule.get("name", "unnamed"))
+        rule_type = rule.get("type")
+        if rule_type not in RULE_FIELDS:
+            error(path, "%s has unknown type %r" % (owner, rule_type))
+            continue
+        for field in RULE_FIELDS[rule_type]:
+            if field not in rule:
+                error(path, "%s is missing '%s'" % (owner, field))
+        if rule_type == "pattern" and "pattern" not in rule and "patterns" not in rule:
+            error(path, "%s is missing 'pattern'" % owner)
+        if rule_type == "keywords" and "list" in rule:
+            check_string_list(path, owner, rule["list"], "list")
+        for field in REGEX_FIELDS:
+            if field not in rule:
+                continue
+            if not isinstance(rule[field], str) or not rule[field]:
+                error(path, "%s: '%s' must be a non-empty string" % (owner, field))
+                continue
+            check_regex(path, "%s: '%s'" % (owner, field), rule[field])
+        if "rules" in rule:
+            check_rules(path, rule["rules"], owner)
+
+
+def read_language(path):
+    data, definition = load_json(path)
+    if definition is None:
+        return None
+    if not isinstance(definition, dict):
+        error(path, "a language definition must be an object")
+        return None
+    name = definition.get("language_name") or os.path.splitext(os.path.basename(path))[0]
+    if "file_extensions" not in definition:
+        # The runtime skips such files too (e.g. test definitions).
+        warning(path, "no 'file_extensions', not compiled in")
+        return None
+    extensions = check_string_list(path, name, definition["file_extensions"], "file_extensions")
+    patterns = check_string_list(path, name, definition.get("first_line_patterns", []), "first_line_patterns")
+    for pattern in patterns:
+        check_regex(path, "%s: first line pattern" % name, pattern)
+    check_rules(path, definition.get("highlighting_rules", []), name)
+    keywords = []
+    for rule in definition.get("highlighting_rules", []):
+        if isinstance(rule, dict) and rule.get("type") == "keywords" and isinstance(rule.get("list"), list):
+            keywords.extend(word for word in rule["list"] if isinstance(word, str))
+    return {
+        "file": os.path.basename(path),
+        "name": name,
+        "size": len(data),
+        "extensions": extensions,
+        "first_line_patterns": patterns,
+        "keywords": keywords,
+        "content_tokens": check_string_list(path, name, definition.get("content_tokens", []), "content_tokens"),
+        "fingerprint": hashlib.sha1(data).digest(),
+        "definition": json.dumps(definition, ensure_ascii=False, separators=(",", ":")).encode("utf-8"),
+    }
+
+
+def read_theme(path):
+    data, theme = load_json(path)
+    if theme is None:
+        return None
+    if not isinstance(theme, dict):
+        error(path, "a theme must be an object")
+        return None
+    if not isinstance(theme.get("name"), str) or not theme["name"]:
+        error(path, "a theme needs a 'name'")
+        return None
+    colors = theme.get("colors", {})
+    if not isinstance(colors, dict):
+        error(path, "'colors' must be an object")
+        colors = {}
+    for key, value in colors.items():
+        if not isinstance(value, str) or not COLOR_RE.fullmatch(value):
+            error(path, "color '%s' has invalid value %r" % (key, value))
+    for section in ("syntax_formats", "token_styles", "styles", "font"):
+        if section in theme and not isinstance(theme[section], dict):
+            error(path, "'%s' must be an object" % section)
+    return {
+        "file": os.path.basename(path),
+        "name": theme["name"],
+        "size": len(data),
+        "fingerprint": hashlib.sha1(data).digest(),
+        "definition": json.dumps(theme, ensure_ascii=False, separators=(",", ":")).encode("utf-8"),
+    }
+
+
+def c_bytes(data):
+    """A C string literal of data; octal escapes keep non-ASCII bytes exact."""
+    out = []
+    for byte in data:
+        if byte in (0x22, 0x5C):
+            out.append("\\" + chr(byte))
+        elif 0x20 <= byte < 0x7F and byte != 0x3F:  # '?' would start trigraphs
+            out.append(chr(byte))
+        else:
+            out.append("\\%03o" % byte)
+    text = "".join(out)
+    # Split long literals; adjacent literals are concatenated.
+    return "\n    ".join('"%s"' % text[i:i + 4000] for i in range(0, max(len(text), 1), 4000))
+
+
+def c_string_array(name, items):
+    if not items:
+        return None
+    return "constexpr const char* %s[] = {%s};\n" % (name, ", ".join(c_bytes(item.encode("utf-8")) for item in items))
+
+
+def generate(languages, themes):
+    out = ["// Generated by generate_builtins.py from resources/syntax and resources/themes. Do not edit.\n",
+           '#include "AlteBuiltins.h"\n\nnamespace {\n']
+    language_rows = []
+    for index, language in enumerate(languages):
+        arrays = {}
+        for field, items in (("extensions", language["extensions"]),
+                             ("firstLinePatterns", language["first_line_patterns"]),
+                             ("keywords", language["keywords"]),
+                             ("contentTokens", language["content_tokens"])):
+            array_name = "kLanguage%d_%s" % (index, field)
+            declaration = c_string_array(array_name, items)
+            if declaration:
+                out.append(declaration)
+            arrays[field] = ("%s, %d" % (array_name, len(items))) if declaration else "nullptr, 0"
+        out.append("constexpr char kLanguage%d_definition[] =\n    %s;\n\n" % (index, c_bytes(language["definition"])))
+        language_rows.append("    {%s, %s, %d, %s, %s, %s, %s, %s, kLanguage%d_definition},\n" % (
+            c_bytes(language["file"].encode()), c_bytes(language["name"].encode("utf-8")), language["size"],
+            arrays["extensions"], arrays["firstLinePatterns"], arrays["keywords"], arrays["contentTokens"],
+            c_bytes(language["fingerprint"]), index))
+    theme_rows = []
+    for index, theme in enumerate(themes):
+        out.append("constexpr char kTheme%d_definition[] =\n    %s;\n\n" % (index, c_bytes(theme["definition"])))
+        theme_rows.append("    {%s, %s, %d, %s, kTheme%d_definition},\n" % (
+            c_bytes(theme["file"].encode()), c_bytes(theme["name"].encode("utf-8")), theme["size"],
+            c_bytes(theme["fingerprint"]), index))
+
+    if language_rows:
+        out.append("constexpr AlteBuiltinLanguage kLanguages[] = {\n%s};\n" % "".join(language_rows))
+    if theme_rows:
+        out.append("constexpr AlteBuiltinTheme kThemes[] = {\n%s};\n" % "".join(theme_rows))
+    out.append("}\n\n")
+    out.append("std::span<const AlteBuiltinLanguage> alteBuiltinLanguages() {\n    return %s;\n}\n\n"
+               % ("kLanguages" if language_rows else "{}"))
+    out.append("std::span<const AlteBuiltinTheme> alteBuiltinThemes() {\n    return %s;\n}\n"
+               % ("kThemes" if theme_rows else "{}"))
+    return "".join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--syntax", required=True, help="directory of language JSON files")
+    parser.add_argument("--themes", required=True, help="directory of theme JSON files")
+    parser.add_argument("--output", required=True, help="C++ file to write")
+    parser.add_argument("--pcre2grep", help="pcre2grep to check regexes with PCRE2 itself")
+    args = parser.parse_args()
+    global pcre2grep
+    pcre2grep = args.pcre2grep
+
+    languages = [l for l in map(read_language, sorted(glob.glob(os.path.join(args.syntax, "*.json")))) if l]
+    themes = [t for t in map(read_theme, sorted(glob.glob(os.path.join(args.themes, "*.json")))) if t]
+    seen = {}
+    for language in languages:
+        if language["name"] in seen:
+            error(language["file"], "language '%s' is also defined by %s" % (language["name"], seen[language["name"]]))
+        seen[language["name"]] = language["file"]
+
+    for message in warnings:
+        print(message, file=sys.stderr)
+    if errors:
+        for message in errors:
+            print(message, file=sys.stderr)
+        return 1
+
+    source = generate(languages, themes)
+    os.makedirs(os.path.dirname(os.path.abspath(args.output)), exist_ok=True)
+    # Leave an unchanged file alone so it is not recompiled.
+    if os.path.exists(args.output):
+        with open(args.output, encoding="utf-8") as f:
+            if f.read() == source:
+                return 0
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write(source)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,15 @@
+#ifndef ALTEAPPLICATION_H
+#define ALTEAPPLICATION_H
+
+#include <QApplication>
+
+// Times the delivery of paint and layout events while a trace is recorded,
+// which covers Qt's own text layout and painting as well as ours.
+class AlteApplication : public QApplication {
+public:
+    AlteApplication(int& argc, char** argv);
+
+    bool notify(QObject* receiver, QEvent* event) override;
+};
+
+#endif // ALTEAPPLICATION_H
@@ -0,0 +1,36 @@
+#ifndef ALTEBUILTINS_H
+#define ALTEBUILTINS_H
+
+#include <span>
+
+// The bundled language and theme files, validated and compiled into the binary
+// by generate_builtins.py when ALTE_BUILTIN_RESOURCES is set. Files on disk
+// with the same name still override them.
+struct AlteBuiltinLanguage {
+    const char* fileName;
+    const char* name;
+    long long sourceSize; // Bytes of the source file
+    const char* const* extensions;
+    int extensionCount;
+    const char* const* firstLinePatterns;
+    int firstLinePatternCount;
+    const char* const* keywords;
+    int keywordCount;
+    const char* const* contentTokens;
+    int contentTokenCount;
+    const char* fingerprint; // 20 bytes, SHA-1 of the source file
+    const char* definition; // Minified JSON
+};
+
+struct AlteBuiltinTheme {
+    const char* fileName;
+    const char* name;
+    long long sourceSize;
+    const char* fingerprint;
+    const char* definition;
+};
+
+std::span<const AlteBuiltinLanguage> alteBuiltinLanguages();
+std::span<const AlteBuiltinTheme> alteBuiltinThemes();
+
+#endif // ALTEBUILTINS_H
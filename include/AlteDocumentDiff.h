@@ -0,0 +1,36 @@
+#ifndef ALTEDOCUMENTDIFF_H
+#define ALTEDOCUMENTDIFF_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QTextDocument;
+
+// One replacement of whole lines, expressed in the line numbers of the
+// document *before* any edit of the same batch is applied.
+struct AlteLineEdit {
+    int firstLine = 0;      // first line (block number) being replaced
+    int removedLines = 0;   // number of old lines removed
+    QStringList insertedLines;
+};
+
+// Computes the minimal set of line edits that turns a QTextDocument into new
+// file content, so that an external change to the file on disk can be applied
+// as a few small edits instead of a full setPlainText().
+class AlteDocumentDiff {
+public:
+    // The old lines are read from the document's blocks. Only the lines between
+    // the unchanged head and tail are copied out of it.
+    static QVector<AlteLineEdit> computeLineEdits(const QTextDocument* document, const QString& newText);
+
+    // Applies the edits as a single undoable edit block. Returns false if the
+    // edits do not fit the document (it was changed since they were computed).
+    static bool applyLineEdits(QTextDocument* document, const QVector<AlteLineEdit>& edits);
+
+    // Convenience wrapper: diffs the document against newText and applies the
+    // result. Returns the number of edits applied, or -1 on failure.
+    static int reloadIncrementally(QTextDocument* document, const QString& newText);
+};
+
+#endif // ALTEDOCUMENTDIFF_H
@@ -0,0 +1,90 @@
+#ifndef ALTEDOCUMENTMANAGER_H
+#define ALTEDOCUMENTMANAGER_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QDateTime>
+
+class QTextEdit;
+class QFile;
+class AlteSyntaxHighlighter;
+
+// Keeps track of every open document in the window and keeps their combined
+// memory use under a global budget. Inactive documents are shrunk in two steps:
+// first their layout and highlight caches are dropped, then unmodified documents
+// backed by a file are replaced by an mmap-backed stub that is re-expanded when
+// the document is activated again.
+class AlteDocumentManager : public QObject {
+    Q_OBJECT
+
+public:
+    enum class Residency {
+        Resident,       // Text, layout and highlighting are all in memory
+        CachesDropped,  // Text in memory, layouts and highlight formats released
+        Stub            // Text released, file mapped for instant restore
+    };
+
+    struct Document {
+        QTextEdit* editor = nullptr;
+        AlteSyntaxHighlighter* highlighter = nullptr;
+        QString filePath;
+        QString languageName;
+        Residency residency = Residency::Resident;
+        quint64 lastActivated = 0;
+
+        // Disk state of filePath when the text was last read or written; a stub
+        // is only mapped back while the file still matches it.
+        QDateTime diskModified;
+        qint64 diskSize = -1;
+
+        // Stub state
+        QFile* mappedFile = nullptr;
+        uchar* mappedData = nullptr;
+        int cursorPosition = 0;
+        int verticalScroll = 0;
+        int horizontalScroll = 0;
+    };
+
+    explicit AlteDocumentManager(QObject* parent = nullptr);
+    ~AlteDocumentManager() override;
+
+    Document* addDocument(QTextEdit* editor, AlteSyntaxHighlighter* highlighter);
+    void removeDocument(QTextEdit* editor);
+    Document* document(QTextEdit* editor) const;
+    Document* documentForPath(const QString& filePath) const;
+    QList<Document*> documents() const;
+
+    // Makes the document resident again and marks it as most recently used.
+    void activate(QTextEdit* editor);
+
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const { return m_memoryBudget; }
+    qint64 estimatedUsage() const;
+
+public slots:
+    void enforceBudget();
+
+signals:
+    // A stub's file changed while it was released; the document was activated
+    // with the text it had, or empty if the file shrank below it, and should be
+    // reloaded like any other change on disk.
+    void changedOnDisk(QTextEdit* editor);
+
+private:
+    qint64 estimateBytes(const Document& document) const;
+    void dropCaches(Document& document);
+    void restoreCaches(Document& document);
+    bool shrinkToStub(Document& document);
+    void restoreFromStub(Document& document);
+    void releaseMapping(Document& document);
+    Document* leastRecentlyUsed(Residency residency, bool requireUnmodifiedFile) const;
+
+    QHash<QTextEdit*, Document*> m_documents;
+    QTextEdit* m_activeEditor;
+    quint64 m_activationCounter;
+    qint64 m_memoryBudget;
+};
+
+#endif // ALTEDOCUMENTMANAGER_H
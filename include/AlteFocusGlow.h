@@ -0,0 +1,37 @@
+#ifndef ALTEFOCUSGLOW_H
+#define ALTEFOCUSGLOW_H
+
+#include <QWidget>
+#include <QColor>
+
+class QVariantAnimation;
+
+// Focus glow painted over the frame of a widget, shown when the widget gains
+// focus and faded out afterwards. The overlay is masked to the frame, so
+// animating it repaints a few pixels and never restyles or relayouts the
+// widget underneath.
+class AlteFocusGlow : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit AlteFocusGlow(QWidget *target, int durationMs = 250);
+
+    void setColor(const QColor &color);
+    // Glows at full strength, then fades out by the end of the duration.
+    void flash();
+    void stop();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    void followTarget();
+
+    QWidget *m_target;
+    QColor m_color;
+    QVariantAnimation *m_animation;
+    qreal m_strength;
+};
+
+#endif // ALTEFOCUSGLOW_H
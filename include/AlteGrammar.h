@@ -0,0 +1,228 @@
+#ifndef ALTEGRAMMAR_H
+#define ALTEGRAMMAR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QRegularExpression>
+#include <QTextCharFormat>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QSharedPointer>
+#include <QFont>
+#include <QReadWriteLock>
+#include <QAtomicInteger>
+#include <memory>
+
+class AlteThemeManager;
+class AlteTheme;
+
+// One coloured span of a line. style indexes AlteGrammar::formats().
+struct AlteToken {
+    quint32 start = 0;
+    quint32 length = 0;
+    quint16 style = 0;
+};
+
+// The highlighting rules of one language, compiled from its syntax JSON, together
+// with the rules of the languages it embeds (e.g. JavaScript and CSS in HTML).
+// A grammar is immutable once loaded apart from its internally locked table of
+// line states, so a single instance can be shared between the UI thread and
+// tokenizer threads. Compiled grammars are cached in memory and
+// on disk, keyed by the hashes of the language files. They do not depend on the
+// theme: formats() resolves the styles of the rules against one.
+class AlteGrammar {
+public:
+    // The language definitions a grammar is built from.
+    struct Source
+    {
+        QString languageName;
+        QByteArray key; // Cache key; empty if the language has no fingerprint
+        QHash<QString, QJsonObject> languageRules; // The language and every language it embeds
+    };
+
+    // Must be called on the UI thread: the in-memory cache is not locked.
+    // Returns the cached grammar when the language files are unchanged.
+    static QSharedPointer<const AlteGrammar> load(const QString& languageName,
+                                                  AlteThemeManager* themeManager);
+    // load() in three steps, for compiling off the UI thread. prepare() (UI
+    // thread) returns the grammar if it is cached in memory and otherwise fills
+    // source; build() reads the disk cache or compiles the rules on any thread;
+    // keep() (UI thread) caches the result for later loads.
+    static QSharedPointer<const AlteGrammar> prepare(const QString& languageName, AlteThemeManager* themeManager,
+                                                     Source& source);
+    static QSharedPointer<const AlteGrammar> build(const Source& source);
+    static void keep(const Source& source, const QSharedPointer<const AlteGrammar>& grammar);
+
+    const QString& languageName() const { return m_languageName; }
+    bool isEmpty() const { return m_rules.isEmpty(); }
+
+    // Tokenizes one line given the state the previous line ended in (0 = none)
+    // and returns the state this line ends in. A state is a small integer that
+    // stands for the stack of multi-line spans open at the end of the line, so
+    // equal states mean equal stacks. Safe to call from any thread.
+    int tokenizeLine(const QString& text, int entryState, QVector<AlteToken>& tokens) const;
+
+    // Same exit state as tokenizeLine(), computed from the multi-line rules only.
+    // Used to find the entry state of a line without tokenizing everything above it.
+    int scanBlockState(const QString& text, int entryState) const;
+
+    // Format of every style in theme, indexed by AlteToken::style. Cheap enough to
+    // rebuild on a theme change; tokens and line states stay valid.
+    QVector<QTextCharFormat> formats(const AlteTheme& theme, const QFont& defaultFont) const;
+    // True for comment and string styles, whose text is not code (e.g. brackets in it do not count).
+    bool isOpaqueStyle(quint16 style) const { return style < m_rules.size() && m_rules[style].isOpaque; }
+
+    // Time spent in each rule since the grammar was loaded or the profile reset.
+    // lines counts the lines a pattern rule ran on, or the searches of a block rule;
+    // skippedLines the lines it was left out on to stay within the line budget.
+    struct RuleProfile
+    {
+        QString name;
+        qint64 nanoseconds = 0;
+        qint64 matches = 0;
+        qint64 lines = 0;
+        qint64 skippedLines = 0;
+        bool slow = false; // Skipped on long lines after exceeding the line budget
+    };
+    QVector<RuleProfile> profile() const;
+    QJsonObject profileToJson() const;
+    // Also gives rules that were found to be slow another chance.
+    void resetProfile() const;
+
+    // Collects the rule counters of the lines this thread tokenizes while it
+    // exists and adds them to the grammar's profile once, when it goes out of
+    // scope, so threads tokenizing in parallel do not contend on every line.
+    // Lines tokenized outside a batch are counted directly.
+    class ProfileBatch
+    {
+    public:
+        explicit ProfileBatch(const AlteGrammar& grammar);
+        ~ProfileBatch();
+        ProfileBatch(const ProfileBatch&) = delete;
+        ProfileBatch& operator=(const ProfileBatch&) = delete;
+
+    private:
+        friend class AlteGrammar;
+        struct Counters
+        {
+            qint64 nanoseconds = 0;
+            qint64 matches = 0;
+            qint64 lines = 0;
+            qint64 skippedLines = 0;
+        };
+        const AlteGrammar& m_grammar;
+        QVector<Counters> m_counters; // By rule index
+        ProfileBatch* m_outer;
+    };
+
+private:
+    friend class AlteGrammarReference; // tools/AlteGrammarReference.h
+    // How a rule is coloured, as written in the language file.
+    struct Style
+    {
+        QString key;      // "style_key" of the theme
+        QString colorRef; // "color_ref", a theme color overriding the style's
+        bool bold = false;
+        bool italic = false;
+        int fontSizeOffset = 0;
+        // Theme ids of key and colorRef, registered by compile(); -1 if empty.
+        int styleId = -1;
+        int colorRefId = -1;
+    };
+    struct Rule
+    {
+        QRegularExpression pattern;
+        Style style;
+        bool isBlockRule = false;
+        bool isKeywordRule = false; // Matched through the keyword table of its context instead of pattern
+        QRegularExpression endPattern;
+        QString literalPrefix; // Text every match starts with; lines without it skip the rule
+        QString endLiteralPrefix; // Same for endPattern of block rules
+        int bodyContext = -1; // Rules active inside a block rule; -1 for a plain span
+        bool embedsLanguage = false; // The body is coloured by an embedded language only
+        QString name;
+        bool isOpaque = false; // Comment or string
+    };
+    QVector<Rule> m_rules;
+    QString m_languageName;
+    bool m_hasBlockRules = false;
+
+    // All "keywords" lists of a context share one table. Words are bucketed by
+    // first character and length, so a lookup is one integer hash probe plus a
+    // compare against the (usually single) candidate.
+    struct KeywordEntry
+    {
+        QString word;
+        int ruleIndex;
+    };
+    struct KeywordMatch
+    {
+        int start;
+        int length;
+        int ruleIndex;
+    };
+
+    // Rules that are active together: the language itself (context 0), the
+    // inside of a block rule with nested rules, or an embedded language.
+    struct Context
+    {
+        QVector<int> patternRules;
+        QVector<int> blockRules;
+        QHash<quint32, QVector<KeywordEntry>> keywordBuckets;
+    };
+    QVector<Context> m_contexts;
+
+    // Per-rule counters, updated by every tokenizer thread, once per ProfileBatch.
+    struct RuleStats
+    {
+        QAtomicInteger<qint64> nanoseconds;
+        QAtomicInteger<qint64> matches;
+        QAtomicInteger<qint64> lines;
+        QAtomicInteger<qint64> skippedLines;
+        QAtomicInt slowLineLength; // Lines at least this long skip the rule
+        QAtomicInt reported;
+    };
+    mutable std::unique_ptr<RuleStats[]> m_stats;
+
+    // Stacks of open block rules, innermost last. State 0 is the empty stack and
+    // states 1..m_rules.size() a single open block rule (index + 1), so the common
+    // cases need no lookup; deeper stacks are interned on first use.
+    using StateStack = QVector<quint16>;
+    mutable QReadWriteLock m_stateLock;
+    mutable QHash<StateStack, int> m_stateIds;
+    mutable QVector<StateStack> m_stateStacks;
+
+    void loadRules(const QHash<QString, QJsonObject>& languageRules);
+    void loadContext(int contextId, const QString& languageName, const QJsonArray& rulesArray,
+                     const QHash<QString, QJsonObject>& languageRules, QHash<QString, int>& embeddedContexts);
+    int embeddedContext(const QString& languageName, const QHash<QString, QJsonObject>& languageRules,
+                        QHash<QString, int>& embeddedContexts);
+    int addContext();
+    int addRule(int contextId, const Rule& rule);
+    void compile();
+    bool readCache(const QString& filePath);
+    void writeCache(const QString& filePath) const;
+    static QString cacheFilePath(const QByteArray& key);
+    static void collectEmbeddedLanguages(const QJsonArray& rulesArray, AlteThemeManager* themeManager,
+                                         QStringList& languages);
+    void addKeywordRule(int contextId, const Rule& baseRule, const QJsonArray& words, const QString& ruleName);
+    void findKeywords(const Context& context, const QString& text, int from, int to,
+                      QVector<KeywordMatch>& matches) const;
+    int walkLine(const QString& text, int entryState, QVector<int>* owner) const;
+    void colourSpan(const Context* context, int spanRule, const QString& text, int from, int to,
+                    QVector<int>& owner) const;
+    void recordRuleTime(int ruleIndex, qint64 nanoseconds, int matches, int lineLength) const;
+    void recordSkippedLine(int ruleIndex) const;
+    bool findBlockStart(const Rule& rule, const QString& text, int from, int& start, int& end) const;
+    bool findBlockEnd(const Rule& rule, const QString& text, int from, int& start, int& end) const;
+    void stackForState(int state, StateStack& stack) const;
+    int stateForStack(const StateStack& stack) const;
+    static quint32 keywordBucketKey(QChar first, int length);
+    static QString literalPrefix(const QString& pattern);
+    static Style styleFromRule(const QJsonObject& ruleDetails);
+    static QTextCharFormat formatForStyle(const Style& style, const AlteTheme& theme, const QFont& defaultFont);
+};
+
+#endif // ALTEGRAMMAR_H
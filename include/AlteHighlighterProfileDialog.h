@@ -0,0 +1,37 @@
+#ifndef ALTEHIGHLIGHTERPROFILEDIALOG_H
+#define ALTEHIGHLIGHTERPROFILEDIALOG_H
+
+#include <QDialog>
+#include <QSharedPointer>
+#include <QTimer>
+#include "AlteGrammar.h"
+
+class QTableWidget;
+class QLabel;
+
+// Debug panel listing where the highlighter spends its time, per grammar rule.
+// Refreshes itself while visible; the numbers can be reset and saved as JSON.
+class AlteHighlighterProfileDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit AlteHighlighterProfileDialog(QWidget *parent = nullptr);
+    void setGrammar(const QSharedPointer<const AlteGrammar>& grammar);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private slots:
+    void refresh();
+    void resetProfile();
+    void saveJson();
+
+private:
+    QSharedPointer<const AlteGrammar> m_grammar;
+    QTableWidget* m_table;
+    QLabel* m_summary;
+    QTimer m_refreshTimer;
+};
+
+#endif // ALTEHIGHLIGHTERPROFILEDIALOG_H
@@ -0,0 +1,67 @@
+#ifndef ALTEIDENTIFIERINDEX_H
+#define ALTEIDENTIFIERINDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <QStringView>
+#include <QStringList>
+#include <QVector>
+#include <span>
+#include "AlteGrammar.h"
+
+class AlteLineRecord;
+class QTextBlock;
+class QTextDocument;
+
+// Identifiers of a document for word completion. Every distinct identifier is
+// interned once and counted by the number of lines using it; each line's
+// identifier ids live in an arena next to its token runs, so an edit only
+// re-counts the lines it re-tokenized. Candidates for a prefix come from a
+// sorted map and are ranked by count.
+class AlteIdentifierIndex {
+public:
+    // Keywords are always offered, even when the document does not use them.
+    void setKeywords(const QStringList& keywords);
+
+    // Replaces the identifiers counted for the block with those in text,
+    // skipping comment and string tokens. The block must have a record.
+    void updateLine(const QTextBlock& block, const QString& text, std::span<const AlteToken> tokens,
+                    const AlteGrammar* grammar);
+
+    // Lines deleted from the document keep their identifiers counted until the
+    // next recount, which walks the remaining records and compacts the arena.
+    void recount(QTextDocument* document);
+    // Drops every line's identifiers; the keywords stay.
+    void clear(QTextDocument* document);
+
+    // Up to limit identifiers starting with prefix, most used first.
+    QStringList complete(const QString& prefix, int limit) const;
+    int identifierCount() const { return int(m_ids.size()); }
+
+    // Identifiers of a line worth completing, outside comment and string tokens.
+    static void scanWords(const QString& text, std::span<const AlteToken> tokens, const AlteGrammar* grammar,
+                          QVector<QStringView>& words);
+
+private:
+    struct Entry {
+        QString text;
+        quint32 count = 0; // Lines using it
+        bool keyword = false;
+    };
+
+    quint32 intern(const QString& word);
+    void release(quint32 id);
+    void setRecordWords(AlteLineRecord* record, const QVector<quint32>& ids);
+
+    QVector<Entry> m_entries;
+    QHash<QString, quint32> m_ids;
+    QMap<QString, quint32> m_sorted;
+    QVector<quint32> m_free;      // Ids of released entries, reused first
+    QVector<quint32> m_lineWords; // Arena of per-line ids
+    qsizetype m_garbage = 0;
+    QVector<quint32> m_scratch;
+    QVector<QStringView> m_scratchWords;
+};
+
+#endif // ALTEIDENTIFIERINDEX_H
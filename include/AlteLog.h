@@ -0,0 +1,17 @@
+#ifndef ALTELOG_H
+#define ALTELOG_H
+
+#include <QLoggingCategory>
+
+// Diagnostic output by area. Debug messages are off unless enabled at run time,
+// e.g. QT_LOGGING_RULES="alte.theme.debug=true", and are compiled out entirely
+// when ALTE_DEBUG_LOGGING is switched off (QT_NO_DEBUG_OUTPUT).
+Q_DECLARE_LOGGING_CATEGORY(lcStartup)
+Q_DECLARE_LOGGING_CATEGORY(lcTheme)
+Q_DECLARE_LOGGING_CATEGORY(lcLanguage)
+Q_DECLARE_LOGGING_CATEGORY(lcGrammar)
+Q_DECLARE_LOGGING_CATEGORY(lcDocument)
+Q_DECLARE_LOGGING_CATEGORY(lcProject)
+Q_DECLARE_LOGGING_CATEGORY(lcTrace)
+
+#endif // ALTELOG_H
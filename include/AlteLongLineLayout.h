@@ -0,0 +1,82 @@
+#ifndef ALTELONGLINELAYOUT_H
+#define ALTELONGLINELAYOUT_H
+
+#include <QAbstractTextDocumentLayout>
+#include <QFont>
+#include <QHash>
+#include <QSharedPointer>
+#include <QTextLayout>
+#include <QVector>
+
+class QTextEdit;
+
+// Document layout for documents with very long lines, such as minified
+// JavaScript or single-line JSON. Lines never wrap and every visible block is
+// one row of the same height. Ordinary lines are laid out by their own
+// QTextLayout when first needed. A line longer than the threshold is never
+// shaped as a whole: only the slice of columns on screen, plus a chunk on
+// either side, is laid out and drawn. Its width is measured chunk by chunk as
+// the chunks are drawn and estimated from the font's advance until then.
+class AlteLongLineLayout : public QAbstractTextDocumentLayout {
+    Q_OBJECT
+
+public:
+    AlteLongLineLayout(QTextDocument *document, int longLineThreshold);
+
+    // Puts the editor's document on this layout and turns off line wrapping.
+    // Does nothing if the document already uses it.
+    static AlteLongLineLayout *install(QTextEdit *editor, int longLineThreshold);
+    static bool hasLongLine(const QString &text, int longLineThreshold);
+
+    // Cursor rectangle of a document position. QTextEdit computes it from the
+    // block's own QTextLayout, which a long line never has.
+    QRectF cursorRect(int position) const;
+
+    void draw(QPainter *painter, const PaintContext &context) override;
+    int hitTest(const QPointF &point, Qt::HitTestAccuracy accuracy) const override;
+    int pageCount() const override;
+    QSizeF documentSize() const override;
+    QRectF frameBoundingRect(QTextFrame *frame) const override;
+    QRectF blockBoundingRect(const QTextBlock &block) const override;
+
+protected:
+    void documentChanged(int from, int charsRemoved, int charsAdded) override;
+
+private:
+    // Chunk widths and the last laid out slice of one long line.
+    struct LongLine {
+        int revision = -1;
+        int length = -1;
+        QVector<qreal> chunkWidths; // Estimated until the chunk is drawn
+        QVector<qreal> chunkX;      // Start of each chunk, plus the end of the line
+        bool chunkXDirty = true;
+        QSharedPointer<QTextLayout> slice;
+        int sliceFrom = 0; // Chunks [sliceFrom, sliceTo) of the line
+        int sliceTo = 0;
+    };
+
+    void updateMetrics();
+    void ensureRows() const;
+    QTextBlock blockAtRow(int row) const;
+    bool isLong(const QTextBlock &block) const;
+    QTextLayout *ensureBlockLayout(const QTextBlock &block) const;
+    LongLine &longLine(const QTextBlock &block) const;
+    qreal chunkStart(LongLine &line, int chunk) const;
+    int chunkAt(LongLine &line, qreal x) const;
+    QTextLayout *ensureSlice(const QTextBlock &block, LongLine &line, int fromChunk, int toChunk) const;
+    void growWidth(qreal width) const;
+
+    int m_threshold;
+    QFont m_font;
+    qreal m_lineHeight;
+    qreal m_advance;
+    mutable QVector<int> m_rowOfBlock; // By block number; -1 for hidden blocks
+    mutable QVector<int> m_blockOfRow;
+    mutable bool m_rowsDirty;
+    mutable qreal m_width;             // Widest line measured so far
+    mutable bool m_sizeChangePending;
+    QSizeF m_reportedSize;
+    mutable QHash<int, LongLine> m_longLines; // By block number
+};
+
+#endif // ALTELONGLINELAYOUT_H
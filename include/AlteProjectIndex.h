@@ -0,0 +1,98 @@
+#ifndef ALTEPROJECTINDEX_H
+#define ALTEPROJECTINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include "AlteGrammar.h"
+
+class AlteThemeManager;
+class QFileSystemWatcher;
+class QTimer;
+
+// Identifiers of one project file, by path relative to the project folder.
+struct AlteProjectFile {
+    QString path;
+    qint64 modified = 0; // Milliseconds since the epoch
+    qint64 size = 0;
+    QStringList words;
+};
+
+// Opt-in index of the identifiers used across a project folder, for completion
+// beyond the open documents. Files are walked and tokenized on a private thread
+// pool; results are merged on the UI thread in batches, so complete() only ever
+// reads data the UI thread owns. The saved index and its word table are built on
+// the pool and swapped in whole, and a language's grammar is only compiled, on
+// the pool too, once a file of it needs tokenizing. The index is kept on disk
+// per folder and only files whose size or modification time changed are
+// tokenized again. Watched directories trigger a rescan of just that directory.
+// A directory watch does not report a file rewritten in place, so the first
+// indexed files are watched as well, up to a limit; edits to the others are
+// only seen at the next rescan of their directory or when the folder is opened.
+class AlteProjectIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AlteProjectIndex(AlteThemeManager* themeManager, QObject* parent = nullptr);
+    ~AlteProjectIndex() override;
+
+    void openFolder(const QString& folderPath);
+    void close();
+    QString folder() const { return m_folder; }
+    int fileCount() const { return int(m_files.size()); }
+
+    // Up to limit identifiers starting with prefix, used by the most files first.
+    QStringList complete(const QString& prefix, int limit) const;
+    // Re-indexes a file Alte itself just wrote, which a directory watch may not report.
+    void refreshFile(const QString& filePath);
+
+signals:
+    void filesIndexed(int fileCount);
+
+private slots:
+    void onDirectoryChanged(const QString& directoryPath);
+    void saveIndex();
+
+private:
+    // Language by file extension, for the workers to pick the files worth indexing.
+    using LanguageMap = QHash<QString, QString>;
+
+    void startScan(const QString& directoryPath, bool recursive);
+    void loadIndex();
+    QString indexFilePath() const;
+    void tokenizeFiles(quint64 generation, const QHash<QString, QStringList>& changedByLanguage);
+    void buildGrammar(quint64 generation, const QString& language);
+    void grammarReady(quint64 generation, const QString& language, const QSharedPointer<const AlteGrammar>& grammar);
+    void startTokenizing(quint64 generation, const QSharedPointer<const AlteGrammar>& grammar, const QStringList& paths);
+    void applyFiles(quint64 generation, const QVector<AlteProjectFile>& files);
+    void applyListing(quint64 generation, const QString& directoryPath, bool recursive,
+                      const QStringList& present, const QStringList& directories);
+    void addWords(const QStringList& words);
+    void removeWords(const QStringList& words);
+
+    static AlteProjectFile indexFile(const QString& folder, const QString& relativePath,
+                                     const QSharedPointer<const AlteGrammar>& grammar);
+
+    AlteThemeManager* m_themeManager;
+    QString m_folder;
+    LanguageMap m_languages;
+    // By language, compiled on first use; null if the language has no rules.
+    QHash<QString, QSharedPointer<const AlteGrammar>> m_grammars;
+    QHash<QString, QStringList> m_waitingFiles; // By language, while its grammar is compiled
+    QHash<QString, AlteProjectFile> m_files;
+    QMap<QString, int> m_words; // Identifier -> number of files using it
+    QThreadPool m_pool;
+    std::atomic<quint64> m_generation; // Bumped on open and close; stale results are dropped
+    QFileSystemWatcher* m_watcher;
+    QTimer* m_saveTimer;
+    bool m_dirty;
+};
+
+#endif // ALTEPROJECTINDEX_H
@@ -0,0 +1,19 @@
+#ifndef ALTESTARTUPTRACE_H
+#define ALTESTARTUPTRACE_H
+
+// Timing of the startup phases, printed with --startup-trace. Marks are cheap
+// no-ops unless the trace was enabled; they are only made from the UI thread.
+class AlteStartupTrace {
+public:
+    // Starts the clock; call first thing in main().
+    static void start();
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    // Ends the phase named phase: its cost is the time since the previous mark.
+    static void mark(const char* phase);
+    // Prints the phases to stderr; later marks are ignored.
+    static void report();
+};
+
+#endif // ALTESTARTUPTRACE_H
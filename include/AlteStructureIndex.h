@@ -0,0 +1,75 @@
+#ifndef ALTESTRUCTUREINDEX_H
+#define ALTESTRUCTUREINDEX_H
+
+#include <QChar>
+#include <QString>
+#include <QVector>
+#include <span>
+#include "AlteGrammar.h"
+
+// Bracket and indentation summary of one line.
+struct AlteLineShape {
+    qint32 delta = 0;     // Opening minus closing brackets
+    qint32 minPrefix = 0; // Lowest running bracket depth within the line, <= 0
+    qint32 maxSuffix = 0; // Highest opening-minus-closing count of any suffix, >= 0
+    qint32 indent = -1;   // Width of the leading whitespace, -1 for blank lines
+};
+
+// Bracket and indentation structure of a document, one AlteLineShape per line
+// kept in an implicit treap ordered by block number. Ranges of lines can be
+// replaced after an edit, and finding the line that closes or opens a bracket
+// or ends an indented region takes O(log n) instead of a scan of the document.
+class AlteStructureIndex {
+public:
+    struct Bracket {
+        int position; // In the line
+        QChar character;
+        bool opening;
+    };
+
+    AlteStructureIndex();
+    ~AlteStructureIndex();
+    AlteStructureIndex(const AlteStructureIndex&) = delete;
+    AlteStructureIndex& operator=(const AlteStructureIndex&) = delete;
+
+    int lineCount() const;
+    void clear();
+    // Replaces lines [first, first + removed) by shapes.
+    void replaceLines(int first, int removed, const QVector<AlteLineShape>& shapes);
+    void setLine(int line, const AlteLineShape& shape);
+
+    // First line at or after from in which a closing bracket brings depth open
+    // brackets down to zero, or -1. depth is updated to the depth that line is
+    // entered with.
+    int findClosingLine(int from, int& depth) const;
+    // Last line at or before to in which an opening bracket matches the
+    // depth-th unmatched closing bracket, or -1. depth is updated to the number
+    // of unmatched closing brackets at the end of that line.
+    int findOpeningLine(int to, int& depth) const;
+    // First non-blank line at or after from that is indented at most indent, or -1.
+    int findDedentLine(int from, int indent) const;
+
+    // Brackets of a line outside the comment and string tokens of grammar. All
+    // brackets count when grammar is null or the line has no tokens.
+    static void scanBrackets(const QString& text, std::span<const AlteToken> tokens, const AlteGrammar* grammar,
+                             QVector<Bracket>& brackets);
+    static AlteLineShape shapeOf(const QString& text, const QVector<Bracket>& brackets);
+    static QChar counterpart(QChar bracket);
+
+private:
+    struct Node;
+    Node* m_root;
+    quint32 m_seed;
+
+    Node* newNode(const AlteLineShape& shape);
+    static void update(Node* node);
+    static void split(Node* node, int count, Node*& first, Node*& rest);
+    static Node* merge(Node* first, Node* rest);
+    static void destroy(Node* node);
+    static void setLine(Node* node, int line, const AlteLineShape& shape);
+    static int findClosing(const Node* node, int offset, int from, int& depth);
+    static int findOpening(const Node* node, int offset, int to, int& depth);
+    static int findDedent(const Node* node, int offset, int from, int indent);
+};
+
+#endif // ALTESTRUCTUREINDEX_H
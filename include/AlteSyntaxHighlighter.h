@@ -2,41 +2,133 @@
 #define SYNTAXHIGHLIGHTER_H
 
 #include <QSyntaxHighlighter>
-#include <QTextCharFormat>
-#include <QRegularExpression>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+#include <QPointer>
 #include <QVector>
-#include <QJsonObject>
-#include <QFont>
+#include <span>
+#include "AlteGrammar.h"
+#include "AlteStructureIndex.h"
+#include "AlteIdentifierIndex.h"
+#include "AlteTokenStore.h"
+#include "AlteTokenizerWorker.h"
 
 class AlteThemeManager;
 class QTextDocument;
+class QTextEdit;
+class QTextBlock;
+class QThread;
+class QTimer;
 
+// Highlights a document with the grammar of its language. Token runs are kept in
+// an AlteTokenStore and only turned into formats for blocks that are shown; large
+// documents are tokenized on a worker thread. The blocks visible in the attached
+// editor are highlighted first, the rest are tokenized in short idle-time slices
+// that move outwards from the viewport in the direction of scrolling.
 class AlteSyntaxHighlighter : public QSyntaxHighlighter
 {
     Q_OBJECT
 
 public:
     AlteSyntaxHighlighter(QTextDocument *parent, AlteThemeManager *themeManager, const QString& languageName);
+    ~AlteSyntaxHighlighter() override;
     void setCurrentLanguage(const QString& languageName, AlteThemeManager *themeManager);
+    // Swaps in the formats of the theme manager's current theme. Stored tokens
+    // stay valid: only the blocks on screen are formatted again right away, the
+    // others as they are scrolled into view.
+    void applyTheme(AlteThemeManager *themeManager);
+    void attachEditor(QTextEdit *editor);
+    QSharedPointer<const AlteGrammar> grammar() const { return m_grammar; }
+    // Lines longer than this are highlighted in long-line mode: only the part on
+    // screen plus a margin is tokenized and formatted.
+    void setLongLineThreshold(int length);
+    int longLineThreshold() const { return m_longLineThreshold; }
+
+    // Token runs of a block as last tokenized with the current grammar; empty if
+    // the block has not been tokenized yet. Valid until the next edit.
+    std::span<const AlteToken> blockTokens(const QTextBlock& block) const;
+    QTextCharFormat styleFormat(quint16 style) const;
+    // Drops all stored tokens, e.g. before the document is hibernated.
+    void releaseTokens();
+
+    // Position of the bracket matching the one at position, or -1 if there is
+    // no bracket there or it is unmatched. Brackets in comments and strings are
+    // ignored once their line has been tokenized.
+    int matchingBracket(int position) const;
+    // Last block number a fold at block would hide, or -1 if block does not
+    // start a region. A line leaving brackets open folds up to the line closing
+    // them, any other line over the following more indented lines.
+    int foldEnd(const QTextBlock& block) const;
+    bool fold(const QTextBlock& block);
+    bool unfold(const QTextBlock& block);
+    void unfoldAll();
+
+    // Identifiers and keywords starting with prefix, most used in the document first.
+    QStringList completions(const QString& prefix, int limit) const { return m_identifiers.complete(prefix, limit); }
 
 protected:
     void highlightBlock(const QString &text) override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void onLinesTokenized(quint64 version, int firstLine, const QVector<AlteLineTokens>& lines);
+    void onTokenizeFinished(quint64 version);
+    void startBackgroundTokenize();
+    void highlightViewport();
+    void backfillSlice();
 
 private:
-    struct HighlightingRule
-    {
-        QRegularExpression pattern;
-        QTextCharFormat format;
-        bool isBlockRule;
-        QRegularExpression endPattern;
-    };
-    QVector<HighlightingRule> m_highlightingRules;
-
-    void loadRulesForLanguage(const QString& languageName, AlteThemeManager *themeManager);
-    QTextCharFormat createFormatFromRule(const QJsonObject& ruleDetails,
-                                         const QJsonObject& themeColors,
-                                         const QFont& defaultFont,
-                                         AlteThemeManager* themeManager);
+    bool withinSynchronousBudget();
+    void applyFormats(AlteLineRecord* line);
+    void ensureWorker();
+    void ensureStatesUpTo(int blockNumber);
+    bool needsHighlight(const QTextBlock& block) const;
+    bool hasCurrentTokens(const QTextBlock& block) const;
+    void highlightLongLine(const QString &text);
+    bool updateLongLineFocus(const QTextBlock& block);
+    void tokenizeIntoStore(QTextBlock& block);
+    AlteLineShape lineShape(const QTextBlock& block) const;
+    void updateStructure(const QTextBlock& block);
+    void rebuildStructure(QTextDocument* doc);
+    void indexIdentifiers(const QTextBlock& block, const QString& text);
+
+    QSharedPointer<const AlteGrammar> m_grammar;
+    QVector<QTextCharFormat> m_formats; // By token style, for the current theme
+    quint32 m_formatEpoch;  // Bumped whenever m_formats changes; tags formatted blocks
+    quint32 m_generation;   // Bumped on every language change; tags stored block tokens
+    quint64 m_version;      // Bumped on every language change and text edit; tags snapshots
+    int m_lastRevision;
+    quint64 m_jobVersion;
+    bool m_jobInFlight;
+    bool m_deferredBlocks;  // A synchronous pass ran out of time and left blocks untokenized
+    QElapsedTimer m_passTimer;
+    QThread *m_workerThread;
+    AlteTokenizerWorker *m_worker;
+    QTimer *m_restartTimer;
+    QPointer<QTextEdit> m_editor;
+    AlteTokenStore m_store;
+    QVector<AlteToken> m_scratchTokens;
+
+    int m_stateWatermark;   // Block states are known to be right up to this block number
+    QTimer *m_backfillTimer;
+    int m_backfillDown;     // Next block to backfill below the viewport
+    int m_backfillUp;       // Next block to backfill above the viewport
+    int m_scrollDirection;  // +1 when the user last scrolled down, -1 when up
+    int m_lastScrollValue;
+
+    int m_longLineThreshold;
+    int m_longLineFocusBlock; // Long block whose visible part is m_longLineFocusFrom..To
+    int m_longLineFocusFrom;
+    int m_longLineFocusTo;
+
+    AlteStructureIndex m_structure;
+    mutable QVector<AlteStructureIndex::Bracket> m_scratchBrackets;
+    int m_structurePendingFrom; // Lines re-tokenized while an edit was being applied
+    int m_structurePendingTo;
+
+    AlteIdentifierIndex m_identifiers;
+    QTimer *m_identifierRecountTimer; // Recounts identifiers and token runs once lines have been deleted
 };
 
 #endif // SYNTAXHIGHLIGHTER_H
@@ -2,22 +2,83 @@
 #define ALTETHEME_H
 
 #include <QString>
-#include <QMap>
-#include <QTextCharFormat>
+#include <QByteArray>
 #include <QColor>
+#include <QHash>
+#include <QJsonObject>
+#include <QSharedPointer>
+#include <QTextCharFormat>
+#include <QVector>
 
+// A theme JSON compiled once into lookup tables: colors are parsed up front and
+// stored by interned id, each style_key of "syntax_formats" (or the older
+// "token_styles") becomes a ready QTextCharFormat, and the "styles" templates
+// are rendered into finished stylesheets. Compiled themes are immutable,
+// so switching themes swaps one pointer and readers never see a half-loaded one.
 class AlteTheme {
 public:
-    AlteTheme();
-    bool loadThemeFromFile(const QString &filePath);
-    QTextCharFormat getFormat(const QString &type) const;
-    QColor getColor(const QString &type) const;
+    static QSharedPointer<const AlteTheme> compile(const QJsonObject& themeData, const QByteArray& fingerprint);
+
+    // Ids are interned process-wide, so an id indexes every theme. Lookups never
+    // add names: one no theme defines is -1, which every accessor below answers
+    // with its default. Both hash the name under a lock; callers that look a
+    // name up repeatedly keep its id instead.
+    static int colorId(const QString& name);
+    static int styleId(const QString& styleKey);
+    // Interns a name a caller will look up, so it has an id before any theme
+    // defines it and the id can be kept across theme switches. Takes the write
+    // lock: call it once, when a theme or language is attached.
+    static int registerColorName(const QString& name);
+    static int registerStyleKey(const QString& styleKey);
+
+    QString name() const { return m_name; }
+    QByteArray fingerprint() const { return m_fingerprint; }
+
+    // Entry of "colors", or defaultValue if the theme does not define it.
+    QColor color(int id, const QColor& defaultValue) const {
+        return id >= 0 && id < m_colors.size() && m_colors[id].isValid() ? m_colors[id] : defaultValue;
+    }
+    // Entry of "syntax", or defaultValue.
+    QColor syntaxColor(int id, const QColor& defaultValue) const {
+        return id >= 0 && id < m_syntaxColors.size() && m_syntaxColors[id].isValid() ? m_syntaxColors[id] : defaultValue;
+    }
+    // Format of a style_key, or nullptr if the theme does not style it.
+    const QTextCharFormat* styleFormat(int id) const {
+        return id >= 0 && id < m_styleFormats.size() && m_hasStyle[id] ? &m_styleFormats[id] : nullptr;
+    }
+
+    // "styles" entry of a widget selector with its %%color%% placeholders
+    // filled in; empty if the theme does not style the selector.
+    QString styleSheet(const QString& widgetName) const { return m_styleSheets.value(widgetName); }
+    // Every "styles" entry as "selector { ... }", one per line.
+    const QString& globalStyleSheet() const { return m_globalStyleSheet; }
+    int styleSheetCount() const { return int(m_styleSheets.size()); }
+    const QJsonObject& fontInfo() const { return m_fontInfo; }
 
 private:
-    QString name;
-    QString themeType;
-    QMap<QString, QColor> editorColors;
-    QMap<QString, QTextCharFormat> syntaxFormats;
+    // A run of template text, or a %%name%% placeholder when colorId >= 0.
+    struct StyleSegment {
+        QString text;
+        int colorId;
+    };
+
+    AlteTheme() = default;
+    QColor resolveColor(const QString& value) const;
+    static QVector<StyleSegment> tokenizeStyle(const QString& style);
+    qsizetype renderedLength(const QVector<StyleSegment>& segments) const;
+    void renderStyle(const QVector<StyleSegment>& segments, QString& out) const;
+    void renderStyleSheets(const QJsonObject& styles);
+
+    QString m_name;
+    QByteArray m_fingerprint;
+    QVector<QColor> m_colors;       // By color id
+    QVector<QColor> m_syntaxColors; // By style id
+    QVector<QTextCharFormat> m_styleFormats; // By style id
+    QVector<bool> m_hasStyle;
+    QVector<QString> m_colorValues; // By color id, as written in the theme
+    QHash<QString, QString> m_styleSheets; // Widget selector -> rendered stylesheet
+    QString m_globalStyleSheet;
+    QJsonObject m_fontInfo;
 };
 
 #endif // ALTETHEME_H
@@ -11,6 +11,11 @@
 #include <QFont>
 #include <QPalette>
 #include <QMap> // Added for getAvailableThemes
+#include <QHash>
+#include <QVector>
+#include <QRegularExpression>
+#include <QSharedPointer>
+#include "AlteTheme.h"
 
 class AlteThemeManager {
 public:
@@ -19,27 +24,92 @@ public:
     bool loadTheme(const QString& filePath);
     void applyTheme(QApplication* app) const;
 
+    // Entry of the current theme's "colors" by an id from
+    // AlteTheme::registerColorName(); no lock and no hashing.
+    QColor color(int colorId, const QColor& defaultValue = Qt::black) const { return m_theme->color(colorId, defaultValue); }
+    // By name, for cold paths: hashes the name under a lock on every call.
     QColor getColor(const QString& name, const QColor& defaultValue = Qt::black) const;
     QColor getSyntaxColor(const QString& name, const QColor& defaultValue = Qt::black) const;
     QString getStyleSheet(const QString& widgetName) const;
+    // The compiled current theme; loadTheme() replaces it, it is never null.
+    QSharedPointer<const AlteTheme> theme() const { return m_theme; }
+    // File the current theme was loaded from; empty before the first loadTheme().
+    QString themeFilePath() const { return m_themeFilePath; }
 
 
 private:
-    QJsonObject themeData;
-    QJsonObject colors;
-    QJsonObject syntaxColors;
-    QJsonObject styles;
-    QJsonObject syntaxHighlightingRules;
-    QJsonObject fontInfo;
-    QMap<QString, QJsonObject> m_languageDefinitions;
+    QSharedPointer<const AlteTheme> m_theme;
+    QString m_themeFilePath;
+    // What is needed of a language before it is used: detection data, keywords
+    // and the file's hash. Cached on disk by path, modification time and size.
+    struct LanguageManifestEntry {
+        QString filePath;
+        qint64 modified = 0; // Milliseconds since the epoch
+        qint64 size = -1;
+        QString name;
+        QStringList extensions;
+        QStringList firstLinePatterns;
+        QStringList keywords;
+        QStringList contentTokens;
+        QByteArray fingerprint; // SHA-1 of the file
+        const char* definition = nullptr; // JSON compiled into the binary, if bundled; not saved
+    };
+    QMap<QString, LanguageManifestEntry> m_languages; // By language name
+    // Full definitions, parsed on first use; only touched from the UI thread.
+    mutable QMap<QString, QJsonObject> m_languageDefinitions;
+
+    // Language detection tables, rebuilt by loadLanguageDefinitions().
+    struct FirstLineMatcher {
+        QString language;
+        QRegularExpression pattern;
+    };
+    struct SniffWeight {
+        int language; // Index into m_sniffLanguages
+        float weight;
+    };
+    QHash<QString, QString> m_extensionLanguages; // Extension without the dot -> language
+    QVector<FirstLineMatcher> m_firstLineMatchers;
+    QStringList m_sniffLanguages;
+    QVector<int> m_sniffVocabularySizes;
+    QHash<QString, QVector<SniffWeight>> m_sniffTokens; // Token -> languages using it
+
+    // Names of the theme files seen so far, so listing themes only reads files
+    // that are new or changed. Kept on disk between runs.
+    struct ThemeCatalogEntry {
+        qint64 modified = 0; // Milliseconds since the epoch
+        qint64 size = -1;
+        QString name;
+    };
+    mutable QHash<QString, ThemeCatalogEntry> m_themeCatalog; // By canonical file path
+    mutable bool m_themeCatalogLoaded = false;
+    mutable QHash<QString, QString> m_themeDirectories; // Requested path -> directory found for it
 
     QString generateGlobalStyleSheet() const;
+    void loadThemeCatalog() const;
+    void saveThemeCatalog() const;
+    static QString themeCatalogPath();
+    static QString readThemeName(const QString& filePath);
+    void buildDetectionTables();
+    static void readLanguageFile(LanguageManifestEntry& entry);
+    static bool readBuiltinLanguage(const QString& fileName, const QByteArray& fingerprint, LanguageManifestEntry& entry);
+    static QString languageManifestPath();
+    static QHash<QString, LanguageManifestEntry> loadLanguageManifest();
+    static void saveLanguageManifest(const QVector<LanguageManifestEntry>& entries);
+    QString sniffLanguage(const QString& content) const;
 
 public:
-    void loadLanguageDefinitions(const QString& directoryPath);
-    QString detectLanguage(const QString& filePath, const QString& firstLineContent) const;
+    // Reads what detection needs of each language file, from the on-disk
+    // manifest where the file is unchanged; full definitions are parsed on first use.
+    // Languages compiled into the binary are used unless a file replaces them.
+    void loadLanguageDefinitions(const QString& directoryPath = "resources/syntax/");
+    // Extension first, then the first-line patterns, then the keywords found in
+    // the first few KB of content if it is given.
+    QString detectLanguage(const QString& filePath, const QString& firstLineContent,
+                           const QString& content = QString()) const;
     QStringList getAvailableLanguages() const;
     QStringList getExtensionsForLanguage(const QString& languageName) const;
+    // Entries of the language's "keywords" rules.
+    QStringList getKeywordsForLanguage(const QString& languageName) const;
 
 public:
     QFont getApplicationFont(const QFont& defaultFont = QApplication::font()) const;
@@ -47,9 +117,13 @@ public:
 
 public:
     QJsonObject getSyntaxRulesForLanguage(const QString& languageName) const;
+    // Content hashes used to key compiled grammar caches; empty if not loaded.
+    QByteArray languageFingerprint(const QString& languageName) const { return m_languages.value(languageName).fingerprint; }
+    QByteArray themeFingerprint() const { return m_theme->fingerprint(); }
 
     int getStylesObjectSizeForDebug() const;
 
+    // Theme name -> file; themes compiled into the binary have a "builtin:" path.
     QMap<QString, QString> getAvailableThemes(const QString& directoryPath = "resources/themes/") const;
 };
 
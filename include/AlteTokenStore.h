@@ -0,0 +1,66 @@
+#ifndef ALTETOKENSTORE_H
+#define ALTETOKENSTORE_H
+
+#include <QVector>
+#include <QTextBlockUserData>
+#include <span>
+#include "AlteGrammar.h"
+
+class QTextBlock;
+class QTextDocument;
+
+// Per-block record of the last tokenization. The token runs themselves live in
+// the AlteTokenStore arena; the record only points into it.
+class AlteLineRecord : public QTextBlockUserData {
+public:
+    quint32 firstRun = 0;
+    quint32 runCount = 0;
+    uint textHash = 0;
+    int entryState = 0;
+    int exitState = 0;
+    quint32 generation = 0; // Grammar generation the runs were produced with
+    quint32 formatEpoch = 0; // Format table the runs were last applied to the block's layout with, 0 = none
+    // Long-line mode: the runs only cover [windowStart, windowEnd) of the line,
+    // which is entered in windowEntryState.
+    bool windowed = false;
+    quint32 windowStart = 0;
+    quint32 windowEnd = 0;
+    int windowEntryState = 0;
+    // Identifiers of the line in the AlteIdentifierIndex arena.
+    quint32 firstWord = 0;
+    quint32 wordCount = 0;
+};
+
+// Token runs of a whole document in one contiguous array, so a highlighted line
+// costs one small record plus its runs instead of a vector and a list of
+// QTextCharFormat ranges. Formats are only resolved from the style ids when a
+// block is formatted for display; other consumers (minimap, bracket matching,
+// completion, export) can read the runs directly.
+class AlteTokenStore {
+public:
+    static AlteLineRecord* record(const QTextBlock& block);
+
+    // Replaces the runs of the block, creating its record if needed.
+    AlteLineRecord* setLine(const QTextBlock& block, const QVector<AlteToken>& tokens,
+                            uint textHash, int entryState, int exitState, quint32 generation);
+
+    // Valid until the next call to setLine() or clear().
+    std::span<const AlteToken> tokens(const AlteLineRecord* record) const;
+
+    // Drops every record of the document and the arena.
+    void clear(QTextDocument* document);
+
+    // Recounts the dead runs and compacts the arena if they make up most of it.
+    // Deleted blocks take their records along, so their runs are only found here.
+    void collectGarbage(QTextDocument* document);
+
+    qsizetype runCount() const { return m_runs.size(); }
+
+private:
+    void compact(QTextDocument* document);
+
+    QVector<AlteToken> m_runs;
+    qsizetype m_garbage = 0; // Runs replaced by setLine(); those of deleted lines only after collectGarbage()
+};
+
+#endif // ALTETOKENSTORE_H
@@ -0,0 +1,68 @@
+#ifndef ALTETOKENIZERWORKER_H
+#define ALTETOKENIZERWORKER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QSharedPointer>
+#include <QAtomicInteger>
+#include <QMetaType>
+#include <QThreadPool>
+#include "AlteGrammar.h"
+
+// Tokens of one line as produced by a tokenizer run.
+struct AlteLineTokens {
+    QVector<AlteToken> tokens;
+    uint textHash = 0;
+    int entryState = 0;
+    int exitState = 0;
+};
+
+// Tokenizes document snapshots on a background thread. Lives in its own QThread;
+// results are published in batches and tagged with the snapshot version, so the
+// highlighter can drop results that belong to an outdated snapshot. Large
+// snapshots are split into chunks that are tokenized in parallel on the worker's
+// own thread pool, then reconciled and published one chunk at a time, in order.
+class AlteTokenizerWorker : public QObject {
+    Q_OBJECT
+
+public:
+    explicit AlteTokenizerWorker(QObject* parent = nullptr);
+
+    // Called from the UI thread whenever a newer snapshot exists; a running job
+    // for an older version stops at its next batch.
+    void setLatestVersion(quint64 version) { m_latestVersion.storeRelaxed(version); }
+    // Lines longer than this only get their exit state; the highlighter tokenizes
+    // the part of them that is on screen itself.
+    void setLongLineThreshold(int length) { m_longLineThreshold.storeRelaxed(length); }
+
+    // Runs on the worker thread. rawText is QTextDocument::toRawText(), i.e. blocks
+    // separated by U+2029. finished() is emitted even when the job is abandoned.
+    void tokenize(quint64 version, QSharedPointer<const AlteGrammar> grammar, const QString& rawText, int blockCount);
+
+signals:
+    void linesTokenized(quint64 version, int firstLine, const QVector<AlteLineTokens>& lines);
+    void finished(quint64 version);
+
+private:
+    struct LineSpan {
+        int start;
+        int length;
+    };
+
+    // Tokenizes lines [first, last) into out. Returns false if the version went
+    // stale on the way. Called from pool threads.
+    bool tokenizeRange(quint64 version, const AlteGrammar& grammar, const QString& rawText,
+                       const QVector<LineSpan>& spans, int first, int last, int entryState,
+                       QVector<AlteLineTokens>& out) const;
+    int tokenizeLine(const AlteGrammar& grammar, const QString& text, int entryState, QVector<AlteToken>& tokens) const;
+
+    // Own pool, so chunks do not queue behind unrelated work on the global one.
+    QThreadPool m_pool;
+    QAtomicInteger<quint64> m_latestVersion;
+    QAtomicInt m_longLineThreshold;
+};
+
+Q_DECLARE_METATYPE(QVector<AlteLineTokens>)
+
+#endif // ALTETOKENIZERWORKER_H
@@ -0,0 +1,53 @@
+#ifndef ALTETRACE_H
+#define ALTETRACE_H
+
+#include <QString>
+#include <atomic>
+
+// Trace-event profiler. Scoped zones are recorded into a buffer per thread and
+// written as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev
+// open. While recording is off a zone costs one relaxed atomic load; building
+// with ALTE_NO_TRACING removes the zones altogether.
+class AlteTrace {
+public:
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    // Starting a recording drops the events of the previous one.
+    static void setEnabled(bool enabled);
+    // Writes the events recorded so far; false if the file could not be written.
+    static bool writeJson(const QString& filePath);
+
+private:
+    friend class AlteTraceZone;
+    static void record(const char* category, const char* name, qint64 startNs, qint64 endNs);
+    static qint64 nowNs();
+
+    static std::atomic<bool> s_enabled;
+};
+
+// Records the time from its construction to the end of the scope. category
+// and name must outlive the recording; string literals and class names do.
+class AlteTraceZone {
+public:
+    AlteTraceZone(const char* category, const char* name)
+        : m_category(category), m_name(name), m_startNs(AlteTrace::isEnabled() ? AlteTrace::nowNs() : -1) {}
+    ~AlteTraceZone() {
+        if (m_startNs >= 0) AlteTrace::record(m_category, m_name, m_startNs, AlteTrace::nowNs());
+    }
+    AlteTraceZone(const AlteTraceZone&) = delete;
+    AlteTraceZone& operator=(const AlteTraceZone&) = delete;
+
+private:
+    const char* m_category;
+    const char* m_name;
+    qint64 m_startNs;
+};
+
+#define ALTE_TRACE_CONCAT_(a, b) a##b
+#define ALTE_TRACE_CONCAT(a, b) ALTE_TRACE_CONCAT_(a, b)
+#ifdef ALTE_NO_TRACING
+#define ALTE_TRACE_ZONE(category, name) do {} while (false)
+#else
+#define ALTE_TRACE_ZONE(category, name) AlteTraceZone ALTE_TRACE_CONCAT(alteTraceZone, __LINE__)(category, name)
+#endif
+
+#endif // ALTETRACE_H
@@ -5,14 +5,23 @@
 #include <QString>
 #include <QCloseEvent>
 #include <QMenuBar>
+#include <QStringList>
 
 class QTextEdit;
 class QAction;
 class QTimer;
 class QEvent;
+class QFileSystemWatcher;
+class QTabWidget;
+class QMenu;
 
 #include "AlteSyntaxHighlighter.h"
 class AlteThemeManager;
+class AlteDocumentManager;
+class AlteHighlighterProfileDialog;
+class QCompleter;
+class AlteProjectIndex;
+class QStringListModel;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -23,12 +32,15 @@ public:
 
 protected:
     void closeEvent(QCloseEvent *event) override;
-    bool eventFilter(QObject *obj, QEvent *event) override;
     void dragEnterEvent(QDragEnterEvent *event) override;
     void dropEvent(QDropEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
+
+signals:
+    // Once, after the window has been painted for the first time.
+    void firstFramePainted();
 
 public slots:
-    void resetTextEditBorderSlot();
     void toggleTypewriterMode();
     void updateTypewriterCenter();
     void newFile();
@@ -37,12 +49,32 @@ public slots:
     bool saveFile();
     bool saveFileAs();
     bool maybeSave();
+    void onFileChangedOnDisk(const QString &filePath);
+    void reloadFromDisk();
+    void closeTab(int index);
+    void onCurrentTabChanged(int index);
+    void showHighlighterProfile();
+    void updateBracketMatch();
+    void foldAtCursor();
+    void unfoldAtCursor();
+    void completeWord();
+    void indexProjectFolder();
+    void insertCompletion(const QString &completion);
+    void switchTheme(const QString &themeFilePath);
+    void recordTrace(bool enabled);
 
 private:
     void createActions();
     void createMenus();
-    QString resolveTextEditStyleSheet(bool useGlowColor);
-    void applyTextEditFocusGlow();
+    void populateThemeMenu(QMenu *themeMenu);
+    QString resolveTextEditStyleSheet();
+    void watchCurrentFile();
+    void watchThemeFile();
+    QTextEdit* createEditor();
+    QTextEdit* editorAt(int index) const;
+    bool openFileInTab(const QString &filePath);
+    void reloadDocumentFromDisk(QTextEdit *editor);
+    void updateTabTitle(QTextEdit *editor);
 
     QTextEdit *textEdit;
     QAction *typewriterModeAction;
@@ -51,6 +83,7 @@ private:
     QAction *openAction;
     QAction *saveAction;
     QAction *saveAsAction;
+    QAction *closeTabAction;
     QAction *exitAction;
     QAction *undoAction;
     QAction *redoAction;
@@ -58,12 +91,35 @@ private:
     QAction *copyAction;
     QAction *pasteAction;
     QAction *selectAllAction;
+    QAction *highlighterProfileAction;
+    QAction *foldAction;
+    QAction *unfoldAction;
+    QAction *unfoldAllAction;
+    QAction *completeWordAction;
+    QAction *indexFolderAction;
+    QAction *recordTraceAction;
 
     QString currentFilePath;
     AlteSyntaxHighlighter *highlighter;
     AlteThemeManager* m_themeManager;
-    QTimer* m_focusTimer;
-    QString m_originalTextEditStyleSheet;
+    QString m_textEditStyleSheet;
+    // Theme colors of the window, registered once; kept across theme switches.
+    int m_glowColorId;
+    int m_bracketColorId;
+    int m_borderColorId;
+    QFileSystemWatcher* m_fileWatcher;
+    QTimer* m_reloadTimer;
+    QFileSystemWatcher* m_themeWatcher;
+    QTimer* m_themeReloadTimer;
+    QStringList m_pendingReloads;
+    QTabWidget* m_tabWidget;
+    AlteDocumentManager* m_documentManager;
+    AlteHighlighterProfileDialog* m_profileDialog;
+    QCompleter* m_completer;
+    QStringListModel* m_completionModel;
+    QString m_completionPrefix;
+    AlteProjectIndex* m_projectIndex;
+    bool m_firstFramePainted;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,33 @@
+#include "AlteApplication.h"
+#include "AlteTrace.h"
+#include <QEvent>
+
+AlteApplication::AlteApplication(int& argc, char** argv)
+    : QApplication(argc, argv) {
+}
+
+bool AlteApplication::notify(QObject* receiver, QEvent* event) {
+#ifndef ALTE_NO_TRACING
+    if (AlteTrace::isEnabled()) {
+        // Zones are named after the receiving class, whose name is static.
+        switch (event->type()) {
+        case QEvent::UpdateRequest: {
+            ALTE_TRACE_ZONE("paint", "frame");
+            return QApplication::notify(receiver, event);
+        }
+        case QEvent::Paint: {
+            ALTE_TRACE_ZONE("paint", receiver->metaObject()->className());
+            return QApplication::notify(receiver, event);
+        }
+        case QEvent::LayoutRequest:
+        case QEvent::Resize: {
+            ALTE_TRACE_ZONE("layout", receiver->metaObject()->className());
+            return QApplication::notify(receiver, event);
+        }
+        default:
+            break;
+        }
+    }
+#endif
+    return QApplication::notify(receiver, event);
+}
@@ -0,0 +1,364 @@
+#include "AlteDocumentDiff.h"
+#include "AlteLog.h"
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QStringView>
+#include <QHash>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Above this many lines the changed region is first diffed as content-defined chunks.
+const int kDirectLineDiffLimit = 4096;
+// A chunk ends after a line whose hash has these bits clear (~32 lines per chunk) ...
+const uint kChunkBoundaryMask = 31;
+// ... or once it grows this long, so runs of identical lines stay bounded.
+const int kMaxChunkLines = 256;
+// Myers gives up beyond this edit distance and the region is replaced as a whole.
+const int kMaxEditDistance = 1024;
+
+struct LineRef {
+    int start;
+    int length;
+    uint hash;
+};
+
+struct Chunk {
+    int firstLine;
+    int lineCount;
+    uint hash;
+};
+
+struct Hunk {
+    int oldStart;
+    int oldLength;
+    int newStart;
+    int newLength;
+};
+
+QVector<LineRef> splitLines(const QString& text, int from, int to) {
+    QVector<LineRef> lines;
+    const QChar* data = text.constData();
+    int lineStart = from;
+    for (int i = from; i <= to; ++i) {
+        if (i == to || data[i] == QLatin1Char('\n')) {
+            const QStringView view(data + lineStart, i - lineStart);
+            lines.append({lineStart, i - lineStart, uint(qHash(view))});
+            lineStart = i + 1;
+        }
+    }
+    return lines;
+}
+
+QVector<Chunk> buildChunks(const QVector<LineRef>& lines) {
+    QVector<Chunk> chunks;
+    Chunk current{0, 0, 0};
+    for (int i = 0; i < lines.size(); ++i) {
+        current.hash = current.hash * 31u + lines[i].hash;
+        ++current.lineCount;
+        if ((lines[i].hash & kChunkBoundaryMask) == 0 || current.lineCount >= kMaxChunkLines) {
+            chunks.append(current);
+            current = Chunk{i + 1, 0, 0};
+        }
+    }
+    if (current.lineCount > 0) {
+        chunks.append(current);
+    }
+    return chunks;
+}
+
+// Myers' O((N+M)D) diff. Appends the unmatched regions of [0,n) x [0,m) to hunks,
+// offset by oldBase/newBase. Returns false if the edit distance exceeds maxD.
+template <typename Equal>
+bool myersHunks(int n, int m, int oldBase, int newBase, const Equal& equal, int maxD, QVector<Hunk>& hunks) {
+    const int dLimit = qMin(n + m, maxD);
+    const int offset = dLimit + 1;
+    std::vector<int> v(size_t(2 * dLimit + 3), 0);
+    std::vector<std::vector<int>> trace;
+
+    int foundD = -1;
+    for (int d = 0; d <= dLimit && foundD < 0; ++d) {
+        // Keep only the diagonals [-d-1, d+1] that the backtrack below reads.
+        trace.emplace_back(v.begin() + (offset - d - 1), v.begin() + (offset + d + 2));
+        for (int k = -d; k <= d; k += 2) {
+            int x;
+            if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) {
+                x = v[offset + k + 1];
+            } else {
+                x = v[offset + k - 1] + 1;
+            }
+            int y = x - k;
+            while (x < n && y < m && equal(x, y)) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                foundD = d;
+                break;
+            }
+        }
+    }
+    if (foundD < 0) {
+        return false;
+    }
+
+    QVector<QPair<int, int>> matches;
+    int x = n;
+    int y = m;
+    for (int d = foundD; d >= 0; --d) {
+        const std::vector<int>& slice = trace[size_t(d)];
+        auto at = [&](int k) { return slice[size_t(k + d + 1)]; };
+        const int k = x - y;
+        int prevK;
+        if (k == -d || (k != d && at(k - 1) < at(k + 1))) {
+            prevK = k + 1;
+        } else {
+            prevK = k - 1;
+        }
+        const int prevX = at(prevK);
+        const int prevY = prevX - prevK;
+        while (x > prevX && y > prevY && x > 0 && y > 0) {
+            --x;
+            --y;
+            matches.append(qMakePair(x, y));
+        }
+        x = prevX;
+        y = prevY;
+    }
+    std::reverse(matches.begin(), matches.end());
+
+    int nextOld = 0;
+    int nextNew = 0;
+    for (const QPair<int, int>& match : matches) {
+        if (match.first > nextOld || match.second > nextNew) {
+            hunks.append({oldBase + nextOld, match.first - nextOld, newBase + nextNew, match.second - nextNew});
+        }
+        nextOld = match.first + 1;
+        nextNew = match.second + 1;
+    }
+    if (nextOld < n || nextNew < m) {
+        hunks.append({oldBase + nextOld, n - nextOld, newBase + nextNew, m - nextNew});
+    }
+    return true;
+}
+
+class RegionDiffer {
+public:
+    RegionDiffer(const QString& oldText, const QVector<LineRef>& oldLines,
+                 const QString& newText, const QVector<LineRef>& newLines)
+        : m_oldText(oldText), m_oldLines(oldLines), m_newText(newText), m_newLines(newLines) {}
+
+    bool linesEqual(int oldIndex, int newIndex) const {
+        const LineRef& a = m_oldLines[oldIndex];
+        const LineRef& b = m_newLines[newIndex];
+        return a.hash == b.hash && a.length == b.length
+               && std::memcmp(m_oldText.constData() + a.start, m_newText.constData() + b.start,
+                              size_t(a.length) * sizeof(QChar)) == 0;
+    }
+
+    // Line-level diff of old [oldStart, oldEnd) against new [newStart, newEnd).
+    void diffLines(int oldStart, int oldEnd, int newStart, int newEnd, QVector<Hunk>& hunks) const {
+        const int n = oldEnd - oldStart;
+        const int m = newEnd - newStart;
+        if (n == 0 && m == 0) {
+            return;
+        }
+        auto equal = [&](int x, int y) { return linesEqual(oldStart + x, newStart + y); };
+        if (n == 0 || m == 0 || !myersHunks(n, m, oldStart, newStart, equal, kMaxEditDistance, hunks)) {
+            hunks.append({oldStart, n, newStart, m});
+        }
+    }
+
+    void diffAll(QVector<Hunk>& hunks) const {
+        const int oldCount = m_oldLines.size();
+        const int newCount = m_newLines.size();
+        if (oldCount <= kDirectLineDiffLimit && newCount <= kDirectLineDiffLimit) {
+            diffLines(0, oldCount, 0, newCount, hunks);
+            return;
+        }
+
+        // Large region: align content-defined chunks first so that a few scattered
+        // edits in a huge file only cost a line-level diff around each of them.
+        const QVector<Chunk> oldChunks = buildChunks(m_oldLines);
+        const QVector<Chunk> newChunks = buildChunks(m_newLines);
+        auto chunksEqual = [&](int x, int y) {
+            return oldChunks[x].hash == newChunks[y].hash && oldChunks[x].lineCount == newChunks[y].lineCount;
+        };
+        QVector<Hunk> chunkHunks;
+        if (!myersHunks(oldChunks.size(), newChunks.size(), 0, 0, chunksEqual, kMaxEditDistance, chunkHunks)) {
+            hunks.append({0, oldCount, 0, newCount});
+            return;
+        }
+
+        // Walk the chunk alignment. Matched chunks are verified line by line (the
+        // chunk hash only proposes them); anything unverified joins the pending gap.
+        int gapOld = 0;
+        int gapNew = 0;
+        int oldChunk = 0;
+        int newChunk = 0;
+        auto consumeMatchedChunks = [&](int untilOldChunk) {
+            while (oldChunk < untilOldChunk) {
+                const Chunk& a = oldChunks[oldChunk];
+                const Chunk& b = newChunks[newChunk];
+                bool verified = true;
+                for (int i = 0; i < a.lineCount && verified; ++i) {
+                    verified = linesEqual(a.firstLine + i, b.firstLine + i);
+                }
+                if (verified) {
+                    diffLines(gapOld, a.firstLine, gapNew, b.firstLine, hunks);
+                    gapOld = a.firstLine + a.lineCount;
+                    gapNew = b.firstLine + b.lineCount;
+                }
+                ++oldChunk;
+                ++newChunk;
+            }
+        };
+        for (const Hunk& chunkHunk : chunkHunks) {
+            consumeMatchedChunks(chunkHunk.oldStart);
+            oldChunk = chunkHunk.oldStart + chunkHunk.oldLength;
+            newChunk = chunkHunk.newStart + chunkHunk.newLength;
+        }
+        consumeMatchedChunks(oldChunks.size());
+        diffLines(gapOld, oldCount, gapNew, newCount, hunks);
+    }
+
+private:
+    const QString& m_oldText;
+    const QVector<LineRef>& m_oldLines;
+    const QString& m_newText;
+    const QVector<LineRef>& m_newLines;
+};
+
+QVector<AlteLineEdit> toLineEdits(int firstLine, const QVector<Hunk>& hunks, const QString& newText,
+                                  const QVector<LineRef>& newLines) {
+    QVector<AlteLineEdit> edits;
+    edits.reserve(hunks.size());
+    for (const Hunk& hunk : hunks) {
+        AlteLineEdit edit;
+        edit.firstLine = firstLine + hunk.oldStart;
+        edit.removedLines = hunk.oldLength;
+        for (int i = 0; i < hunk.newLength; ++i) {
+            const LineRef& line = newLines[hunk.newStart + i];
+            edit.insertedLines.append(newText.mid(line.start, line.length));
+        }
+        edits.append(edit);
+    }
+    return edits;
+}
+
+bool blockEquals(const QTextBlock& block, const QString& newText, const LineRef& line) {
+    if (block.length() - 1 != line.length) {
+        return false;
+    }
+    const QString text = block.text();
+    return std::memcmp(text.constData(), newText.constData() + line.start, size_t(line.length) * sizeof(QChar)) == 0;
+}
+
+} // namespace
+
+QVector<AlteLineEdit> AlteDocumentDiff::computeLineEdits(const QTextDocument* document, const QString& newText) {
+    const QVector<LineRef> newLines = splitLines(newText, 0, int(newText.size()));
+    const int oldCount = document->blockCount();
+    const int newCount = newLines.size();
+
+    // Unchanged lines at both ends are compared in place, one block at a time.
+    int head = 0;
+    QTextBlock first = document->begin();
+    while (head < oldCount && head < newCount && blockEquals(first, newText, newLines[head])) {
+        first = first.next();
+        ++head;
+    }
+    if (head == oldCount && head == newCount) {
+        return {};
+    }
+    int tail = 0;
+    QTextBlock last = document->lastBlock();
+    while (tail < oldCount - head && tail < newCount - head
+           && blockEquals(last, newText, newLines[newCount - 1 - tail])) {
+        last = last.previous();
+        ++tail;
+    }
+
+    QString oldText;
+    QVector<LineRef> oldLines;
+    QTextBlock block = first;
+    for (int i = head; i < oldCount - tail; ++i, block = block.next()) {
+        const QString text = block.text();
+        const int start = int(oldText.size());
+        oldText += text;
+        oldText += QLatin1Char('\n');
+        oldLines.append({start, int(text.size()), uint(qHash(QStringView(text)))});
+    }
+    const QVector<LineRef> regionLines = newLines.mid(head, newCount - tail - head);
+    QVector<Hunk> hunks;
+    RegionDiffer(oldText, oldLines, newText, regionLines).diffAll(hunks);
+    return toLineEdits(head, hunks, newText, regionLines);
+}
+
+bool AlteDocumentDiff::applyLineEdits(QTextDocument* document, const QVector<AlteLineEdit>& edits) {
+    if (!document) {
+        return false;
+    }
+    int previousEnd = 0;
+    for (const AlteLineEdit& edit : edits) {
+        if (edit.firstLine < previousEnd || edit.removedLines < 0
+            || edit.firstLine + edit.removedLines > document->blockCount()) {
+            qCWarning(lcDocument) << "AlteDocumentDiff: Edit at line" << edit.firstLine << "does not fit the document.";
+            return false;
+        }
+        previousEnd = edit.firstLine + edit.removedLines;
+    }
+
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    // Bottom-up, so the line numbers of the remaining edits stay valid.
+    for (int i = edits.size() - 1; i >= 0; --i) {
+        const AlteLineEdit& edit = edits[i];
+        const QString inserted = edit.insertedLines.join(QLatin1Char('\n'));
+        if (edit.removedLines > 0) {
+            const QTextBlock first = document->findBlockByNumber(edit.firstLine);
+            const QTextBlock last = document->findBlockByNumber(edit.firstLine + edit.removedLines - 1);
+            const int lastEnd = last.position() + last.length() - 1;
+            if (!edit.insertedLines.isEmpty()) {
+                cursor.setPosition(first.position());
+                cursor.setPosition(lastEnd, QTextCursor::KeepAnchor);
+                cursor.insertText(inserted);
+            } else if (last.next().isValid()) {
+                cursor.setPosition(first.position());
+                cursor.setPosition(last.next().position(), QTextCursor::KeepAnchor);
+                cursor.removeSelectedText();
+            } else {
+                const QTextBlock before = first.previous();
+                cursor.setPosition(before.isValid() ? before.position() + before.length() - 1 : first.position());
+                cursor.setPosition(lastEnd, QTextCursor::KeepAnchor);
+                cursor.removeSelectedText();
+            }
+        } else if (!edit.insertedLines.isEmpty()) {
+            if (edit.firstLine < document->blockCount()) {
+                cursor.setPosition(document->findBlockByNumber(edit.firstLine).position());
+                cursor.insertText(inserted + QLatin1Char('\n'));
+            } else {
+                cursor.movePosition(QTextCursor::End);
+                cursor.insertText(QLatin1Char('\n') + inserted);
+            }
+        }
+    }
+    cursor.endEditBlock();
+    return true;
+}
+
+int AlteDocumentDiff::reloadIncrementally(QTextDocument* document, const QString& newText) {
+    if (!document) {
+        return -1;
+    }
+    const QVector<AlteLineEdit> edits = computeLineEdits(document, newText);
+    if (edits.isEmpty()) {
+        return 0;
+    }
+    return applyLineEdits(document, edits) ? edits.size() : -1;
+}
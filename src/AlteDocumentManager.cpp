@@ -0,0 +1,263 @@
+#include "AlteDocumentManager.h"
+#include "AlteSyntaxHighlighter.h"
+#include "AlteLog.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextLayout>
+#include <QTextCursor>
+#include <QScrollBar>
+#include <QFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QTextStream>
+#include <QDebug>
+
+namespace {
+// Default budget shared by all documents of the process.
+const qint64 kDefaultMemoryBudget = qint64(512) * 1024 * 1024;
+// Rough per-block cost of a QTextLayout with its lines and highlight formats.
+const qint64 kCacheBytesPerBlock = 256;
+}
+
+AlteDocumentManager::AlteDocumentManager(QObject* parent)
+    : QObject(parent), m_activeEditor(nullptr), m_activationCounter(0), m_memoryBudget(kDefaultMemoryBudget) {
+}
+
+AlteDocumentManager::~AlteDocumentManager() {
+    for (Document* document : m_documents) {
+        releaseMapping(*document);
+        delete document;
+    }
+}
+
+AlteDocumentManager::Document* AlteDocumentManager::addDocument(QTextEdit* editor, AlteSyntaxHighlighter* highlighter) {
+    if (!editor) return nullptr;
+    Document* document = new Document;
+    document->editor = editor;
+    document->highlighter = highlighter;
+    document->lastActivated = ++m_activationCounter;
+    m_documents.insert(editor, document);
+    return document;
+}
+
+void AlteDocumentManager::removeDocument(QTextEdit* editor) {
+    Document* document = m_documents.take(editor);
+    if (!document) return;
+    releaseMapping(*document);
+    delete document;
+    if (m_activeEditor == editor) {
+        m_activeEditor = nullptr;
+    }
+}
+
+AlteDocumentManager::Document* AlteDocumentManager::document(QTextEdit* editor) const {
+    return m_documents.value(editor, nullptr);
+}
+
+AlteDocumentManager::Document* AlteDocumentManager::documentForPath(const QString& filePath) const {
+    if (filePath.isEmpty()) return nullptr;
+    for (Document* document : m_documents) {
+        if (document->filePath == filePath) {
+            return document;
+        }
+    }
+    return nullptr;
+}
+
+QList<AlteDocumentManager::Document*> AlteDocumentManager::documents() const {
+    return m_documents.values();
+}
+
+void AlteDocumentManager::activate(QTextEdit* editor) {
+    Document* document = m_documents.value(editor, nullptr);
+    if (!document) return;
+    m_activeEditor = editor;
+    document->lastActivated = ++m_activationCounter;
+    if (document->residency == Residency::Stub) {
+        restoreFromStub(*document);
+    }
+    if (document->residency == Residency::CachesDropped) {
+        restoreCaches(*document);
+    }
+}
+
+void AlteDocumentManager::setMemoryBudget(qint64 bytes) {
+    m_memoryBudget = bytes;
+    enforceBudget();
+}
+
+qint64 AlteDocumentManager::estimateBytes(const Document& document) const {
+    if (document.residency == Residency::Stub) {
+        return 0; // Mapped pages belong to the page cache, not to us
+    }
+    const QTextDocument* textDocument = document.editor->document();
+    qint64 bytes = qint64(textDocument->characterCount()) * qint64(sizeof(QChar));
+    if (document.residency == Residency::Resident) {
+        bytes += qint64(textDocument->blockCount()) * kCacheBytesPerBlock;
+    }
+    return bytes;
+}
+
+qint64 AlteDocumentManager::estimatedUsage() const {
+    qint64 total = 0;
+    for (const Document* document : m_documents) {
+        total += estimateBytes(*document);
+    }
+    return total;
+}
+
+AlteDocumentManager::Document* AlteDocumentManager::leastRecentlyUsed(Residency residency, bool requireUnmodifiedFile) const {
+    Document* candidate = nullptr;
+    for (Document* document : m_documents) {
+        if (document->editor == m_activeEditor || document->residency != residency) continue;
+        if (requireUnmodifiedFile
+            && (document->filePath.isEmpty() || document->editor->document()->isModified())) continue;
+        if (!candidate || document->lastActivated < candidate->lastActivated) {
+            candidate = document;
+        }
+    }
+    return candidate;
+}
+
+void AlteDocumentManager::enforceBudget() {
+    qint64 usage = estimatedUsage();
+    // Cheapest step first: drop layouts and formats of the least recently used documents.
+    while (usage > m_memoryBudget) {
+        Document* document = leastRecentlyUsed(Residency::Resident, false);
+        if (!document) break;
+        usage -= estimateBytes(*document);
+        dropCaches(*document);
+        usage += estimateBytes(*document);
+    }
+    // Then release the text of unmodified files; it can be mapped back from disk.
+    while (usage > m_memoryBudget) {
+        Document* document = leastRecentlyUsed(Residency::CachesDropped, true);
+        if (!document) break;
+        usage -= estimateBytes(*document);
+        if (!shrinkToStub(*document)) {
+            // Could not map the file; keep it resident and stop trying this round.
+            break;
+        }
+    }
+    if (usage > m_memoryBudget) {
+        qCDebug(lcDocument) << "AlteDocumentManager: Estimated usage" << usage << "bytes still exceeds budget" << m_memoryBudget;
+    }
+}
+
+void AlteDocumentManager::dropCaches(Document& document) {
+    QTextDocument* textDocument = document.editor->document();
+    if (document.highlighter) {
+        // Token runs are recomputed when highlighting resumes. Detaching the
+        // highlighter removes its formats from every block layout.
+        document.highlighter->releaseTokens();
+        document.highlighter->setDocument(nullptr);
+    }
+    for (QTextBlock block = textDocument->begin(); block.isValid(); block = block.next()) {
+        if (QTextLayout* layout = block.layout()) {
+            layout->clearLayout();
+        }
+    }
+    document.residency = Residency::CachesDropped;
+}
+
+void AlteDocumentManager::restoreCaches(Document& document) {
+    QTextDocument* textDocument = document.editor->document();
+    textDocument->markContentsDirty(0, textDocument->characterCount());
+    if (document.highlighter) {
+        document.highlighter->setDocument(textDocument);
+    }
+    document.residency = Residency::Resident;
+}
+
+bool AlteDocumentManager::shrinkToStub(Document& document) {
+    QFile* file = new QFile(document.filePath);
+    const QFileInfo fileInfo(document.filePath);
+    if (fileInfo.lastModified() != document.diskModified || fileInfo.size() != document.diskSize) {
+        // The text no longer matches the file; a reload is pending.
+        delete file;
+        return false;
+    }
+    if (!file->open(QIODevice::ReadOnly)) {
+        qCWarning(lcDocument) << "AlteDocumentManager: Cannot map" << document.filePath << ":" << file->errorString();
+        delete file;
+        return false;
+    }
+    uchar* data = file->size() > 0 ? file->map(0, file->size()) : nullptr;
+    if (file->size() > 0 && !data) {
+        qCWarning(lcDocument) << "AlteDocumentManager: mmap failed for" << document.filePath << ":" << file->errorString();
+        delete file;
+        return false;
+    }
+
+    QTextEdit* editor = document.editor;
+    document.cursorPosition = editor->textCursor().position();
+    document.verticalScroll = editor->verticalScrollBar()->value();
+    document.horizontalScroll = editor->horizontalScrollBar()->value();
+    document.mappedFile = file;
+    document.mappedData = data;
+
+    // clear() also drops the undo stack, which is what actually holds on to the text.
+    editor->document()->clear();
+    editor->document()->setModified(false);
+    document.residency = Residency::Stub;
+    qCDebug(lcDocument) << "AlteDocumentManager: Shrunk" << document.filePath << "to an mmap-backed stub.";
+    return true;
+}
+
+void AlteDocumentManager::restoreFromStub(Document& document) {
+    // Only clean documents are stubbed, so the mapping may be the last copy of
+    // the text: it stays readable after the file is deleted or replaced, and is
+    // read whenever the file still covers every mapped byte. Reading pages past
+    // the end of a file truncated since it was mapped would raise SIGBUS.
+    const QFileInfo fileInfo(document.filePath);
+    const bool exists = fileInfo.exists();
+    const bool unchanged = exists && fileInfo.lastModified() == document.diskModified
+                           && fileInfo.size() == document.diskSize;
+    const bool readable = document.mappedFile && document.mappedFile->size() >= document.diskSize
+                          && (document.mappedData || document.diskSize == 0);
+    QTextEdit* editor = document.editor;
+    if (readable) {
+        // Decoded like the text-mode QTextStream reads used when the file was opened.
+        QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(document.mappedData),
+                                                   qsizetype(document.diskSize));
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::ReadOnly | QIODevice::Text);
+        QTextStream in(&buffer);
+        const QString content = in.readAll();
+        buffer.close();
+        releaseMapping(document);
+        editor->setPlainText(content);
+        // Without its file, the text only survives if it is saved again.
+        editor->document()->setModified(!exists);
+    } else {
+        releaseMapping(document);
+        if (!exists) {
+            qCWarning(lcDocument) << "AlteDocumentManager:" << document.filePath
+                                  << "was deleted and truncated while released; its text is lost.";
+        }
+    }
+    // The highlighter is still detached; restoreCaches() re-attaches it.
+    document.residency = Residency::CachesDropped;
+    if (exists && !unchanged) {
+        emit changedOnDisk(editor);
+    }
+
+    QTextCursor cursor = editor->textCursor();
+    cursor.setPosition(qBound(0, document.cursorPosition, editor->document()->characterCount() - 1));
+    editor->setTextCursor(cursor);
+    editor->verticalScrollBar()->setValue(document.verticalScroll);
+    editor->horizontalScrollBar()->setValue(document.horizontalScroll);
+}
+
+void AlteDocumentManager::releaseMapping(Document& document) {
+    if (document.mappedFile) {
+        if (document.mappedData) {
+            document.mappedFile->unmap(document.mappedData);
+        }
+        document.mappedFile->close();
+        delete document.mappedFile;
+    }
+    document.mappedFile = nullptr;
+    document.mappedData = nullptr;
+}
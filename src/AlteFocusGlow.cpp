@@ -0,0 +1,96 @@
+#include "AlteFocusGlow.h"
+#include <QEvent>
+#include <QPainter>
+#include <QRegion>
+#include <QVariantAnimation>
+
+namespace {
+// Width of the glow, drawn over the 1px stylesheet border and one pixel inside it.
+const int kGlowWidth = 2;
+// Share of the duration the glow stays at full strength before fading.
+const qreal kHoldFraction = 0.6;
+}
+
+AlteFocusGlow::AlteFocusGlow(QWidget *target, int durationMs)
+    : QWidget(target), m_target(target), m_color(Qt::cyan), m_animation(new QVariantAnimation(this)), m_strength(0.0) {
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setAttribute(Qt::WA_NoSystemBackground);
+    setFocusPolicy(Qt::NoFocus);
+
+    m_animation->setDuration(qMax(1, durationMs));
+    m_animation->setStartValue(1.0);
+    m_animation->setKeyValueAt(kHoldFraction, 1.0);
+    m_animation->setEndValue(0.0);
+    connect(m_animation, &QVariantAnimation::valueChanged, this, [this](const QVariant &value) {
+        m_strength = value.toReal();
+        update();
+    });
+    connect(m_animation, &QVariantAnimation::finished, this, &AlteFocusGlow::stop);
+
+    target->installEventFilter(this);
+    followTarget();
+    hide();
+}
+
+void AlteFocusGlow::setColor(const QColor &color) {
+    m_color = color;
+    if (isVisible()) update();
+}
+
+void AlteFocusGlow::flash() {
+    m_animation->stop();
+    m_strength = 1.0;
+    raise();
+    show();
+    update();
+    m_animation->start();
+}
+
+void AlteFocusGlow::stop() {
+    m_animation->stop();
+    m_strength = 0.0;
+    hide();
+}
+
+void AlteFocusGlow::followTarget() {
+    const QRect frame = m_target->rect();
+    setGeometry(frame);
+    // Only the frame ring belongs to the overlay; the text area under it is
+    // never repainted on its behalf.
+    setMask(QRegion(frame).subtracted(QRegion(frame.adjusted(kGlowWidth, kGlowWidth, -kGlowWidth, -kGlowWidth))));
+}
+
+bool AlteFocusGlow::eventFilter(QObject *watched, QEvent *event) {
+    if (watched == m_target) {
+        switch (event->type()) {
+        case QEvent::Resize:
+            followTarget();
+            break;
+        case QEvent::ChildAdded:
+            if (isVisible()) raise();
+            break;
+        case QEvent::FocusIn:
+            flash();
+            break;
+        case QEvent::FocusOut:
+            stop();
+            break;
+        default:
+            break;
+        }
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
+void AlteFocusGlow::paintEvent(QPaintEvent *) {
+    if (m_strength <= 0.0) return;
+    QPainter painter(this);
+    QColor outer = m_color;
+    outer.setAlphaF(m_color.alphaF() * m_strength);
+    QColor inner = m_color;
+    inner.setAlphaF(m_color.alphaF() * m_strength * 0.5);
+    painter.setPen(outer);
+    painter.drawRect(rect().adjusted(0, 0, -1, -1));
+    painter.setPen(inner);
+    painter.drawRect(rect().adjusted(1, 1, -2, -2));
+}
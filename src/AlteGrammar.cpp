@@ -0,0 +1,984 @@
+#include "AlteGrammar.h"
+#include "AlteThemeManager.h"
+#include "AlteLog.h"
+#include "AlteTrace.h"
+#include <QJsonArray>
+#include <QStringView>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <climits>
+
+namespace {
+const quint32 kCacheMagic = 0x414C5447; // "ALTG"
+// Bump whenever the serialized layout of AlteGrammar changes.
+const quint32 kCacheFormatVersion = 6;
+// Spans nested deeper than this are treated as text of the innermost one.
+const int kMaxStateDepth = 16;
+// Time the rules may spend on one line. It is checked between rules: once it is
+// used up the remaining pattern rules are left out, and a rule that used it up
+// alone is skipped on lines at least as long from then on. It does not stop a
+// match that is already running; kMatchLimit bounds that.
+const qint64 kLineBudgetNs = 10 * 1000 * 1000;
+// Every pattern starts with this PCRE2 limit on backtracking steps, so a
+// catastrophic pattern gives up on a match (and colours nothing there) after a
+// few milliseconds instead of running for seconds.
+const QLatin1String kMatchLimit("(*LIMIT_MATCH=1000000)");
+
+// Grammars by cache key. Only ever touched from the UI thread.
+QHash<QByteArray, QSharedPointer<const AlteGrammar>>& memoryCache() {
+    static QHash<QByteArray, QSharedPointer<const AlteGrammar>> cache;
+    return cache;
+}
+
+// Started for each line tokenized on the thread.
+thread_local QElapsedTimer lineTimer;
+// Innermost ProfileBatch of the thread.
+thread_local AlteGrammar::ProfileBatch* currentProfileBatch = nullptr;
+}
+
+QSharedPointer<const AlteGrammar> AlteGrammar::load(const QString& languageName,
+                                                    AlteThemeManager* themeManager) {
+    Source source;
+    if (QSharedPointer<const AlteGrammar> cached = prepare(languageName, themeManager, source)) {
+        return cached;
+    }
+    const QSharedPointer<const AlteGrammar> grammar = build(source);
+    keep(source, grammar);
+    return grammar;
+}
+
+QSharedPointer<const AlteGrammar> AlteGrammar::prepare(const QString& languageName, AlteThemeManager* themeManager,
+                                                       Source& source) {
+    if (!themeManager) {
+        qCWarning(lcGrammar) << "AlteGrammar::load: ThemeManager is null.";
+        return QSharedPointer<const AlteGrammar>(new AlteGrammar);
+    }
+    if (languageName.isEmpty()) {
+        // Plain text
+        return QSharedPointer<const AlteGrammar>(new AlteGrammar);
+    }
+
+    // Formats are resolved per theme by formats(), so only the definitions of the
+    // language and of the languages it embeds are part of the key.
+    const QJsonObject langRules = themeManager->getSyntaxRulesForLanguage(languageName);
+    QStringList languages(languageName);
+    collectEmbeddedLanguages(langRules.value("highlighting_rules").toArray(), themeManager, languages);
+    const QByteArray languageFingerprint = themeManager->languageFingerprint(languageName);
+    source.key.clear();
+    if (!languageFingerprint.isEmpty()) {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(languageFingerprint);
+        for (int i = 1; i < languages.size(); ++i) {
+            hash.addData(themeManager->languageFingerprint(languages.at(i)));
+        }
+        source.key = hash.result().toHex();
+        if (QSharedPointer<const AlteGrammar> cached = memoryCache().value(source.key)) {
+            return cached;
+        }
+    }
+
+    source.languageName = languageName;
+    source.languageRules.clear();
+    source.languageRules.insert(languageName, langRules);
+    for (int i = 1; i < languages.size(); ++i) {
+        source.languageRules.insert(languages.at(i), themeManager->getSyntaxRulesForLanguage(languages.at(i)));
+    }
+    return QSharedPointer<const AlteGrammar>();
+}
+
+QSharedPointer<const AlteGrammar> AlteGrammar::build(const Source& source) {
+    QSharedPointer<AlteGrammar> grammar(new AlteGrammar);
+    grammar->m_languageName = source.languageName;
+    const QString cachePath = source.key.isEmpty() ? QString() : cacheFilePath(source.key);
+    if (cachePath.isEmpty() || !grammar->readCache(cachePath)) {
+        ALTE_TRACE_ZONE("highlight", "compileGrammar");
+        qCDebug(lcGrammar) << "Compiling rules for language:" << source.languageName;
+        if (source.languageRules.value(source.languageName).isEmpty()) {
+            qCWarning(lcGrammar) << "AlteGrammar: No syntax rules found for language" << source.languageName << "(langRules object is empty).";
+            return grammar;
+        }
+        grammar->loadRules(source.languageRules);
+        if (!cachePath.isEmpty()) {
+            grammar->writeCache(cachePath);
+        }
+    }
+    grammar->compile();
+    return grammar;
+}
+
+void AlteGrammar::keep(const Source& source, const QSharedPointer<const AlteGrammar>& grammar) {
+    if (!source.key.isEmpty() && grammar) {
+        memoryCache().insert(source.key, grammar);
+    }
+}
+
+QString AlteGrammar::cacheFilePath(const QByteArray& key) {
+    QString cachePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (cachePath.isEmpty()) {
+        return QString();
+    }
+    QDir cacheDir(cachePath);
+    if (!cacheDir.mkpath("grammars")) {
+        qCWarning(lcGrammar) << "AlteGrammar: Could not create grammar cache directory in" << cachePath;
+        return QString();
+    }
+    return cacheDir.filePath("grammars/" + QString::fromLatin1(key) + ".bin");
+}
+
+bool AlteGrammar::readCache(const QString& filePath) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_15);
+    quint32 magic = 0;
+    quint32 formatVersion = 0;
+    in >> magic >> formatVersion;
+    if (magic != kCacheMagic || formatVersion != kCacheFormatVersion) {
+        return false;
+    }
+
+    qint32 ruleCount = 0;
+    in >> ruleCount;
+    QVector<Rule> rules;
+    for (qint32 i = 0; i < ruleCount && in.status() == QDataStream::Ok; ++i) {
+        Rule rule;
+        QString pattern;
+        QString endPattern;
+        qint32 bodyContext = -1;
+        qint32 fontSizeOffset = 0;
+        in >> pattern >> endPattern >> rule.style.key >> rule.style.colorRef >> rule.style.bold >> rule.style.italic
+           >> fontSizeOffset >> rule.isBlockRule >> rule.isKeywordRule
+           >> rule.literalPrefix >> rule.endLiteralPrefix >> bodyContext >> rule.embedsLanguage >> rule.name
+           >> rule.isOpaque;
+        rule.pattern.setPattern(pattern);
+        rule.endPattern.setPattern(endPattern);
+        rule.bodyContext = bodyContext;
+        rule.style.fontSizeOffset = fontSizeOffset;
+        rules.append(rule);
+    }
+    QVector<Context> contexts;
+    qint32 contextCount = 0;
+    in >> contextCount;
+    for (qint32 c = 0; c < contextCount && in.status() == QDataStream::Ok; ++c) {
+        Context context;
+        qint32 bucketCount = 0;
+        in >> context.patternRules >> context.blockRules >> bucketCount;
+        for (qint32 i = 0; i < bucketCount && in.status() == QDataStream::Ok; ++i) {
+            quint32 bucketKey = 0;
+            qint32 entryCount = 0;
+            in >> bucketKey >> entryCount;
+            QVector<KeywordEntry>& bucket = context.keywordBuckets[bucketKey];
+            for (qint32 j = 0; j < entryCount && in.status() == QDataStream::Ok; ++j) {
+                KeywordEntry entry;
+                qint32 ruleIndex = 0;
+                in >> entry.word >> ruleIndex;
+                entry.ruleIndex = ruleIndex;
+                bucket.append(entry);
+            }
+        }
+        contexts.append(context);
+    }
+    // The tokenizer indexes with these without checking, so a cache that does not
+    // fit together is as corrupt as one that could not be read.
+    const auto isRule = [&rules](int index) { return index >= 0 && index < rules.size(); };
+    bool consistent = in.status() == QDataStream::Ok && !contexts.isEmpty();
+    for (const Rule& rule : rules) {
+        if (!consistent) break;
+        consistent = rule.bodyContext >= -1 && rule.bodyContext < contexts.size();
+    }
+    for (const Context& context : contexts) {
+        if (!consistent) break;
+        for (const int index : context.patternRules) {
+            consistent = consistent && isRule(index) && !rules[index].isBlockRule;
+        }
+        for (const int index : context.blockRules) {
+            consistent = consistent && isRule(index) && rules[index].isBlockRule;
+        }
+        for (const QVector<KeywordEntry>& bucket : context.keywordBuckets) {
+            for (const KeywordEntry& entry : bucket) {
+                consistent = consistent && isRule(entry.ruleIndex);
+            }
+        }
+    }
+    if (!consistent) {
+        qCWarning(lcGrammar) << "AlteGrammar: Ignoring corrupt grammar cache" << filePath;
+        return false;
+    }
+    m_rules = rules;
+    m_contexts = contexts;
+    return true;
+}
+
+void AlteGrammar::writeCache(const QString& filePath) const {
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcGrammar) << "AlteGrammar: Could not write grammar cache" << filePath << ":" << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_15);
+    out << kCacheMagic << kCacheFormatVersion;
+    out << qint32(m_rules.size());
+    for (const Rule& rule : m_rules) {
+        out << rule.pattern.pattern() << rule.endPattern.pattern() << rule.style.key << rule.style.colorRef
+            << rule.style.bold << rule.style.italic << qint32(rule.style.fontSizeOffset) << rule.isBlockRule
+            << rule.isKeywordRule << rule.literalPrefix << rule.endLiteralPrefix << qint32(rule.bodyContext)
+            << rule.embedsLanguage << rule.name << rule.isOpaque;
+    }
+    out << qint32(m_contexts.size());
+    for (const Context& context : m_contexts) {
+        out << context.patternRules << context.blockRules << qint32(context.keywordBuckets.size());
+        for (auto it = context.keywordBuckets.constBegin(); it != context.keywordBuckets.constEnd(); ++it) {
+            out << it.key() << qint32(it.value().size());
+            for (const KeywordEntry& entry : it.value()) {
+                out << entry.word << qint32(entry.ruleIndex);
+            }
+        }
+    }
+    if (!file.commit()) {
+        qCWarning(lcGrammar) << "AlteGrammar: Could not write grammar cache" << filePath << ":" << file.errorString();
+    }
+}
+
+// Compiles every regex up front, while the grammar is still private to the
+// loading thread, so tokenizer threads only ever read it.
+void AlteGrammar::compile() {
+    m_hasBlockRules = false;
+    m_stats.reset(new RuleStats[m_rules.size()]);
+    resetProfile();
+    for (Rule& rule : m_rules) {
+        // Resolved here rather than per theme, so switching themes hashes no names.
+        if (!rule.style.key.isEmpty()) rule.style.styleId = AlteTheme::registerStyleKey(rule.style.key);
+        if (!rule.style.colorRef.isEmpty()) rule.style.colorRefId = AlteTheme::registerColorName(rule.style.colorRef);
+        if (!rule.pattern.pattern().startsWith(kMatchLimit)) {
+            rule.pattern.setPattern(kMatchLimit + rule.pattern.pattern());
+        }
+        rule.pattern.optimize();
+        if (rule.isBlockRule) {
+            if (!rule.endPattern.pattern().startsWith(kMatchLimit)) {
+                rule.endPattern.setPattern(kMatchLimit + rule.endPattern.pattern());
+            }
+            rule.endPattern.optimize();
+            m_hasBlockRules = true;
+        }
+    }
+}
+
+AlteGrammar::Style AlteGrammar::styleFromRule(const QJsonObject& ruleDetails) {
+    Style style;
+    style.key = ruleDetails.value("style_key").toString();
+    style.colorRef = ruleDetails.value("color_ref").toString();
+    style.bold = ruleDetails.value("bold").toBool(false);
+    style.italic = ruleDetails.value("italic").toBool(false);
+    style.fontSizeOffset = ruleDetails.value("fontPointSizeOffset").toInt(0);
+    return style;
+}
+
+QVector<QTextCharFormat> AlteGrammar::formats(const AlteTheme& theme, const QFont& defaultFont) const {
+    QVector<QTextCharFormat> formats;
+    formats.reserve(m_rules.size());
+    for (const Rule& rule : m_rules) {
+        formats.append(formatForStyle(rule.style, theme, defaultFont));
+    }
+    return formats;
+}
+
+QTextCharFormat AlteGrammar::formatForStyle(const Style& style, const AlteTheme& theme, const QFont& defaultFont) {
+    static const int defaultStyleId = AlteTheme::registerStyleKey("default");
+    static const int textColorId = AlteTheme::registerColorName("text");
+
+    // Start from the theme's prebuilt format for the style_key, which already
+    // carries its color, weight and slant.
+    const QTextCharFormat* styleFormat = theme.styleFormat(style.styleId);
+    if (!styleFormat) {
+        styleFormat = theme.styleFormat(defaultStyleId);
+    }
+    QTextCharFormat format = styleFormat ? *styleFormat : QTextCharFormat();
+
+    if (!style.colorRef.isEmpty()) {
+        const QColor refColor = theme.color(style.colorRefId, QColor());
+        if (refColor.isValid()) {
+            format.setForeground(refColor);
+        } else {
+            qCWarning(lcGrammar) << "AlteGrammar: Color reference '" << style.colorRef << "' is invalid or not found in theme colors.";
+        }
+    }
+    if (!format.hasProperty(QTextFormat::ForegroundBrush)) {
+        format.setForeground(theme.syntaxColor(style.styleId, theme.color(textColorId, Qt::black)));
+    }
+
+    if (style.bold) {
+        format.setFontWeight(QFont::Bold);
+    }
+    if (style.italic) {
+        format.setFontItalic(true);
+    }
+
+    if (style.fontSizeOffset != 0) {
+        QFont currentFont = format.font();
+        if (currentFont.pointSize() <= 0) {
+             currentFont = defaultFont;
+        }
+        int newSize = currentFont.pointSize() + style.fontSizeOffset;
+        if (newSize > 0) {
+            currentFont.setPointSize(newSize);
+            format.setFont(currentFont); // Apply the font with new size
+        } else {
+            qCWarning(lcGrammar) << "AlteGrammar: Calculated font point size is not positive (" << newSize << "). Ignoring offset.";
+        }
+    }
+    return format;
+}
+
+void AlteGrammar::loadRules(const QHash<QString, QJsonObject>& languageRules) {
+    const QJsonObject langRules = languageRules.value(m_languageName);
+    if (!langRules.contains("highlighting_rules") || !langRules.value("highlighting_rules").isArray()) {
+        qCWarning(lcGrammar) << "AlteGrammar: 'highlighting_rules' array not found or not an array for language" << m_languageName << "Def:" << langRules;
+        return;
+    }
+    QHash<QString, int> embeddedContexts;
+    embeddedContexts.insert(m_languageName, addContext());
+    loadContext(0, m_languageName, langRules.value("highlighting_rules").toArray(), languageRules, embeddedContexts);
+
+    for (Rule& rule : m_rules) {
+        if (!rule.isKeywordRule) {
+            rule.literalPrefix = literalPrefix(rule.pattern.pattern());
+        }
+        if (rule.isBlockRule) {
+            rule.endLiteralPrefix = literalPrefix(rule.endPattern.pattern());
+        }
+    }
+}
+
+int AlteGrammar::addContext() {
+    m_contexts.append(Context());
+    return m_contexts.size() - 1;
+}
+
+int AlteGrammar::addRule(int contextId, const Rule& rule) {
+    const int ruleIndex = m_rules.size();
+    m_rules.append(rule);
+    if (rule.isBlockRule) {
+        m_contexts[contextId].blockRules.append(ruleIndex);
+    } else if (!rule.isKeywordRule) {
+        m_contexts[contextId].patternRules.append(ruleIndex);
+    }
+    return ruleIndex;
+}
+
+// Returns the context holding the rules of an embedded language, loading it on
+// first use. Each language is loaded once per grammar, which also ends cycles.
+int AlteGrammar::embeddedContext(const QString& languageName, const QHash<QString, QJsonObject>& languageRules,
+                                 QHash<QString, int>& embeddedContexts) {
+    const auto existing = embeddedContexts.constFind(languageName);
+    if (existing != embeddedContexts.constEnd()) {
+        return existing.value();
+    }
+    const QJsonValue rulesValue = languageRules.value(languageName).value("highlighting_rules");
+    if (!rulesValue.isArray()) {
+        qCWarning(lcGrammar) << "AlteGrammar: Embedded language" << languageName << "of" << m_languageName << "has no highlighting rules.";
+        embeddedContexts.insert(languageName, -1);
+        return -1;
+    }
+    const int contextId = addContext();
+    embeddedContexts.insert(languageName, contextId);
+    loadContext(contextId, languageName, rulesValue.toArray(), languageRules, embeddedContexts);
+    return contextId;
+}
+
+void AlteGrammar::collectEmbeddedLanguages(const QJsonArray& rulesArray, AlteThemeManager* themeManager,
+                                           QStringList& languages) {
+    for (const QJsonValue& ruleValue : rulesArray) {
+        const QJsonObject ruleDef = ruleValue.toObject();
+        const QString embedded = ruleDef.value("embed_language").toString();
+        if (!embedded.isEmpty() && !languages.contains(embedded)) {
+            languages.append(embedded);
+            collectEmbeddedLanguages(themeManager->getSyntaxRulesForLanguage(embedded).value("highlighting_rules").toArray(),
+                                     themeManager, languages);
+        }
+        collectEmbeddedLanguages(ruleDef.value("rules").toArray(), themeManager, languages);
+    }
+}
+
+void AlteGrammar::loadContext(int contextId, const QString& languageName, const QJsonArray& rulesArray,
+                              const QHash<QString, QJsonObject>& languageRules, QHash<QString, int>& embeddedContexts) {
+    for (const QJsonValue& ruleValue : rulesArray) {
+        QJsonObject ruleDef = ruleValue.toObject();
+        QString ruleName = ruleDef.value("name").toString("Unnamed Rule");
+
+        Rule baseRuleSetup;
+        baseRuleSetup.name = languageName == m_languageName ? ruleName : languageName + ": " + ruleName;
+        baseRuleSetup.style = styleFromRule(ruleDef);
+        const QString& styleKey = baseRuleSetup.style.key;
+        baseRuleSetup.isOpaque = styleKey.contains("comment") || styleKey.contains("string") || styleKey == "regex"
+                                 || styleKey == "attribute_value" || styleKey == "cdata_section";
+        baseRuleSetup.isBlockRule = false;
+        baseRuleSetup.isKeywordRule = false;
+
+        QString ruleType = ruleDef.value("type").toString();
+
+        if (ruleType.isEmpty()) {
+            qCWarning(lcGrammar) << "AlteGrammar: Rule" << ruleName << "is missing 'type' field. Def:" << ruleDef;
+            continue;
+        }
+
+        if (ruleType == "keywords") {
+            if (!ruleDef.contains("list")) {
+                qCWarning(lcGrammar) << "AlteGrammar: 'keywords' rule" << ruleName << "is missing 'list' field. Def:" << ruleDef;
+                continue;
+            }
+            addKeywordRule(contextId, baseRuleSetup, ruleDef.value("list").toArray(), ruleName);
+        } else if (ruleType == "line_comment") {
+            if (!ruleDef.contains("start_delimiter")) {
+                qCWarning(lcGrammar) << "AlteGrammar: 'line_comment' rule" << ruleName << "is missing 'start_delimiter' field. Def:" << ruleDef;
+                continue;
+            }
+            Rule specificRule = baseRuleSetup;
+            QString delimiter = ruleDef.value("start_delimiter").toString();
+            if (!delimiter.isEmpty()) {
+                specificRule.pattern = QRegularExpression(QRegularExpression::escape(delimiter) + ".*");
+                if (specificRule.pattern.isValid()) {
+                    addRule(contextId, specificRule);
+                } else {
+                    qCWarning(lcGrammar) << "AlteGrammar: Invalid regex from line_comment rule" << ruleName << "for delimiter" << delimiter;
+                }
+            } else {
+                qCWarning(lcGrammar) << "AlteGrammar: Empty delimiter for line_comment rule" << ruleName;
+            }
+        } else if (ruleType == "multi_line_string" || ruleType == "multi_line_comment") {
+            // "state_id" of older definitions is ignored: states are assigned by the grammar.
+            if (!ruleDef.contains("start_pattern")) {
+                qCWarning(lcGrammar) << "AlteGrammar:" << ruleType << "rule" << ruleName << "is missing 'start_pattern' field. Def:" << ruleDef;
+                continue;
+            }
+            if (!ruleDef.contains("end_pattern")) {
+                qCWarning(lcGrammar) << "AlteGrammar:" << ruleType << "rule" << ruleName << "is missing 'end_pattern' field. Def:" << ruleDef;
+                continue;
+            }
+            Rule blockRule = baseRuleSetup;
+            blockRule.isBlockRule = true;
+            blockRule.pattern = QRegularExpression(ruleDef.value("start_pattern").toString());
+            blockRule.endPattern = QRegularExpression(ruleDef.value("end_pattern").toString());
+            if (!blockRule.pattern.isValid() || !blockRule.endPattern.isValid()) {
+                qCWarning(lcGrammar) << "AlteGrammar: Invalid regex for" << ruleType << "rule" << ruleName
+                           << ": Start:" << ruleDef.value("start_pattern").toString()
+                           << "End:" << ruleDef.value("end_pattern").toString();
+                continue;
+            }
+            const int ruleIndex = addRule(contextId, blockRule);
+
+            // The body of a span is either another language ("embed_language"),
+            // its own rules ("rules", "nested" for spans that nest in themselves)
+            // or plain text in the span's colour.
+            const QString embeddedLanguage = ruleDef.value("embed_language").toString();
+            if (!embeddedLanguage.isEmpty()) {
+                const int bodyContext = embeddedContext(embeddedLanguage, languageRules, embeddedContexts);
+                if (bodyContext >= 0) {
+                    m_rules[ruleIndex].bodyContext = bodyContext;
+                    m_rules[ruleIndex].embedsLanguage = true;
+                }
+            } else if (ruleDef.value("rules").isArray() || ruleDef.value("nested").toBool(false)) {
+                const int bodyContext = addContext();
+                m_rules[ruleIndex].bodyContext = bodyContext;
+                if (ruleDef.value("nested").toBool(false)) {
+                    m_contexts[bodyContext].blockRules.append(ruleIndex);
+                }
+                loadContext(bodyContext, languageName, ruleDef.value("rules").toArray(), languageRules, embeddedContexts);
+            }
+        } else if (ruleType == "pattern") {
+            if (!ruleDef.contains("pattern")) {
+                qCWarning(lcGrammar) << "AlteGrammar: 'pattern' rule" << ruleName << "is missing 'pattern' field. Def:" << ruleDef;
+                continue;
+            }
+            Rule singlePatternRule = baseRuleSetup;
+            QString patternStr = ruleDef.value("pattern").toString();
+            if (patternStr.isEmpty()){
+                 qCWarning(lcGrammar) << "AlteGrammar: Empty pattern string for 'pattern' rule" << ruleName;
+                 continue;
+            }
+            singlePatternRule.pattern = QRegularExpression(patternStr);
+            if (singlePatternRule.pattern.isValid()) {
+                addRule(contextId, singlePatternRule);
+            } else {
+                qCWarning(lcGrammar) << "AlteGrammar: Invalid regex for 'pattern' rule" << ruleName << ":" << patternStr;
+            }
+        } else if (ruleDef.contains("patterns")) { // Legacy path, if still needed
+            // This can be kept for backward compatibility or removed if all JSONs are updated.
+            // For now, let's assume it's similar to "keywords" with "list" but uses "patterns" key.
+            qCWarning(lcGrammar) << "AlteGrammar: Rule" << ruleName << "uses legacy 'patterns' key. Consider updating to 'list' under 'keywords' type.";
+            if (!ruleDef.contains("patterns")) { // Should not happen if previous 'contains' is true
+                 qCWarning(lcGrammar) << "AlteGrammar: 'patterns' rule" << ruleName << "is missing 'patterns' field. Def:" << ruleDef;
+                 continue;
+            }
+            addKeywordRule(contextId, baseRuleSetup, ruleDef.value("patterns").toArray(), ruleName);
+        } else {
+            if (!ruleName.startsWith("_comment_")) {
+                 qCWarning(lcGrammar) << "AlteGrammar: Rule" << ruleName << "has unknown type'" << ruleType << "' or is malformed. Def:" << ruleDef;
+            }
+        }
+    }
+}
+
+// Returns the literal text every match of the pattern must start with, or an
+// empty string when that cannot be told from the pattern cheaply. Leading \b and
+// ^ are skipped: they are zero-width, and starting the search at the first
+// occurrence of the prefix does not change what they match.
+QString AlteGrammar::literalPrefix(const QString& pattern) {
+    // A top-level alternative can start with anything.
+    int depth = 0;
+    bool inClass = false;
+    for (int i = 0; i < pattern.size(); ++i) {
+        const QChar c = pattern.at(i);
+        if (c == '\\') {
+            ++i;
+        } else if (inClass) {
+            if (c == ']') inClass = false;
+        } else if (c == '[') {
+            inClass = true;
+        } else if (c == '(') {
+            ++depth;
+        } else if (c == ')') {
+            --depth;
+        } else if (c == '|' && depth == 0) {
+            return QString();
+        }
+    }
+
+    static const QString metaCharacters = QStringLiteral("^$.|?*+()[]{}");
+    QString prefix;
+    int i = 0;
+    while (i < pattern.size()) {
+        const QChar c = pattern.at(i);
+        QChar literal;
+        int next = i + 1;
+        if (c == '\\') {
+            if (next >= pattern.size()) break;
+            const QChar escaped = pattern.at(next);
+            ++next;
+            if (escaped == 'b' && prefix.isEmpty()) {
+                i = next;
+                continue;
+            }
+            if (escaped.isLetterOrNumber()) break; // \s, \w, \d, ... are classes, not literals
+            literal = escaped;
+        } else if (c == '^' && i == 0) {
+            i = next;
+            continue;
+        } else if (metaCharacters.contains(c)) {
+            break;
+        } else {
+            literal = c;
+        }
+
+        if (next < pattern.size()) {
+            const QChar quantifier = pattern.at(next);
+            if (quantifier == '?' || quantifier == '*' || quantifier == '{') break; // Literal is optional
+            if (quantifier == '+') {
+                prefix += literal;
+                break;
+            }
+        }
+        prefix += literal;
+        i = next;
+    }
+    return prefix;
+}
+
+quint32 AlteGrammar::keywordBucketKey(QChar first, int length) {
+    return (quint32(first.unicode()) << 16) | quint32(qMin(length, 0xFFFF));
+}
+
+static inline bool isKeywordChar(QChar c) {
+    // Matches \w of QRegularExpression without UseUnicodePropertiesOption (ASCII only),
+    // so a word run equal to a keyword is exactly a \bkeyword\b match.
+    const ushort u = c.unicode();
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u == '_';
+}
+
+void AlteGrammar::addKeywordRule(int contextId, const Rule& baseRule, const QJsonArray& words, const QString& ruleName) {
+    Rule keywordRule = baseRule;
+    keywordRule.isKeywordRule = true;
+    const int ruleIndex = addRule(contextId, keywordRule);
+
+    for (const QJsonValue& val : words) {
+        const QString word = val.toString();
+        if (word.isEmpty()) continue;
+        if (!std::all_of(word.cbegin(), word.cend(), isKeywordChar)) {
+            // Not a plain identifier (e.g. "std::string"): keep the old per-keyword regex.
+            Rule specificRule = baseRule;
+            specificRule.pattern = QRegularExpression("\\b" + QRegularExpression::escape(word) + "\\b");
+            if (specificRule.pattern.isValid()) {
+                addRule(contextId, specificRule);
+            } else {
+                qCWarning(lcGrammar) << "AlteGrammar: Invalid regex from keyword in list" << word << "for rule" << ruleName;
+            }
+            continue;
+        }
+        QVector<KeywordEntry>& bucket = m_contexts[contextId].keywordBuckets[keywordBucketKey(word.at(0), word.size())];
+        auto existing = std::find_if(bucket.begin(), bucket.end(), [&](const KeywordEntry& entry) { return entry.word == word; });
+        if (existing != bucket.end()) {
+            // A later list used to overwrite an earlier one, so the later rule wins.
+            existing->ruleIndex = ruleIndex;
+        } else {
+            bucket.append({word, ruleIndex});
+        }
+    }
+}
+
+void AlteGrammar::findKeywords(const Context& context, const QString& text, int from, int to,
+                               QVector<KeywordMatch>& matches) const {
+    matches.clear();
+    if (context.keywordBuckets.isEmpty()) return;
+
+    const QChar* data = text.constData();
+    int i = from;
+    while (i < to) {
+        if (!isKeywordChar(data[i])) {
+            ++i;
+            continue;
+        }
+        const int start = i;
+        while (i < to && isKeywordChar(data[i])) {
+            ++i;
+        }
+        const auto bucket = context.keywordBuckets.constFind(keywordBucketKey(data[start], i - start));
+        if (bucket == context.keywordBuckets.constEnd()) continue;
+        const QStringView word(data + start, i - start);
+        for (const KeywordEntry& entry : bucket.value()) {
+            if (word == entry.word) {
+                matches.append({start, i - start, entry.ruleIndex});
+                break;
+            }
+        }
+    }
+}
+
+int AlteGrammar::tokenizeLine(const QString& text, int entryState, QVector<AlteToken>& tokens) const {
+    tokens.clear();
+    // Per-thread scratch buffer, so tokenizer threads never share mutable state.
+    static thread_local QVector<int> owner;
+
+    // Record the winning rule per character and turn each run of equal owners
+    // into one token.
+    owner.fill(-1, text.length());
+    lineTimer.start();
+    const int exitState = walkLine(text, entryState, &owner);
+
+    for (int start = 0; start < owner.size();) {
+        const int ruleIndex = owner[start];
+        int end = start + 1;
+        while (end < owner.size() && owner[end] == ruleIndex) {
+            ++end;
+        }
+        if (ruleIndex >= 0) {
+            tokens.append({quint32(start), quint32(end - start), quint16(ruleIndex)});
+        }
+        start = end;
+    }
+    return exitState;
+}
+
+int AlteGrammar::scanBlockState(const QString& text, int entryState) const {
+    if (!m_hasBlockRules) return 0;
+    lineTimer.start();
+    return walkLine(text, entryState, nullptr);
+}
+
+// Walks a line from delimiter to delimiter. The text in between is coloured with
+// the rules active inside the innermost open span (when owner is given); every
+// opening pushes a block rule on the state stack and every closing pops it.
+// Returns the state for the stack left open at the end of the line.
+int AlteGrammar::walkLine(const QString& text, int entryState, QVector<int>* owner) const {
+    static thread_local StateStack stack;
+    stackForState(entryState, stack);
+
+    int pos = 0;
+    for (;;) {
+        const int spanRule = stack.isEmpty() ? -1 : stack.last();
+        const int contextId = spanRule < 0 ? 0 : m_rules[spanRule].bodyContext;
+        const Context* context = contextId >= 0 && contextId < m_contexts.size() ? &m_contexts[contextId] : nullptr;
+
+        int closeStart = -1;
+        int closeEnd = -1;
+        if (spanRule >= 0 && !findBlockEnd(m_rules[spanRule], text, pos, closeStart, closeEnd)) {
+            closeStart = -1;
+        }
+
+        // The first span opening before the innermost one closes; earlier rules win ties.
+        int openRule = -1;
+        int openStart = closeStart >= 0 ? closeStart : text.length();
+        int openEnd = openStart;
+        if (context && stack.size() < kMaxStateDepth) {
+            for (int ruleIndex : context->blockRules) {
+                int start = 0;
+                int end = 0;
+                if (findBlockStart(m_rules[ruleIndex], text, pos, start, end) && start < openStart) {
+                    openRule = ruleIndex;
+                    openStart = start;
+                    openEnd = end;
+                }
+            }
+        }
+
+        if (owner) {
+            colourSpan(context, spanRule, text, pos, openStart, *owner);
+        }
+        if (openRule >= 0) {
+            if (owner) std::fill(owner->begin() + openStart, owner->begin() + openEnd, openRule);
+            stack.append(quint16(openRule));
+            pos = openEnd;
+        } else if (closeStart >= 0) {
+            if (owner) std::fill(owner->begin() + closeStart, owner->begin() + closeEnd, spanRule);
+            stack.removeLast();
+            pos = closeEnd;
+        } else {
+            break;
+        }
+    }
+    return stateForStack(stack);
+}
+
+// Colours [from, to) of a line that lies inside spanRule (-1 at top level) with
+// the rules of context. Later rules win where matches overlap.
+void AlteGrammar::colourSpan(const Context* context, int spanRule, const QString& text, int from, int to,
+                             QVector<int>& owner) const {
+    if (from >= to) return;
+    // A plain span is coloured as a whole; embedded code starts out uncoloured.
+    const int fill = spanRule >= 0 && !m_rules[spanRule].embedsLanguage ? spanRule : -1;
+    std::fill(owner.begin() + from, owner.begin() + to, fill);
+    if (!context) return;
+
+    static thread_local QVector<KeywordMatch> keywordMatches;
+    findKeywords(*context, text, from, to, keywordMatches);
+    for (const KeywordMatch& match : keywordMatches) {
+        std::fill_n(owner.begin() + match.start, match.length, match.ruleIndex);
+    }
+
+    qint64 ruleStart = lineTimer.nsecsElapsed();
+    for (int ruleIndex : context->patternRules) {
+        const Rule &rule = m_rules[ruleIndex];
+        RuleStats& stats = m_stats[ruleIndex];
+        if (ruleStart > kLineBudgetNs || text.length() >= stats.slowLineLength.loadRelaxed()) {
+            recordSkippedLine(ruleIndex);
+            continue;
+        }
+        int offset = from;
+        if (!rule.literalPrefix.isEmpty()) {
+            offset = text.indexOf(rule.literalPrefix, from);
+            if (offset < 0 || offset >= to) continue;
+        }
+
+        int matches = 0;
+        QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text, offset);
+        while (matchIterator.hasNext()) {
+            QRegularExpressionMatch match = matchIterator.next();
+            const int start = match.capturedStart();
+            if (start >= to) break;
+            ++matches;
+            const int end = qMin(int(match.capturedEnd()), to);
+            for (int i = start; i < end; ++i) {
+                // Keyword matches were recorded first; only a later rule may take them over.
+                if (owner[i] < ruleIndex || owner[i] == fill) {
+                    owner[i] = ruleIndex;
+                }
+            }
+        }
+        const qint64 ruleEnd = lineTimer.nsecsElapsed();
+        recordRuleTime(ruleIndex, ruleEnd - ruleStart, matches, text.length());
+        ruleStart = ruleEnd;
+    }
+}
+
+void AlteGrammar::recordRuleTime(int ruleIndex, qint64 nanoseconds, int matches, int lineLength) const {
+    RuleStats& stats = m_stats[ruleIndex];
+    ProfileBatch* batch = currentProfileBatch;
+    if (batch && &batch->m_grammar == this) {
+        ProfileBatch::Counters& counters = batch->m_counters[ruleIndex];
+        counters.nanoseconds += nanoseconds;
+        counters.matches += matches;
+        ++counters.lines;
+    } else {
+        stats.nanoseconds.fetchAndAddRelaxed(nanoseconds);
+        stats.matches.fetchAndAddRelaxed(matches);
+        stats.lines.fetchAndAddRelaxed(1);
+    }
+    if (nanoseconds <= kLineBudgetNs) return;
+    if (m_rules[ruleIndex].isBlockRule) {
+        // Block rules decide the line state and cannot be left out.
+        if (stats.reported.testAndSetRelaxed(0, 1)) {
+            qCWarning(lcGrammar) << "AlteGrammar: Block rule" << m_rules[ruleIndex].name << "of" << m_languageName << "took"
+                       << nanoseconds / 1000000 << "ms on a line of" << lineLength << "characters.";
+        }
+        return;
+    }
+
+    int slowLength = stats.slowLineLength.loadRelaxed();
+    while (lineLength < slowLength && !stats.slowLineLength.testAndSetRelaxed(slowLength, lineLength)) {
+        slowLength = stats.slowLineLength.loadRelaxed();
+    }
+    if (stats.reported.testAndSetRelaxed(0, 1)) {
+        qCWarning(lcGrammar) << "AlteGrammar: Rule" << m_rules[ruleIndex].name << "of" << m_languageName << "took"
+                   << nanoseconds / 1000000 << "ms on a line of" << lineLength
+                   << "characters; skipping it on lines at least that long.";
+    }
+}
+
+void AlteGrammar::recordSkippedLine(int ruleIndex) const {
+    ProfileBatch* batch = currentProfileBatch;
+    if (batch && &batch->m_grammar == this) {
+        ++batch->m_counters[ruleIndex].skippedLines;
+    } else {
+        m_stats[ruleIndex].skippedLines.fetchAndAddRelaxed(1);
+    }
+}
+
+AlteGrammar::ProfileBatch::ProfileBatch(const AlteGrammar& grammar)
+    : m_grammar(grammar), m_counters(grammar.m_rules.size()), m_outer(currentProfileBatch) {
+    currentProfileBatch = this;
+}
+
+AlteGrammar::ProfileBatch::~ProfileBatch() {
+    currentProfileBatch = m_outer;
+    if (!m_grammar.m_stats) return;
+    for (int i = 0; i < m_counters.size(); ++i) {
+        const Counters& counters = m_counters[i];
+        if (counters.lines == 0 && counters.skippedLines == 0) continue;
+        RuleStats& stats = m_grammar.m_stats[i];
+        stats.nanoseconds.fetchAndAddRelaxed(counters.nanoseconds);
+        stats.matches.fetchAndAddRelaxed(counters.matches);
+        stats.lines.fetchAndAddRelaxed(counters.lines);
+        stats.skippedLines.fetchAndAddRelaxed(counters.skippedLines);
+    }
+}
+
+QVector<AlteGrammar::RuleProfile> AlteGrammar::profile() const {
+    QVector<RuleProfile> rules;
+    if (!m_stats) return rules;
+    rules.reserve(m_rules.size());
+    for (int i = 0; i < m_rules.size(); ++i) {
+        const RuleStats& stats = m_stats[i];
+        RuleProfile rule;
+        rule.name = m_rules[i].name;
+        rule.nanoseconds = stats.nanoseconds.loadRelaxed();
+        rule.matches = stats.matches.loadRelaxed();
+        rule.lines = stats.lines.loadRelaxed();
+        rule.skippedLines = stats.skippedLines.loadRelaxed();
+        rule.slow = stats.slowLineLength.loadRelaxed() != INT_MAX;
+        rules.append(rule);
+    }
+    return rules;
+}
+
+QJsonObject AlteGrammar::profileToJson() const {
+    QJsonArray rules;
+    for (const RuleProfile& rule : profile()) {
+        QJsonObject entry;
+        entry["name"] = rule.name;
+        entry["nanoseconds"] = rule.nanoseconds;
+        entry["matches"] = rule.matches;
+        entry["lines"] = rule.lines;
+        entry["skipped_lines"] = rule.skippedLines;
+        entry["slow"] = rule.slow;
+        rules.append(entry);
+    }
+    QJsonObject root;
+    root["language_name"] = m_languageName;
+    root["rules"] = rules;
+    return root;
+}
+
+void AlteGrammar::resetProfile() const {
+    if (!m_stats) return;
+    for (int i = 0; i < m_rules.size(); ++i) {
+        RuleStats& stats = m_stats[i];
+        stats.nanoseconds.storeRelaxed(0);
+        stats.matches.storeRelaxed(0);
+        stats.lines.storeRelaxed(0);
+        stats.skippedLines.storeRelaxed(0);
+        stats.slowLineLength.storeRelaxed(INT_MAX);
+        stats.reported.storeRelaxed(0);
+    }
+}
+
+// Finds the first non-empty opening of a block rule at or after from.
+bool AlteGrammar::findBlockStart(const Rule& rule, const QString& text, int from, int& start, int& end) const {
+    const qint64 searchStart = lineTimer.nsecsElapsed();
+    bool found = false;
+    while (from <= text.length()) {
+        if (!rule.literalPrefix.isEmpty()) {
+            from = text.indexOf(rule.literalPrefix, from);
+            if (from < 0) break;
+        }
+        const QRegularExpressionMatch match = rule.pattern.match(text, from);
+        if (!match.hasMatch()) break;
+        if (match.capturedLength() > 0) {
+            start = match.capturedStart();
+            end = match.capturedEnd();
+            found = true;
+            break;
+        }
+        // An empty opening would never move the walk forward.
+        from = match.capturedStart() + 1;
+    }
+    recordRuleTime(int(&rule - m_rules.constData()), lineTimer.nsecsElapsed() - searchStart, found ? 1 : 0, text.length());
+    return found;
+}
+
+// Finds the closing delimiter of a block rule at or after from.
+bool AlteGrammar::findBlockEnd(const Rule& rule, const QString& text, int from, int& start, int& end) const {
+    if (!rule.endLiteralPrefix.isEmpty()) {
+        from = text.indexOf(rule.endLiteralPrefix, from);
+        if (from < 0) return false;
+    }
+    const qint64 searchStart = lineTimer.nsecsElapsed();
+    const QRegularExpressionMatch endMatch = rule.endPattern.match(text, from);
+    recordRuleTime(int(&rule - m_rules.constData()), lineTimer.nsecsElapsed() - searchStart,
+                   endMatch.hasMatch() ? 1 : 0, text.length());
+    if (!endMatch.hasMatch()) return false;
+    start = endMatch.capturedStart();
+    end = endMatch.capturedEnd();
+    return true;
+}
+
+void AlteGrammar::stackForState(int state, StateStack& stack) const {
+    stack.clear();
+    if (state <= 0) return;
+    if (state <= m_rules.size()) {
+        // States of another grammar may be handed in right after a language change.
+        if (m_rules[state - 1].isBlockRule) {
+            stack.append(quint16(state - 1));
+        }
+        return;
+    }
+    QReadLocker locker(&m_stateLock);
+    const int slot = state - m_rules.size() - 1;
+    if (slot < m_stateStacks.size()) {
+        stack = m_stateStacks[slot];
+    }
+}
+
+int AlteGrammar::stateForStack(const StateStack& stack) const {
+    if (stack.isEmpty()) return 0;
+    if (stack.size() == 1) return stack.first() + 1;
+    {
+        QReadLocker locker(&m_stateLock);
+        const auto it = m_stateIds.constFind(stack);
+        if (it != m_stateIds.constEnd()) return it.value();
+    }
+    QWriteLocker locker(&m_stateLock);
+    const auto it = m_stateIds.constFind(stack);
+    if (it != m_stateIds.constEnd()) return it.value(); // Interned by another thread meanwhile
+    m_stateStacks.append(stack);
+    const int state = m_rules.size() + m_stateStacks.size();
+    m_stateIds.insert(stack, state);
+    return state;
+}
@@ -0,0 +1,137 @@
+#include "AlteHighlighterProfileDialog.h"
+#include "AlteLog.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPushButton>
+#include <QFileDialog>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QDebug>
+
+namespace {
+enum Column { NameColumn, TimeColumn, MatchesColumn, LinesColumn, SkippedColumn, SlowColumn, ColumnCount };
+
+QTableWidgetItem* numberItem(qint64 value) {
+    QTableWidgetItem* item = new QTableWidgetItem;
+    item->setData(Qt::DisplayRole, QVariant::fromValue(value));
+    item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    return item;
+}
+}
+
+AlteHighlighterProfileDialog::AlteHighlighterProfileDialog(QWidget *parent)
+    : QDialog(parent) {
+    setWindowTitle(tr("Highlighter Profile"));
+    setModal(false);
+    resize(640, 420);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+    m_summary = new QLabel(this);
+    mainLayout->addWidget(m_summary);
+
+    m_table = new QTableWidget(0, ColumnCount, this);
+    m_table->setHorizontalHeaderLabels({tr("Rule"), tr("Time (µs)"), tr("Matches"), tr("Lines"), tr("Skipped"), tr("Slow")});
+    m_table->horizontalHeader()->setSectionResizeMode(NameColumn, QHeaderView::Stretch);
+    m_table->verticalHeader()->setVisible(false);
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    // Most expensive first.
+    m_table->horizontalHeader()->setSortIndicator(TimeColumn, Qt::DescendingOrder);
+    mainLayout->addWidget(m_table);
+    QLabel* budgetNote = new QLabel(tr("A line's 10 ms budget is checked between rules, so it is not a hard stop: "
+                                       "rules left when it runs out are skipped (\"Skipped\"), and a rule that used it "
+                                       "up alone is skipped on lines at least as long from then on (\"Slow\"). "
+                                       "A single match is cut off by the regex match limit instead."), this);
+    budgetNote->setWordWrap(true);
+    mainLayout->addWidget(budgetNote);
+
+    QHBoxLayout* buttons = new QHBoxLayout;
+    QPushButton* resetButton = new QPushButton(tr("Reset"), this);
+    QPushButton* saveButton = new QPushButton(tr("Save JSON..."), this);
+    QPushButton* closeButton = new QPushButton(tr("Close"), this);
+    buttons->addWidget(resetButton);
+    buttons->addWidget(saveButton);
+    buttons->addStretch();
+    buttons->addWidget(closeButton);
+    mainLayout->addLayout(buttons);
+    connect(resetButton, &QPushButton::clicked, this, &AlteHighlighterProfileDialog::resetProfile);
+    connect(saveButton, &QPushButton::clicked, this, &AlteHighlighterProfileDialog::saveJson);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::close);
+
+    m_refreshTimer.setInterval(1000);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &AlteHighlighterProfileDialog::refresh);
+}
+
+void AlteHighlighterProfileDialog::setGrammar(const QSharedPointer<const AlteGrammar>& grammar) {
+    m_grammar = grammar;
+    refresh();
+}
+
+void AlteHighlighterProfileDialog::showEvent(QShowEvent *event) {
+    QDialog::showEvent(event);
+    refresh();
+    m_refreshTimer.start();
+}
+
+void AlteHighlighterProfileDialog::hideEvent(QHideEvent *event) {
+    m_refreshTimer.stop();
+    QDialog::hideEvent(event);
+}
+
+void AlteHighlighterProfileDialog::refresh() {
+    QVector<AlteGrammar::RuleProfile> rules;
+    if (m_grammar) {
+        rules = m_grammar->profile();
+    }
+    qint64 total = 0;
+    m_table->setSortingEnabled(false);
+    m_table->setRowCount(rules.size());
+    for (int row = 0; row < rules.size(); ++row) {
+        const AlteGrammar::RuleProfile& rule = rules[row];
+        total += rule.nanoseconds;
+        m_table->setItem(row, NameColumn, new QTableWidgetItem(rule.name));
+        m_table->setItem(row, TimeColumn, numberItem(rule.nanoseconds / 1000));
+        m_table->setItem(row, MatchesColumn, numberItem(rule.matches));
+        m_table->setItem(row, LinesColumn, numberItem(rule.lines));
+        m_table->setItem(row, SkippedColumn, numberItem(rule.skippedLines));
+        m_table->setItem(row, SlowColumn, new QTableWidgetItem(rule.slow ? tr("yes") : QString()));
+    }
+    m_table->setSortingEnabled(true);
+
+    if (m_grammar) {
+        m_summary->setText(tr("%1: %2 rules, %3 ms in total")
+                               .arg(m_grammar->languageName())
+                               .arg(rules.size())
+                               .arg(total / 1000000));
+    } else {
+        m_summary->setText(tr("No grammar in the current tab."));
+    }
+}
+
+void AlteHighlighterProfileDialog::resetProfile() {
+    if (m_grammar) {
+        m_grammar->resetProfile();
+    }
+    refresh();
+}
+
+void AlteHighlighterProfileDialog::saveJson() {
+    if (!m_grammar) return;
+    const QString filePath = QFileDialog::getSaveFileName(this, tr("Save Highlighter Profile"),
+                                                          m_grammar->languageName() + "-profile.json",
+                                                          tr("JSON Files (*.json)"));
+    if (filePath.isEmpty()) return;
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcGrammar) << "AlteHighlighterProfileDialog: Could not write" << filePath << ":" << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(m_grammar->profileToJson()).toJson());
+    if (!file.commit()) {
+        qCWarning(lcGrammar) << "AlteHighlighterProfileDialog: Could not write" << filePath << ":" << file.errorString();
+    }
+}
@@ -0,0 +1,215 @@
+#include "AlteIdentifierIndex.h"
+#include "AlteTokenStore.h"
+#include <QTextBlock>
+#include <QTextDocument>
+#include <algorithm>
+
+namespace {
+// Shorter words are typed faster than picked from a list.
+const int kMinWordLength = 3;
+// Entries of the sorted map looked at per query, which bounds a one-letter prefix.
+const int kMaxScannedCandidates = 20000;
+// The arena is rebuilt once at least this many ids are dead and they make up
+// more than half of it.
+const qsizetype kCompactMinGarbage = 64 * 1024;
+
+bool isWordStart(QChar c) {
+    return c.isLetter() || c == QLatin1Char('_');
+}
+
+bool isWordChar(QChar c) {
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+}
+
+void AlteIdentifierIndex::setKeywords(const QStringList& keywords) {
+    for (int id = 0; id < m_entries.size(); ++id) {
+        if (!m_entries[id].keyword) continue;
+        m_entries[id].keyword = false;
+        if (m_entries[id].count == 0) {
+            release(quint32(id));
+        }
+    }
+    for (const QString& keyword : keywords) {
+        if (keyword.isEmpty()) continue;
+        m_entries[intern(keyword)].keyword = true;
+    }
+}
+
+quint32 AlteIdentifierIndex::intern(const QString& word) {
+    const auto it = m_ids.constFind(word);
+    if (it != m_ids.constEnd()) return it.value();
+    quint32 id;
+    if (!m_free.isEmpty()) {
+        id = m_free.takeLast();
+        m_entries[id] = Entry();
+    } else {
+        id = quint32(m_entries.size());
+        m_entries.append(Entry());
+    }
+    m_entries[id].text = word;
+    m_ids.insert(word, id);
+    m_sorted.insert(word, id);
+    return id;
+}
+
+void AlteIdentifierIndex::release(quint32 id) {
+    Entry& entry = m_entries[id];
+    m_ids.remove(entry.text);
+    m_sorted.remove(entry.text);
+    entry = Entry();
+    m_free.append(id);
+}
+
+void AlteIdentifierIndex::setRecordWords(AlteLineRecord* record, const QVector<quint32>& ids) {
+    const quint32 count = quint32(ids.size());
+    if (record->wordCount > 0 && count <= record->wordCount) {
+        std::copy(ids.cbegin(), ids.cend(), m_lineWords.begin() + record->firstWord);
+        m_garbage += record->wordCount - count;
+    } else {
+        m_garbage += record->wordCount;
+        record->firstWord = quint32(m_lineWords.size());
+        m_lineWords.append(ids);
+    }
+    record->wordCount = count;
+}
+
+void AlteIdentifierIndex::scanWords(const QString& text, std::span<const AlteToken> tokens, const AlteGrammar* grammar,
+                                    QVector<QStringView>& words) {
+    words.clear();
+    auto token = tokens.begin();
+    int i = 0;
+    while (i < text.length()) {
+        if (!isWordStart(text.at(i))) {
+            // Skip the rest of a number or other word that does not start an identifier.
+            while (i < text.length() && isWordChar(text.at(i))) {
+                ++i;
+            }
+            if (i < text.length() && !isWordStart(text.at(i))) ++i;
+            continue;
+        }
+        const int start = i;
+        while (i < text.length() && isWordChar(text.at(i))) {
+            ++i;
+        }
+        if (i - start < kMinWordLength) continue;
+        if (grammar) {
+            while (token != tokens.end() && int(token->start + token->length) <= start) {
+                ++token;
+            }
+            if (token != tokens.end() && int(token->start) <= start && grammar->isOpaqueStyle(token->style)) {
+                continue; // Inside a comment or string
+            }
+        }
+        words.append(QStringView(text).mid(start, i - start));
+    }
+}
+
+void AlteIdentifierIndex::updateLine(const QTextBlock& block, const QString& text, std::span<const AlteToken> tokens,
+                                     const AlteGrammar* grammar) {
+    AlteLineRecord* record = AlteTokenStore::record(block);
+    if (!record) return;
+
+    scanWords(text, tokens, grammar, m_scratchWords);
+    m_scratch.clear();
+    for (const QStringView word : m_scratchWords) {
+        m_scratch.append(intern(word.toString()));
+    }
+    std::sort(m_scratch.begin(), m_scratch.end());
+    m_scratch.erase(std::unique(m_scratch.begin(), m_scratch.end()), m_scratch.end());
+
+    // Count the new words before releasing the old ones, so words the line
+    // keeps are not released and interned again.
+    for (const quint32 id : m_scratch) {
+        ++m_entries[id].count;
+    }
+    for (quint32 k = 0; k < record->wordCount; ++k) {
+        const quint32 id = m_lineWords[record->firstWord + k];
+        if (--m_entries[id].count == 0 && !m_entries[id].keyword) {
+            release(id);
+        }
+    }
+    setRecordWords(record, m_scratch);
+
+    if (m_garbage >= kCompactMinGarbage && m_garbage * 2 > m_lineWords.size()) {
+        recount(block.document());
+    }
+}
+
+void AlteIdentifierIndex::recount(QTextDocument* document) {
+    if (!document) return;
+    for (Entry& entry : m_entries) {
+        entry.count = 0;
+    }
+    QVector<quint32> live;
+    live.reserve(m_lineWords.size() - m_garbage);
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        AlteLineRecord* record = AlteTokenStore::record(block);
+        if (!record || record->wordCount == 0) continue;
+        const qsizetype firstWord = live.size();
+        for (quint32 k = 0; k < record->wordCount; ++k) {
+            const quint32 id = m_lineWords[record->firstWord + k];
+            ++m_entries[id].count;
+            live.append(id);
+        }
+        record->firstWord = quint32(firstWord);
+    }
+    m_lineWords = live;
+    m_garbage = 0;
+
+    // Identifiers only deleted lines used.
+    for (int id = 0; id < m_entries.size(); ++id) {
+        const Entry& entry = m_entries[id];
+        if (entry.count == 0 && !entry.keyword && !entry.text.isEmpty()) {
+            release(quint32(id));
+        }
+    }
+}
+
+void AlteIdentifierIndex::clear(QTextDocument* document) {
+    if (document) {
+        for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+            if (AlteLineRecord* record = AlteTokenStore::record(block)) {
+                record->firstWord = 0;
+                record->wordCount = 0;
+            }
+        }
+    }
+    m_lineWords = QVector<quint32>();
+    m_garbage = 0;
+    for (int id = 0; id < m_entries.size(); ++id) {
+        m_entries[id].count = 0;
+        if (!m_entries[id].keyword && !m_entries[id].text.isEmpty()) {
+            release(quint32(id));
+        }
+    }
+}
+
+QStringList AlteIdentifierIndex::complete(const QString& prefix, int limit) const {
+    if (prefix.isEmpty() || limit <= 0) return {};
+    QVector<const Entry*> candidates;
+    int scanned = 0;
+    for (auto it = m_sorted.lowerBound(prefix);
+         it != m_sorted.constEnd() && scanned < kMaxScannedCandidates && it.key().startsWith(prefix); ++it, ++scanned) {
+        const Entry& entry = m_entries[it.value()];
+        if (entry.text.length() > prefix.length()) {
+            candidates.append(&entry);
+        }
+    }
+
+    const auto ranked = [](const Entry* a, const Entry* b) {
+        if (a->count != b->count) return a->count > b->count;
+        if (a->keyword != b->keyword) return a->keyword;
+        if (a->text.length() != b->text.length()) return a->text.length() < b->text.length();
+        return a->text < b->text;
+    };
+    const qsizetype shown = qMin(qsizetype(limit), candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + shown, candidates.end(), ranked);
+
+    QStringList result;
+    result.reserve(shown);
+    for (qsizetype i = 0; i < shown; ++i) {
+        result.append(candidates[i]->text);
+    }
+    return result;
+}
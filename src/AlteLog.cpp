@@ -0,0 +1,9 @@
+#include "AlteLog.h"
+
+Q_LOGGING_CATEGORY(lcStartup, "alte.startup", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcTheme, "alte.theme", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcLanguage, "alte.language", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcGrammar, "alte.grammar", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcDocument, "alte.document", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcProject, "alte.project", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcTrace, "alte.trace", QtInfoMsg)
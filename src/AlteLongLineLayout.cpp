@@ -0,0 +1,393 @@
+#include "AlteLongLineLayout.h"
+#include <QFontMetricsF>
+#include <QPainter>
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextEdit>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace {
+// Characters per measured chunk of a long line. A slice is the visible chunks
+// plus one on either side, so short scrolls reuse it.
+const int kChunkLength = 4096;
+
+QTextOption noWrapOption(const QTextDocument *document) {
+    QTextOption option = document->defaultTextOption();
+    option.setWrapMode(QTextOption::NoWrap);
+    return option;
+}
+
+void layOutSingleLine(QTextLayout *layout) {
+    layout->beginLayout();
+    QTextLine line = layout->createLine();
+    if (line.isValid()) {
+        line.setLineWidth(qreal(INT_MAX));
+        line.setPosition(QPointF(0, 0));
+    }
+    layout->endLayout();
+}
+}
+
+AlteLongLineLayout::AlteLongLineLayout(QTextDocument *document, int longLineThreshold)
+    : QAbstractTextDocumentLayout(document), m_threshold(qMax(1, longLineThreshold)), m_lineHeight(1), m_advance(1),
+      m_rowsDirty(true), m_width(0), m_sizeChangePending(false) {
+    updateMetrics();
+}
+
+AlteLongLineLayout *AlteLongLineLayout::install(QTextEdit *editor, int longLineThreshold) {
+    QTextDocument *document = editor->document();
+    if (AlteLongLineLayout *existing = qobject_cast<AlteLongLineLayout *>(document->documentLayout())) {
+        return existing;
+    }
+    AlteLongLineLayout *layout = new AlteLongLineLayout(document, longLineThreshold);
+    document->setDocumentLayout(layout);
+    editor->setLineWrapMode(QTextEdit::NoWrap);
+    // QTextEdit scrolls a long line back to its start whenever the cursor moves;
+    // queued, this runs after it and before the repaint.
+    connect(editor, &QTextEdit::cursorPositionChanged, layout, [editor, layout]() {
+        const QTextCursor cursor = editor->textCursor();
+        if (!layout->isLong(cursor.block())) return;
+        const QRectF rect = layout->cursorRect(cursor.position());
+        QScrollBar *scrollBar = editor->horizontalScrollBar();
+        const int width = editor->viewport()->width();
+        if (rect.left() < scrollBar->value() || rect.right() > scrollBar->value() + width) {
+            scrollBar->setValue(int(rect.left()) - width / 2);
+        }
+    }, Qt::QueuedConnection);
+    return layout;
+}
+
+bool AlteLongLineLayout::hasLongLine(const QString &text, int longLineThreshold) {
+    qsizetype lineStart = 0;
+    for (;;) {
+        const qsizetype lineEnd = text.indexOf(QLatin1Char('\n'), lineStart);
+        if ((lineEnd < 0 ? text.size() : lineEnd) - lineStart > longLineThreshold) return true;
+        if (lineEnd < 0) return false;
+        lineStart = lineEnd + 1;
+    }
+}
+
+void AlteLongLineLayout::updateMetrics() {
+    m_font = document()->defaultFont();
+    const QFontMetricsF metrics(m_font);
+    m_lineHeight = qMax<qreal>(1, metrics.height());
+    m_advance = qMax<qreal>(1, metrics.horizontalAdvance(QLatin1Char('x')));
+}
+
+void AlteLongLineLayout::ensureRows() const {
+    if (!m_rowsDirty) return;
+    const QTextDocument *doc = document();
+    m_rowOfBlock.fill(-1, doc->blockCount());
+    m_blockOfRow.clear();
+    for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+        if (!block.isVisible()) continue;
+        m_rowOfBlock[block.blockNumber()] = int(m_blockOfRow.size());
+        m_blockOfRow.append(block.blockNumber());
+    }
+    m_rowsDirty = false;
+}
+
+QTextBlock AlteLongLineLayout::blockAtRow(int row) const {
+    return document()->findBlockByNumber(m_blockOfRow[row]);
+}
+
+bool AlteLongLineLayout::isLong(const QTextBlock &block) const {
+    return block.isValid() && block.length() - 1 > m_threshold;
+}
+
+// Ordinary lines use the block's own layout, which QTextCursor also reads.
+QTextLayout *AlteLongLineLayout::ensureBlockLayout(const QTextBlock &block) const {
+    QTextLayout *layout = block.layout();
+    if (layout->lineCount() == 0) {
+        layout->setTextOption(noWrapOption(document()));
+        layOutSingleLine(layout);
+        growWidth(layout->maximumWidth());
+    }
+    return layout;
+}
+
+AlteLongLineLayout::LongLine &AlteLongLineLayout::longLine(const QTextBlock &block) const {
+    LongLine &line = m_longLines[block.blockNumber()];
+    const int length = block.length() - 1;
+    if (line.revision != block.revision() || line.length != length) {
+        line = LongLine();
+        line.revision = block.revision();
+        line.length = length;
+        const int chunks = (length + kChunkLength - 1) / kChunkLength;
+        line.chunkWidths.resize(chunks);
+        for (int chunk = 0; chunk < chunks; ++chunk) {
+            line.chunkWidths[chunk] = qMin(kChunkLength, length - chunk * kChunkLength) * m_advance;
+        }
+        growWidth(chunkStart(line, chunks));
+    }
+    return line;
+}
+
+qreal AlteLongLineLayout::chunkStart(LongLine &line, int chunk) const {
+    if (line.chunkXDirty) {
+        line.chunkX.resize(line.chunkWidths.size() + 1);
+        qreal x = 0;
+        for (int i = 0; i < line.chunkWidths.size(); ++i) {
+            line.chunkX[i] = x;
+            x += line.chunkWidths[i];
+        }
+        line.chunkX[line.chunkWidths.size()] = x;
+        line.chunkXDirty = false;
+    }
+    return line.chunkX[qBound(0, chunk, int(line.chunkWidths.size()))];
+}
+
+int AlteLongLineLayout::chunkAt(LongLine &line, qreal x) const {
+    chunkStart(line, 0);
+    const auto next = std::upper_bound(line.chunkX.constBegin(), line.chunkX.constEnd() - 1, x);
+    return qBound(0, int(next - line.chunkX.constBegin()) - 1, qMax(0, int(line.chunkWidths.size()) - 1));
+}
+
+// Lays out chunks [fromChunk, toChunk) of a long line, with the formats the
+// highlighter set on the block, and records their measured widths.
+QTextLayout *AlteLongLineLayout::ensureSlice(const QTextBlock &block, LongLine &line, int fromChunk, int toChunk) const {
+    if (line.slice && line.sliceFrom <= fromChunk && line.sliceTo >= toChunk) {
+        return line.slice.data();
+    }
+    const int from = fromChunk * kChunkLength;
+    const int to = qMin(line.length, toChunk * kChunkLength);
+    QTextCursor cursor(document());
+    cursor.setPosition(block.position() + from);
+    cursor.setPosition(block.position() + to, QTextCursor::KeepAnchor);
+
+    QSharedPointer<QTextLayout> slice(new QTextLayout(cursor.selectedText(), document()->defaultFont()));
+    slice->setTextOption(noWrapOption(document()));
+    QVector<QTextLayout::FormatRange> formats;
+    for (const QTextLayout::FormatRange &range : block.layout()->formats()) {
+        const int start = qMax(range.start, from);
+        const int end = qMin(range.start + range.length, to);
+        if (start >= end) continue;
+        QTextLayout::FormatRange clipped;
+        clipped.start = start - from;
+        clipped.length = end - start;
+        clipped.format = range.format;
+        formats.append(clipped);
+    }
+    slice->setFormats(formats);
+    layOutSingleLine(slice.data());
+
+    const QTextLine textLine = slice->lineAt(0);
+    for (int chunk = fromChunk; chunk < toChunk; ++chunk) {
+        const qreal width = textLine.cursorToX(qMin(to, (chunk + 1) * kChunkLength) - from)
+                            - textLine.cursorToX(chunk * kChunkLength - from);
+        if (width != line.chunkWidths[chunk]) {
+            line.chunkWidths[chunk] = width;
+            line.chunkXDirty = true;
+        }
+    }
+    line.slice = slice;
+    line.sliceFrom = fromChunk;
+    line.sliceTo = toChunk;
+    growWidth(chunkStart(line, int(line.chunkWidths.size())));
+    return slice.data();
+}
+
+// Widths are found while painting; the scroll bars learn about them once
+// control returns to the event loop.
+void AlteLongLineLayout::growWidth(qreal width) const {
+    if (width <= m_width) return;
+    m_width = width;
+    if (m_sizeChangePending) return;
+    m_sizeChangePending = true;
+    AlteLongLineLayout *self = const_cast<AlteLongLineLayout *>(this);
+    QMetaObject::invokeMethod(self, [self]() {
+        self->m_sizeChangePending = false;
+        self->m_reportedSize = self->documentSize();
+        emit self->documentSizeChanged(self->m_reportedSize);
+    }, Qt::QueuedConnection);
+}
+
+void AlteLongLineLayout::draw(QPainter *painter, const PaintContext &context) {
+    ensureRows();
+    const QTextDocument *doc = document();
+    const qreal margin = doc->documentMargin();
+    const QRectF clip = context.clip.isValid() ? context.clip : QRectF(QPointF(0, 0), documentSize());
+    const int firstRow = qMax(0, int(std::floor((clip.top() - margin) / m_lineHeight)));
+    const int lastRow = qMin(int(m_blockOfRow.size()) - 1, int(std::floor((clip.bottom() - margin) / m_lineHeight)));
+    bool widthOk = false;
+    int cursorWidth = property("cursorWidth").toInt(&widthOk);
+    if (!widthOk) cursorWidth = 1;
+
+    painter->setPen(context.palette.color(QPalette::Text));
+    for (int row = firstRow; row <= lastRow; ++row) {
+        const QTextBlock block = blockAtRow(row);
+        const qreal y = margin + row * m_lineHeight;
+        const int blockStart = block.position();
+        const int blockEnd = blockStart + block.length() - 1;
+
+        QVector<QTextLayout::FormatRange> selections;
+        for (const Selection &selection : context.selections) {
+            const QTextCursor &cursor = selection.cursor;
+            if (selection.format.boolProperty(QTextFormat::FullWidthSelection)) {
+                if (cursor.position() >= blockStart && cursor.position() <= blockEnd) {
+                    painter->fillRect(QRectF(clip.left(), y, clip.width(), m_lineHeight), selection.format.background());
+                }
+                continue;
+            }
+            const int start = qMax(cursor.selectionStart(), blockStart);
+            const int end = qMin(cursor.selectionEnd(), blockEnd);
+            if (start >= end) continue;
+            QTextLayout::FormatRange range;
+            range.start = start - blockStart;
+            range.length = end - start;
+            range.format = selection.format;
+            selections.append(range);
+        }
+
+        if (!isLong(block)) {
+            QTextLayout *layout = ensureBlockLayout(block);
+            const QPointF position(margin, y);
+            layout->draw(painter, position, selections, clip);
+            if (context.cursorPosition >= blockStart && context.cursorPosition <= blockEnd) {
+                layout->drawCursor(painter, position, context.cursorPosition - blockStart, cursorWidth);
+            }
+            continue;
+        }
+
+        LongLine &line = longLine(block);
+        const int lastChunk = int(line.chunkWidths.size()) - 1;
+        const int fromChunk = qMax(0, chunkAt(line, clip.left() - margin) - 1);
+        const int toChunk = qMin(lastChunk, chunkAt(line, clip.right() - margin) + 1) + 1;
+        QTextLayout *slice = ensureSlice(block, line, fromChunk, toChunk);
+        const int from = line.sliceFrom * kChunkLength;
+        const int length = int(slice->text().size());
+        const QPointF position(margin + chunkStart(line, line.sliceFrom), y);
+        QVector<QTextLayout::FormatRange> sliceSelections;
+        for (QTextLayout::FormatRange range : selections) {
+            const int start = qMax(range.start - from, 0);
+            const int end = qMin(range.start + range.length - from, length);
+            if (start >= end) continue;
+            range.start = start;
+            range.length = end - start;
+            sliceSelections.append(range);
+        }
+        slice->draw(painter, position, sliceSelections, clip);
+        const int cursor = context.cursorPosition - blockStart - from;
+        if (context.cursorPosition >= blockStart && cursor >= 0 && cursor <= length) {
+            slice->drawCursor(painter, position, cursor, cursorWidth);
+        }
+    }
+}
+
+int AlteLongLineLayout::hitTest(const QPointF &point, Qt::HitTestAccuracy accuracy) const {
+    ensureRows();
+    if (m_blockOfRow.isEmpty()) return -1;
+    const qreal margin = document()->documentMargin();
+    int row = int(std::floor((point.y() - margin) / m_lineHeight));
+    if (accuracy == Qt::ExactHit && (row < 0 || row >= m_blockOfRow.size())) return -1;
+    row = qBound(0, row, int(m_blockOfRow.size()) - 1);
+    const QTextBlock block = blockAtRow(row);
+    const qreal x = point.x() - margin;
+
+    if (!isLong(block)) {
+        const QTextLine line = ensureBlockLayout(block)->lineAt(0);
+        if (accuracy == Qt::ExactHit && (x < 0 || x > line.naturalTextWidth())) return -1;
+        return block.position() + line.xToCursor(x);
+    }
+    LongLine &line = longLine(block);
+    const int chunk = chunkAt(line, x);
+    if (accuracy == Qt::ExactHit && (x < 0 || x > chunkStart(line, int(line.chunkWidths.size())))) return -1;
+    const QTextLayout *slice = ensureSlice(block, line, qMax(0, chunk - 1),
+                                           qMin(int(line.chunkWidths.size()), chunk + 2));
+    const int offset = slice->lineAt(0).xToCursor(x - chunkStart(line, line.sliceFrom));
+    return block.position() + line.sliceFrom * kChunkLength + offset;
+}
+
+QRectF AlteLongLineLayout::cursorRect(int position) const {
+    const QTextBlock block = document()->findBlock(position);
+    const QRectF blockRect = blockBoundingRect(block);
+    if (blockRect.isNull()) return QRectF();
+    const int offset = position - block.position();
+    qreal x = 0;
+    if (!isLong(block)) {
+        x = ensureBlockLayout(block)->lineAt(0).cursorToX(offset);
+    } else {
+        LongLine &line = longLine(block);
+        const int chunk = qMin(offset / kChunkLength, qMax(0, int(line.chunkWidths.size()) - 1));
+        const QTextLayout *slice = ensureSlice(block, line, qMax(0, chunk - 1),
+                                               qMin(int(line.chunkWidths.size()), chunk + 2));
+        const int from = line.sliceFrom * kChunkLength;
+        x = chunkStart(line, line.sliceFrom) + slice->lineAt(0).cursorToX(offset - from);
+    }
+    return QRectF(blockRect.left() + x, blockRect.top(), 1, m_lineHeight);
+}
+
+int AlteLongLineLayout::pageCount() const {
+    return 1;
+}
+
+QSizeF AlteLongLineLayout::documentSize() const {
+    ensureRows();
+    const qreal margin = document()->documentMargin();
+    return QSizeF(m_width + 2 * margin, m_blockOfRow.size() * m_lineHeight + 2 * margin);
+}
+
+QRectF AlteLongLineLayout::frameBoundingRect(QTextFrame *) const {
+    return QRectF(QPointF(0, 0), documentSize());
+}
+
+QRectF AlteLongLineLayout::blockBoundingRect(const QTextBlock &block) const {
+    if (!block.isValid() || !block.isVisible()) return QRectF();
+    ensureRows();
+    const int row = m_rowOfBlock.value(block.blockNumber(), -1);
+    if (row < 0) return QRectF();
+    qreal width = 0;
+    if (isLong(block)) {
+        LongLine &line = longLine(block);
+        width = chunkStart(line, int(line.chunkWidths.size()));
+    } else {
+        // QTextCursor relies on this to lay out the blocks it moves through.
+        width = ensureBlockLayout(block)->lineAt(0).naturalTextWidth();
+    }
+    const qreal margin = document()->documentMargin();
+    return QRectF(margin, margin + row * m_lineHeight, width, m_lineHeight);
+}
+
+void AlteLongLineLayout::documentChanged(int from, int charsRemoved, int charsAdded) {
+    Q_UNUSED(charsRemoved);
+    QTextDocument *doc = document();
+    if (doc->defaultFont() != m_font) {
+        updateMetrics();
+        for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+            block.layout()->clearLayout();
+        }
+        m_longLines.clear();
+        m_width = 0;
+    }
+    if (m_rowOfBlock.size() != doc->blockCount()) {
+        // Long lines are kept by block number.
+        m_rowsDirty = true;
+        m_longLines.clear();
+    }
+
+    const QTextBlock last = doc->findBlock(qMax(from, from + charsAdded - 1));
+    for (QTextBlock block = doc->findBlock(from); block.isValid(); block = block.next()) {
+        const int number = block.blockNumber();
+        if (!m_rowsDirty && (m_rowOfBlock.value(number, -1) >= 0) != block.isVisible()) {
+            m_rowsDirty = true;
+        }
+        // Text or formats changed; layouts are redone when next shown.
+        block.layout()->clearLayout();
+        const auto entry = m_longLines.find(number);
+        if (entry != m_longLines.end()) {
+            entry->slice.reset();
+        }
+        if (block == last) break;
+    }
+
+    const QSizeF size = documentSize();
+    if (size != m_reportedSize) {
+        m_reportedSize = size;
+        emit documentSizeChanged(size);
+    }
+    emit update();
+}
@@ -0,0 +1,477 @@
+#include "AlteProjectIndex.h"
+#include "AlteIdentifierIndex.h"
+#include "AlteLog.h"
+#include "AlteThemeManager.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+const quint32 kIndexMagic = 0x414C5049; // "ALPI"
+const quint32 kIndexFormatVersion = 1;
+// Larger files are most likely generated or data, not code worth completing from.
+const qint64 kMaxFileSize = 2 * 1024 * 1024;
+// Lines longer than this (minified code) are skipped.
+const int kMaxLineLength = 20000;
+const int kMaxFiles = 50000;
+// inotify watches are a per-user resource shared with every other program.
+const int kMaxWatchedDirectories = 4096;
+// Files watched for edits in place, which their directory's watch misses.
+const int kMaxWatchedFiles = 2048;
+// Files tokenized per pool task and per batch merged on the UI thread.
+const int kChunkFiles = 32;
+// Entries of the sorted map looked at per query.
+const int kMaxScannedCandidates = 20000;
+const int kSaveDelayMs = 5000;
+
+bool isSkippedDirectory(const QString& name) {
+    return name == QLatin1String("node_modules");
+}
+}
+
+AlteProjectIndex::AlteProjectIndex(AlteThemeManager* themeManager, QObject* parent)
+    : QObject(parent), m_themeManager(themeManager), m_generation(0), m_dirty(false) {
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &AlteProjectIndex::onDirectoryChanged);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &AlteProjectIndex::refreshFile);
+
+    m_saveTimer = new QTimer(this);
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(kSaveDelayMs);
+    connect(m_saveTimer, &QTimer::timeout, this, &AlteProjectIndex::saveIndex);
+}
+
+AlteProjectIndex::~AlteProjectIndex() {
+    ++m_generation;
+    m_pool.clear();
+    saveIndex();
+    m_pool.waitForDone();
+}
+
+void AlteProjectIndex::openFolder(const QString& folderPath) {
+    close();
+    m_folder = QDir(folderPath).absolutePath();
+
+    // Extensions come from the language manifest; grammars are only compiled
+    // for the languages the folder turns out to contain.
+    m_languages.clear();
+    m_grammars.clear();
+    if (m_themeManager) {
+        for (const QString& language : m_themeManager->getAvailableLanguages()) {
+            if (language == QLatin1String("Plain Text")) continue;
+            for (const QString& extension : m_themeManager->getExtensionsForLanguage(language)) {
+                const QString suffix = extension.mid(1);
+                if (!suffix.isEmpty() && !m_languages.contains(suffix)) {
+                    m_languages.insert(suffix, language);
+                }
+            }
+        }
+    }
+    qCDebug(lcProject) << "AlteProjectIndex: Indexing" << m_folder;
+    loadIndex();
+}
+
+void AlteProjectIndex::close() {
+    ++m_generation;
+    m_pool.clear();
+    saveIndex();
+    m_saveTimer->stop();
+    if (!m_watcher->directories().isEmpty()) {
+        m_watcher->removePaths(m_watcher->directories());
+    }
+    if (!m_watcher->files().isEmpty()) {
+        m_watcher->removePaths(m_watcher->files());
+    }
+    m_waitingFiles.clear();
+    m_files.clear();
+    m_words.clear();
+    m_folder.clear();
+}
+
+QString AlteProjectIndex::indexFilePath() const {
+    const QString cachePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (cachePath.isEmpty()) return QString();
+    QDir cacheDir(cachePath);
+    if (!cacheDir.mkpath("projects")) {
+        qCWarning(lcProject) << "AlteProjectIndex: Could not create index directory in" << cachePath;
+        return QString();
+    }
+    const QByteArray key = QCryptographicHash::hash(m_folder.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return cacheDir.filePath("projects/" + QString::fromLatin1(key) + ".idx");
+}
+
+void AlteProjectIndex::loadIndex() {
+    const quint64 generation = m_generation.load();
+    const QString filePath = indexFilePath();
+    const QString folder = m_folder;
+    m_pool.start(QRunnable::create([this, generation, filePath, folder]() {
+        QHash<QString, AlteProjectFile> files;
+        QFile file(filePath);
+        if (!filePath.isEmpty() && file.open(QIODevice::ReadOnly)) {
+            QDataStream in(&file);
+            in.setVersion(QDataStream::Qt_5_15);
+            quint32 magic = 0;
+            quint32 formatVersion = 0;
+            QString indexedFolder;
+            qint32 count = 0;
+            in >> magic >> formatVersion >> indexedFolder >> count;
+            if (magic == kIndexMagic && formatVersion == kIndexFormatVersion && indexedFolder == folder) {
+                for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+                    AlteProjectFile entry;
+                    in >> entry.path >> entry.modified >> entry.size >> entry.words;
+                    files.insert(entry.path, entry);
+                }
+            }
+            if (in.status() != QDataStream::Ok) {
+                qCWarning(lcProject) << "AlteProjectIndex: Ignoring corrupt index" << filePath;
+                files.clear();
+            }
+        }
+        QMap<QString, int> words;
+        for (const AlteProjectFile& entry : std::as_const(files)) {
+            for (const QString& word : entry.words) {
+                ++words[word];
+            }
+        }
+        QMetaObject::invokeMethod(this, [this, generation, files, words]() {
+            if (generation != m_generation.load()) return;
+            m_files = files;
+            m_words = words;
+            emit filesIndexed(int(m_files.size()));
+            // Only what changed since the index was written gets tokenized.
+            startScan(m_folder, true);
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void AlteProjectIndex::saveIndex() {
+    if (!m_dirty || m_folder.isEmpty()) return;
+    m_dirty = false;
+    const QString filePath = indexFilePath();
+    if (filePath.isEmpty()) return;
+    const QString folder = m_folder;
+    const QHash<QString, AlteProjectFile> files = m_files;
+    m_pool.start(QRunnable::create([filePath, folder, files]() {
+        QSaveFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCWarning(lcProject) << "AlteProjectIndex: Could not write" << filePath << ":" << file.errorString();
+            return;
+        }
+        QDataStream out(&file);
+        out.setVersion(QDataStream::Qt_5_15);
+        out << kIndexMagic << kIndexFormatVersion << folder << qint32(files.size());
+        for (const AlteProjectFile& entry : files) {
+            out << entry.path << entry.modified << entry.size << entry.words;
+        }
+        if (!file.commit()) {
+            qCWarning(lcProject) << "AlteProjectIndex: Could not write" << filePath << ":" << file.errorString();
+        }
+    }));
+}
+
+void AlteProjectIndex::startScan(const QString& directoryPath, bool recursive) {
+    const quint64 generation = m_generation.load();
+    const QString folder = m_folder;
+    const LanguageMap languages = m_languages;
+    const QHash<QString, AlteProjectFile> known = m_files;
+    m_pool.start(QRunnable::create([this, generation, folder, directoryPath, recursive, languages, known]() {
+        const QDir root(folder);
+        QStringList present;
+        QStringList directories;
+        QHash<QString, QStringList> changed; // By language
+        QStringList pending(directoryPath);
+        while (!pending.isEmpty() && present.size() < kMaxFiles) {
+            if (generation != m_generation.load()) return;
+            const QDir directory(pending.takeFirst());
+            directories.append(directory.absolutePath());
+            const QFileInfoList entries = directory.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+            for (const QFileInfo& info : entries) {
+                if (info.isDir()) {
+                    if (recursive && !info.isSymLink() && !isSkippedDirectory(info.fileName())) {
+                        pending.append(info.absoluteFilePath());
+                    } else if (!recursive) {
+                        directories.append(info.absoluteFilePath());
+                    }
+                    continue;
+                }
+                if (info.size() > kMaxFileSize) continue;
+                QString language = languages.value(info.completeSuffix());
+                if (language.isEmpty()) language = languages.value(info.suffix());
+                if (language.isEmpty()) continue;
+                const QString path = root.relativeFilePath(info.absoluteFilePath());
+                present.append(path);
+                const auto it = known.constFind(path);
+                if (it == known.constEnd() || it->size != info.size()
+                    || it->modified != info.lastModified().toMSecsSinceEpoch()) {
+                    changed[language].append(path);
+                }
+            }
+        }
+
+        QMetaObject::invokeMethod(this, [this, generation, directoryPath, recursive, present, directories, changed]() {
+            applyListing(generation, directoryPath, recursive, present, directories);
+            tokenizeFiles(generation, changed);
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void AlteProjectIndex::tokenizeFiles(quint64 generation, const QHash<QString, QStringList>& changedByLanguage) {
+    if (generation != m_generation.load()) return;
+    for (auto it = changedByLanguage.constBegin(); it != changedByLanguage.constEnd(); ++it) {
+        const auto grammar = m_grammars.constFind(it.key());
+        if (grammar != m_grammars.constEnd()) {
+            startTokenizing(generation, grammar.value(), it.value());
+            continue;
+        }
+        // The files wait for the grammar, which is compiled once however many ask.
+        const bool building = m_waitingFiles.contains(it.key());
+        m_waitingFiles[it.key()] += it.value();
+        if (!building) buildGrammar(generation, it.key());
+    }
+}
+
+void AlteProjectIndex::buildGrammar(quint64 generation, const QString& language) {
+    // Only gathering the definitions needs the UI thread; the rules are compiled
+    // on the pool, and the workers share the grammar, which is immutable.
+    AlteGrammar::Source source;
+    const QSharedPointer<const AlteGrammar> cached =
+        m_themeManager ? AlteGrammar::prepare(language, m_themeManager, source) : QSharedPointer<const AlteGrammar>();
+    if (cached || !m_themeManager) {
+        grammarReady(generation, language, cached);
+        return;
+    }
+    m_pool.start(QRunnable::create([this, generation, language, source]() {
+        const QSharedPointer<const AlteGrammar> grammar = AlteGrammar::build(source);
+        QMetaObject::invokeMethod(this, [this, generation, language, source, grammar]() {
+            AlteGrammar::keep(source, grammar);
+            grammarReady(generation, language, grammar);
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void AlteProjectIndex::grammarReady(quint64 generation, const QString& language,
+                                    const QSharedPointer<const AlteGrammar>& grammar) {
+    if (generation != m_generation.load()) return;
+    const QSharedPointer<const AlteGrammar> usable =
+        grammar && !grammar->isEmpty() ? grammar : QSharedPointer<const AlteGrammar>();
+    m_grammars.insert(language, usable);
+    startTokenizing(generation, usable, m_waitingFiles.take(language));
+}
+
+void AlteProjectIndex::startTokenizing(quint64 generation, const QSharedPointer<const AlteGrammar>& grammar,
+                                       const QStringList& paths) {
+    const QString folder = m_folder;
+    for (int first = 0; first < paths.size(); first += kChunkFiles) {
+        const QStringList chunk = paths.mid(first, kChunkFiles);
+        m_pool.start(QRunnable::create([this, generation, folder, grammar, chunk]() {
+            QVector<AlteProjectFile> files;
+            for (const QString& path : chunk) {
+                if (generation != m_generation.load()) return;
+                files.append(indexFile(folder, path, grammar));
+            }
+            QMetaObject::invokeMethod(this, [this, generation, files]() {
+                applyFiles(generation, files);
+            }, Qt::QueuedConnection);
+        }));
+    }
+}
+
+AlteProjectFile AlteProjectIndex::indexFile(const QString& folder, const QString& relativePath,
+                                            const QSharedPointer<const AlteGrammar>& grammar) {
+    AlteProjectFile entry;
+    entry.path = relativePath;
+    const QFileInfo info(QDir(folder).filePath(relativePath));
+    entry.modified = info.lastModified().toMSecsSinceEpoch();
+    entry.size = info.size();
+
+    QFile file(info.absoluteFilePath());
+    if (!grammar || !file.open(QIODevice::ReadOnly)) return entry;
+    const QString content = QString::fromUtf8(file.readAll());
+
+    AlteGrammar::ProfileBatch profileBatch(*grammar);
+    QSet<QString> words;
+    QVector<AlteToken> tokens;
+    QVector<QStringView> lineWords;
+    int state = 0;
+    int lineStart = 0;
+    while (lineStart <= content.size()) {
+        int lineEnd = content.indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd < 0) lineEnd = content.size();
+        int length = lineEnd - lineStart;
+        if (length > 0 && content.at(lineEnd - 1) == QLatin1Char('\r')) --length;
+        if (length <= kMaxLineLength) {
+            const QString line = content.mid(lineStart, length);
+            state = grammar->tokenizeLine(line, state, tokens);
+            AlteIdentifierIndex::scanWords(line, tokens, grammar.data(), lineWords);
+            for (const QStringView word : lineWords) {
+                words.insert(word.toString());
+            }
+        }
+        lineStart = lineEnd + 1;
+    }
+    entry.words = QStringList(words.cbegin(), words.cend());
+    return entry;
+}
+
+void AlteProjectIndex::applyFiles(quint64 generation, const QVector<AlteProjectFile>& files) {
+    if (generation != m_generation.load()) return;
+    for (const AlteProjectFile& entry : files) {
+        const auto it = m_files.constFind(entry.path);
+        if (it != m_files.constEnd()) {
+            removeWords(it->words);
+        }
+        addWords(entry.words);
+        m_files.insert(entry.path, entry);
+    }
+    m_dirty = true;
+    m_saveTimer->start();
+    emit filesIndexed(int(m_files.size()));
+}
+
+void AlteProjectIndex::applyListing(quint64 generation, const QString& directoryPath, bool recursive,
+                                    const QStringList& present, const QStringList& directories) {
+    if (generation != m_generation.load()) return;
+
+    // Forget files of the scanned directory that are gone.
+    const QString scope = QDir(directoryPath).absolutePath();
+    const QSet<QString> presentSet(present.cbegin(), present.cend());
+    const QDir root(m_folder);
+    bool removed = false;
+    QStringList gone;
+    for (auto it = m_files.begin(); it != m_files.end();) {
+        const QString absolute = root.absoluteFilePath(it.key());
+        const bool inScope = recursive ? (scope == m_folder || absolute.startsWith(scope + QLatin1Char('/')))
+                                       : QFileInfo(absolute).absolutePath() == scope;
+        if (inScope && !presentSet.contains(it.key())) {
+            removeWords(it->words);
+            gone.append(absolute);
+            it = m_files.erase(it);
+            removed = true;
+        } else {
+            ++it;
+        }
+    }
+    if (removed) {
+        m_dirty = true;
+        m_saveTimer->start();
+        emit filesIndexed(int(m_files.size()));
+    }
+
+    const QStringList watched = m_watcher->directories();
+    const QSet<QString> watchedSet(watched.cbegin(), watched.cend());
+    QStringList toWatch;
+    for (const QString& directory : directories) {
+        if (watchedSet.contains(directory)) continue;
+        if (watched.size() + toWatch.size() >= kMaxWatchedDirectories) {
+            qCWarning(lcProject) << "AlteProjectIndex: Not watching more than" << kMaxWatchedDirectories << "directories of" << m_folder;
+            break;
+        }
+        const QFileInfo info(directory);
+        if (!recursive && directory != scope) {
+            // A directory created since the last scan.
+            if (info.isDir() && !info.isHidden() && !info.isSymLink() && !isSkippedDirectory(info.fileName())) {
+                startScan(directory, true);
+            }
+            continue;
+        }
+        toWatch.append(directory);
+    }
+    if (!toWatch.isEmpty()) {
+        m_watcher->addPaths(toWatch);
+    }
+
+    // Directory watches miss files rewritten in place, so watch the files too.
+    const QStringList watchedFiles = m_watcher->files();
+    QSet<QString> watchedFileSet(watchedFiles.cbegin(), watchedFiles.cend());
+    QStringList unwatch;
+    for (const QString& absolute : std::as_const(gone)) {
+        if (watchedFileSet.remove(absolute)) unwatch.append(absolute);
+    }
+    if (!unwatch.isEmpty()) {
+        m_watcher->removePaths(unwatch);
+    }
+    QStringList filesToWatch;
+    for (const QString& path : present) {
+        if (watchedFileSet.size() + filesToWatch.size() >= kMaxWatchedFiles) break;
+        const QString absolute = root.absoluteFilePath(path);
+        if (!watchedFileSet.contains(absolute)) filesToWatch.append(absolute);
+    }
+    if (!filesToWatch.isEmpty()) {
+        m_watcher->addPaths(filesToWatch);
+    }
+}
+
+void AlteProjectIndex::onDirectoryChanged(const QString& directoryPath) {
+    if (m_folder.isEmpty()) return;
+    if (!QFileInfo(directoryPath).isDir()) {
+        // Removed along with everything below it.
+        applyListing(m_generation.load(), directoryPath, true, QStringList(), QStringList());
+        m_watcher->removePath(directoryPath);
+        return;
+    }
+    // Lists the directory again and re-stats every file in it against the index,
+    // so edits that came with the change are picked up too.
+    startScan(directoryPath, false);
+}
+
+void AlteProjectIndex::refreshFile(const QString& filePath) {
+    if (m_folder.isEmpty()) return;
+    const QString absolute = QFileInfo(filePath).absoluteFilePath();
+    if (!absolute.startsWith(m_folder + QLatin1Char('/'))) return;
+    startScan(QFileInfo(absolute).absolutePath(), false);
+}
+
+void AlteProjectIndex::addWords(const QStringList& words) {
+    for (const QString& word : words) {
+        ++m_words[word];
+    }
+}
+
+void AlteProjectIndex::removeWords(const QStringList& words) {
+    for (const QString& word : words) {
+        const auto it = m_words.find(word);
+        if (it != m_words.end() && --it.value() <= 0) {
+            m_words.erase(it);
+        }
+    }
+}
+
+QStringList AlteProjectIndex::complete(const QString& prefix, int limit) const {
+    if (prefix.isEmpty() || limit <= 0) return {};
+    QVector<QMap<QString, int>::const_iterator> candidates;
+    int scanned = 0;
+    for (auto it = m_words.lowerBound(prefix);
+         it != m_words.constEnd() && scanned < kMaxScannedCandidates && it.key().startsWith(prefix); ++it, ++scanned) {
+        if (it.key().length() > prefix.length()) {
+            candidates.append(it);
+        }
+    }
+    const auto ranked = [](const QMap<QString, int>::const_iterator& a, const QMap<QString, int>::const_iterator& b) {
+        if (a.value() != b.value()) return a.value() > b.value();
+        if (a.key().length() != b.key().length()) return a.key().length() < b.key().length();
+        return a.key() < b.key();
+    };
+    const qsizetype shown = qMin(qsizetype(limit), candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + shown, candidates.end(), ranked);
+
+    QStringList result;
+    result.reserve(shown);
+    for (qsizetype i = 0; i < shown; ++i) {
+        result.append(candidates[i].key());
+    }
+    return result;
+}
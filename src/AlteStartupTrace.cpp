@@ -0,0 +1,45 @@
+#include "AlteStartupTrace.h"
+#include <QElapsedTimer>
+#include <QVector>
+#include <cstdio>
+
+namespace {
+struct Phase {
+    const char* name;
+    qint64 endNs; // Since start()
+};
+
+QElapsedTimer s_clock;
+QVector<Phase> s_phases;
+bool s_enabled = false;
+bool s_reported = false;
+}
+
+void AlteStartupTrace::start() {
+    s_clock.start();
+}
+
+void AlteStartupTrace::setEnabled(bool enabled) {
+    s_enabled = enabled;
+}
+
+bool AlteStartupTrace::isEnabled() {
+    return s_enabled;
+}
+
+void AlteStartupTrace::mark(const char* phase) {
+    if (!s_enabled || s_reported) return;
+    s_phases.append({phase, s_clock.nsecsElapsed()});
+}
+
+void AlteStartupTrace::report() {
+    if (!s_enabled || s_reported) return;
+    s_reported = true;
+    fprintf(stderr, "Startup trace (ms)          phase    total\n");
+    qint64 previous = 0;
+    for (const Phase& phase : s_phases) {
+        fprintf(stderr, "  %-24s %7.1f  %7.1f\n", phase.name, (phase.endNs - previous) / 1e6, phase.endNs / 1e6);
+        previous = phase.endNs;
+    }
+    fflush(stderr);
+}
@@ -0,0 +1,259 @@
+#include "AlteStructureIndex.h"
+#include <climits>
+
+// Summary of a run of lines; combining two runs is what keeps searches O(log n).
+struct AlteStructureSpan {
+    qint32 sum = 0;
+    qint32 minPrefix = 0;
+    qint32 maxSuffix = 0;
+    qint32 minIndent = INT_MAX;
+};
+
+namespace {
+const int kTabWidth = 4;
+
+using Span = AlteStructureSpan;
+
+Span spanOf(const AlteLineShape& shape) {
+    return {shape.delta, shape.minPrefix, shape.maxSuffix, shape.indent < 0 ? INT_MAX : shape.indent};
+}
+
+Span combine(const Span& first, const Span& rest) {
+    Span span;
+    span.sum = first.sum + rest.sum;
+    span.minPrefix = qMin(first.minPrefix, first.sum + rest.minPrefix);
+    span.maxSuffix = qMax(rest.maxSuffix, rest.sum + first.maxSuffix);
+    span.minIndent = qMin(first.minIndent, rest.minIndent);
+    return span;
+}
+}
+
+struct AlteStructureIndex::Node {
+    Node* left = nullptr;
+    Node* right = nullptr;
+    quint32 priority = 0;
+    int size = 1;
+    AlteLineShape shape;
+    Span span; // Of the whole subtree, lines in order
+};
+
+AlteStructureIndex::AlteStructureIndex()
+    : m_root(nullptr), m_seed(0x9E3779B9u) {
+}
+
+AlteStructureIndex::~AlteStructureIndex() {
+    destroy(m_root);
+}
+
+int AlteStructureIndex::lineCount() const {
+    return m_root ? m_root->size : 0;
+}
+
+void AlteStructureIndex::clear() {
+    destroy(m_root);
+    m_root = nullptr;
+}
+
+AlteStructureIndex::Node* AlteStructureIndex::newNode(const AlteLineShape& shape) {
+    // xorshift32; the priorities only need to be well spread.
+    m_seed ^= m_seed << 13;
+    m_seed ^= m_seed >> 17;
+    m_seed ^= m_seed << 5;
+    Node* node = new Node;
+    node->priority = m_seed;
+    node->shape = shape;
+    node->span = spanOf(shape);
+    return node;
+}
+
+void AlteStructureIndex::update(Node* node) {
+    Span span = spanOf(node->shape);
+    node->size = 1;
+    if (node->left) {
+        span = combine(node->left->span, span);
+        node->size += node->left->size;
+    }
+    if (node->right) {
+        span = combine(span, node->right->span);
+        node->size += node->right->size;
+    }
+    node->span = span;
+}
+
+void AlteStructureIndex::split(Node* node, int count, Node*& first, Node*& rest) {
+    if (!node) {
+        first = rest = nullptr;
+        return;
+    }
+    const int leftSize = node->left ? node->left->size : 0;
+    if (count <= leftSize) {
+        split(node->left, count, first, node->left);
+        rest = node;
+    } else {
+        split(node->right, count - leftSize - 1, node->right, rest);
+        first = node;
+    }
+    update(node);
+}
+
+AlteStructureIndex::Node* AlteStructureIndex::merge(Node* first, Node* rest) {
+    if (!first) return rest;
+    if (!rest) return first;
+    if (first->priority > rest->priority) {
+        first->right = merge(first->right, rest);
+        update(first);
+        return first;
+    }
+    rest->left = merge(first, rest->left);
+    update(rest);
+    return rest;
+}
+
+void AlteStructureIndex::destroy(Node* node) {
+    if (!node) return;
+    destroy(node->left);
+    destroy(node->right);
+    delete node;
+}
+
+void AlteStructureIndex::replaceLines(int first, int removed, const QVector<AlteLineShape>& shapes) {
+    Node* before = nullptr;
+    Node* rest = nullptr;
+    Node* replaced = nullptr;
+    Node* after = nullptr;
+    split(m_root, first, before, rest);
+    split(rest, removed, replaced, after);
+    destroy(replaced);
+    for (const AlteLineShape& shape : shapes) {
+        before = merge(before, newNode(shape));
+    }
+    m_root = merge(before, after);
+}
+
+void AlteStructureIndex::setLine(int line, const AlteLineShape& shape) {
+    if (line < 0 || line >= lineCount()) return;
+    setLine(m_root, line, shape);
+}
+
+void AlteStructureIndex::setLine(Node* node, int line, const AlteLineShape& shape) {
+    const int leftSize = node->left ? node->left->size : 0;
+    if (line < leftSize) {
+        setLine(node->left, line, shape);
+    } else if (line > leftSize) {
+        setLine(node->right, line - leftSize - 1, shape);
+    } else {
+        node->shape = shape;
+    }
+    update(node);
+}
+
+int AlteStructureIndex::findClosingLine(int from, int& depth) const {
+    return findClosing(m_root, 0, from, depth);
+}
+
+int AlteStructureIndex::findClosing(const Node* node, int offset, int from, int& depth) {
+    if (!node || offset + node->size <= from) return -1;
+    if (offset >= from && depth + node->span.minPrefix > 0) {
+        // Nothing in this subtree closes the bracket; skip it as a whole.
+        depth += node->span.sum;
+        return -1;
+    }
+    const int result = findClosing(node->left, offset, from, depth);
+    if (result >= 0) return result;
+    const int self = offset + (node->left ? node->left->size : 0);
+    if (self >= from) {
+        if (depth + node->shape.minPrefix <= 0) return self;
+        depth += node->shape.delta;
+    }
+    return findClosing(node->right, self + 1, from, depth);
+}
+
+int AlteStructureIndex::findOpeningLine(int to, int& depth) const {
+    return findOpening(m_root, 0, to, depth);
+}
+
+int AlteStructureIndex::findOpening(const Node* node, int offset, int to, int& depth) {
+    if (!node || offset > to) return -1;
+    if (offset + node->size - 1 <= to && depth - node->span.maxSuffix > 0) {
+        depth -= node->span.sum;
+        return -1;
+    }
+    const int self = offset + (node->left ? node->left->size : 0);
+    const int result = findOpening(node->right, self + 1, to, depth);
+    if (result >= 0) return result;
+    if (self <= to) {
+        if (depth - node->shape.maxSuffix <= 0) return self;
+        depth -= node->shape.delta;
+    }
+    return findOpening(node->left, offset, to, depth);
+}
+
+int AlteStructureIndex::findDedentLine(int from, int indent) const {
+    return findDedent(m_root, 0, from, indent);
+}
+
+int AlteStructureIndex::findDedent(const Node* node, int offset, int from, int indent) {
+    if (!node || offset + node->size <= from || node->span.minIndent > indent) return -1;
+    const int result = findDedent(node->left, offset, from, indent);
+    if (result >= 0) return result;
+    const int self = offset + (node->left ? node->left->size : 0);
+    if (self >= from && node->shape.indent >= 0 && node->shape.indent <= indent) return self;
+    return findDedent(node->right, self + 1, from, indent);
+}
+
+QChar AlteStructureIndex::counterpart(QChar bracket) {
+    switch (bracket.unicode()) {
+    case '(': return QLatin1Char(')');
+    case ')': return QLatin1Char('(');
+    case '[': return QLatin1Char(']');
+    case ']': return QLatin1Char('[');
+    case '{': return QLatin1Char('}');
+    case '}': return QLatin1Char('{');
+    default: return QChar();
+    }
+}
+
+void AlteStructureIndex::scanBrackets(const QString& text, std::span<const AlteToken> tokens, const AlteGrammar* grammar,
+                                      QVector<Bracket>& brackets) {
+    brackets.clear();
+    auto token = tokens.begin();
+    for (int i = 0; i < text.length(); ++i) {
+        const ushort c = text.at(i).unicode();
+        const bool opening = c == '(' || c == '[' || c == '{';
+        if (!opening && c != ')' && c != ']' && c != '}') continue;
+        if (grammar) {
+            while (token != tokens.end() && int(token->start + token->length) <= i) {
+                ++token;
+            }
+            if (token != tokens.end() && int(token->start) <= i && grammar->isOpaqueStyle(token->style)) {
+                continue; // Inside a comment or string
+            }
+        }
+        brackets.append({i, text.at(i), opening});
+    }
+}
+
+AlteLineShape AlteStructureIndex::shapeOf(const QString& text, const QVector<Bracket>& brackets) {
+    AlteLineShape shape;
+    int depth = 0;
+    for (const Bracket& bracket : brackets) {
+        depth += bracket.opening ? 1 : -1;
+        shape.minPrefix = qMin(shape.minPrefix, depth);
+    }
+    shape.delta = depth;
+    // Highest suffix sum = total minus the lowest prefix sum.
+    shape.maxSuffix = depth - shape.minPrefix;
+
+    int width = 0;
+    for (const QChar c : text) {
+        if (c == QLatin1Char(' ')) {
+            ++width;
+        } else if (c == QLatin1Char('\t')) {
+            width += kTabWidth - width % kTabWidth;
+        } else {
+            shape.indent = width;
+            break;
+        }
+    }
+    return shape;
+}
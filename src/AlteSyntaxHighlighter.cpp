@@ -1,295 +1,739 @@
 #include "AlteSyntaxHighlighter.h"
 #include "AlteThemeManager.h"
+#include "AlteTrace.h"
+#include "AlteLog.h"
+#include "AlteLongLineLayout.h"
 #include <QTextDocument>
-#include <QJsonArray>
+#include <QTextBlock>
+#include <QTextEdit>
+#include <QScrollBar>
+#include <QThread>
+#include <QTimer>
+#include <QEvent>
 #include <QDebug>
+#include <algorithm>
+#include <climits>
+
+namespace {
+// Documents up to this size are still rehighlighted in one go on a language change.
+const int kSynchronousBlockLimit = 5000;
+// Time one synchronous highlighting pass may spend tokenizing before the rest of
+// the document is left to the background tokenizer.
+const qint64 kSynchronousBudgetMs = 30;
+// Delay before a snapshot is retaken after edits interrupted a background run.
+const int kRestartDelayMs = 250;
+// Blocks above and below the viewport that are highlighted together with it.
+const int kViewportMargin = 50;
+// Time one idle-time backfill slice may take before yielding to the event loop.
+const qint64 kBackfillSliceMs = 4;
+// Lines longer than this are highlighted in long-line mode by default.
+const int kDefaultLongLineThreshold = 20000;
+// Characters before and after the visible part of a long line that are
+// highlighted with it, so short scrolls do not re-format the block.
+const int kLongLineMargin = 16384;
+// Delay before identifier counts are corrected after lines were deleted.
+const int kIdentifierRecountDelayMs = 1000;
+}
 
 AlteSyntaxHighlighter::AlteSyntaxHighlighter(QTextDocument *parent, AlteThemeManager *themeManager, const QString& languageName)
-    : QSyntaxHighlighter(parent) {
+    : QSyntaxHighlighter(parent), m_formatEpoch(0), m_generation(0), m_version(0), m_lastRevision(-1), m_jobVersion(0),
+      m_jobInFlight(false), m_deferredBlocks(false), m_workerThread(nullptr), m_worker(nullptr),
+      m_stateWatermark(-1), m_backfillDown(0), m_backfillUp(-1), m_scrollDirection(1), m_lastScrollValue(0),
+      m_longLineThreshold(kDefaultLongLineThreshold), m_longLineFocusBlock(-1), m_longLineFocusFrom(0),
+      m_longLineFocusTo(0), m_structurePendingFrom(INT_MAX), m_structurePendingTo(-1) {
+    qRegisterMetaType<QVector<AlteLineTokens>>();
+
+    m_backfillTimer = new QTimer(this);
+    m_backfillTimer->setSingleShot(true);
+    m_backfillTimer->setInterval(0);
+    connect(m_backfillTimer, &QTimer::timeout, this, &AlteSyntaxHighlighter::backfillSlice);
+
+    m_identifierRecountTimer = new QTimer(this);
+    m_identifierRecountTimer->setSingleShot(true);
+    m_identifierRecountTimer->setInterval(kIdentifierRecountDelayMs);
+    connect(m_identifierRecountTimer, &QTimer::timeout, this, [this]() {
+        m_identifiers.recount(document());
+        m_store.collectGarbage(document());
+    });
+
+    m_restartTimer = new QTimer(this);
+    m_restartTimer->setSingleShot(true);
+    m_restartTimer->setInterval(kRestartDelayMs);
+    connect(m_restartTimer, &QTimer::timeout, this, &AlteSyntaxHighlighter::startBackgroundTokenize);
+    if (parent) {
+        m_lastRevision = parent->revision();
+        connect(parent, &QTextDocument::contentsChange, this, &AlteSyntaxHighlighter::onContentsChange);
+        rebuildStructure(parent);
+    }
+
     if (themeManager && !languageName.isEmpty()) {
         setCurrentLanguage(languageName, themeManager);
-    } else {
-        qWarning() << "SyntaxHighlighter: ThemeManager or languageName not provided. No rules loaded.";
+    } else if (!themeManager) {
+        qCWarning(lcGrammar) << "SyntaxHighlighter: ThemeManager not provided. No rules loaded.";
+    }
+}
+
+AlteSyntaxHighlighter::~AlteSyntaxHighlighter() {
+    if (m_workerThread) {
+        // Make a running job stop at its next batch instead of finishing the document.
+        m_worker->setLatestVersion(++m_version);
+        m_workerThread->quit();
+        m_workerThread->wait();
     }
 }
 
 void AlteSyntaxHighlighter::setCurrentLanguage(const QString& languageName, AlteThemeManager *themeManager) {
-    m_highlightingRules.clear();
-    if (!themeManager) {
-        qWarning() << "AlteSyntaxHighlighter::setCurrentLanguage: ThemeManager is null.";
-        rehighlight();
-        return;
+    ALTE_TRACE_ZONE("highlight", "setCurrentLanguage");
+    const QFont documentFont = document() ? document()->defaultFont() : QApplication::font();
+    m_grammar = AlteGrammar::load(languageName, themeManager);
+    m_formats = themeManager ? m_grammar->formats(*themeManager->theme(), documentFont) : QVector<QTextCharFormat>();
+    ++m_formatEpoch;
+    m_identifiers.setKeywords(themeManager ? themeManager->getKeywordsForLanguage(languageName) : QStringList());
+    ++m_generation;
+    ++m_version;
+    if (m_worker) {
+        m_worker->setLatestVersion(m_version);
     }
-    if (languageName.isEmpty()){
-        qWarning() << "AlteSyntaxHighlighter::setCurrentLanguage: languageName is empty.";
+    if (!document()) return;
+
+    m_stateWatermark = -1;
+    const bool largeDocument = document()->blockCount() > kSynchronousBlockLimit;
+    if (m_editor && m_editor->isVisible() && m_editor->document() == document()) {
+        // Highlight what is on screen right away so the next frame is already
+        // correct; the rest of the document follows in idle-time slices.
+        highlightViewport();
+        if (largeDocument) {
+            startBackgroundTokenize();
+        }
+    } else if (!largeDocument) {
         rehighlight();
-        return;
+    } else {
+        startBackgroundTokenize();
+        m_backfillDown = 0;
+        m_backfillUp = -1;
+        m_backfillTimer->start();
     }
-    loadRulesForLanguage(languageName, themeManager);
-    rehighlight();
 }
 
-QTextCharFormat AlteSyntaxHighlighter::createFormatFromRule(const QJsonObject& ruleDetails,
-                                                      const QJsonObject& themeColors,
-                                                      const QFont& defaultFont,
-                                                      AlteThemeManager* themeManager) {
-    QTextCharFormat format;
-    QString style_key = ruleDetails.value("style_key").toString();
-    QString colorNameRef = ruleDetails.value("color_ref").toString();
-    QColor finalColor;
-    bool colorSet = false;
+void AlteSyntaxHighlighter::applyTheme(AlteThemeManager *themeManager) {
+    ALTE_TRACE_ZONE("theme", "applyFormats");
+    if (!themeManager || !m_grammar) return;
+    const QFont documentFont = document() ? document()->defaultFont() : QApplication::font();
+    m_formats = m_grammar->formats(*themeManager->theme(), documentFont);
+    ++m_formatEpoch;
+    if (!document()) return;
 
-    if (!colorNameRef.isEmpty()) {
-        finalColor = themeManager->getColor(colorNameRef);
-        if (finalColor.isValid()) {
-            colorSet = true;
-        } else {
-            qWarning() << "AlteSyntaxHighlighter: Color reference '" << colorNameRef << "' is invalid or not found in theme colors.";
+    if (m_editor && m_editor->document() == document()) {
+        // A hidden editor catches up when it is shown, see eventFilter().
+        if (m_editor->isVisible()) {
+            highlightViewport();
         }
+    } else if (document()->blockCount() <= kSynchronousBlockLimit) {
+        rehighlight();
     }
+}
 
-    if (!colorSet && !style_key.isEmpty()) {
-        finalColor = themeManager->getSyntaxColor(style_key);
-        if (finalColor.isValid()) {
-            colorSet = true;
-        } else {
-            qWarning() << "AlteSyntaxHighlighter: Style key '" << style_key << "' did not yield a valid color.";
-        }
+bool AlteSyntaxHighlighter::eventFilter(QObject *watched, QEvent *event) {
+    if (watched == m_editor && event->type() == QEvent::Show) {
+        // Blocks formatted with an earlier theme, e.g. while the tab was in the background.
+        highlightViewport();
     }
+    return QSyntaxHighlighter::eventFilter(watched, event);
+}
 
-    if (colorSet) {
-        format.setForeground(finalColor);
-    } else {
-        // Fallback to default text color
-        qWarning() << "AlteSyntaxHighlighter: No valid color found via color_ref or style_key for rule. Using default text color.";
-        format.setForeground(themeManager->getColor("text", Qt::black)); // Ensure a default if "text" isn't found
+void AlteSyntaxHighlighter::attachEditor(QTextEdit *editor) {
+    if (m_editor) {
+        disconnect(m_editor->verticalScrollBar(), nullptr, this, nullptr);
+        disconnect(m_editor->horizontalScrollBar(), nullptr, this, nullptr);
+        m_editor->removeEventFilter(this);
     }
+    m_editor = editor;
+    if (!editor) return;
+    editor->installEventFilter(this);
+    m_lastScrollValue = editor->verticalScrollBar()->value();
+    connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &AlteSyntaxHighlighter::highlightViewport);
+    connect(editor->verticalScrollBar(), &QScrollBar::rangeChanged, this, &AlteSyntaxHighlighter::highlightViewport);
+    // Unwrapped long lines scroll sideways out of their highlighted window.
+    connect(editor->horizontalScrollBar(), &QScrollBar::valueChanged, this, &AlteSyntaxHighlighter::highlightViewport);
+}
 
-    if (ruleDetails.value("bold").toBool(false)) {
-        format.setFontWeight(QFont::Bold);
+bool AlteSyntaxHighlighter::withinSynchronousBudget() {
+    if (!m_passTimer.isValid()) {
+        // A pass lasts until control returns to the event loop.
+        m_passTimer.start();
+        QTimer::singleShot(0, this, [this]() {
+            m_passTimer.invalidate();
+            if (m_deferredBlocks) {
+                m_deferredBlocks = false;
+                startBackgroundTokenize();
+                highlightViewport();
+            }
+        });
     }
-    if (ruleDetails.value("italic").toBool(false)) {
-        format.setFontItalic(true);
+    return m_passTimer.elapsed() < kSynchronousBudgetMs;
+}
+
+void AlteSyntaxHighlighter::setLongLineThreshold(int length) {
+    m_longLineThreshold = qMax(1, length);
+    if (m_worker) {
+        m_worker->setLongLineThreshold(m_longLineThreshold);
     }
+}
 
-    if (ruleDetails.contains("fontPointSizeOffset")) {
-        int offset = ruleDetails.value("fontPointSizeOffset").toInt(0);
-        if (offset != 0) {
-            QFont currentFont = format.font();
-            if (currentFont.pointSize() <= 0) {
-                 currentFont = defaultFont;
-            }
-            int newSize = currentFont.pointSize() + offset;
-            if (newSize > 0) {
-                currentFont.setPointSize(newSize);
-                format.setFont(currentFont); // Apply the font with new size
-            } else {
-                qWarning() << "AlteSyntaxHighlighter: Calculated font point size is not positive (" << newSize << "). Ignoring offset.";
+void AlteSyntaxHighlighter::highlightBlock(const QString &text) {
+    ALTE_TRACE_ZONE("highlight", "highlightBlock");
+    if (!m_grammar || m_grammar->isEmpty()) return;
+    if (text.length() > m_longLineThreshold) {
+        highlightLongLine(text);
+        return;
+    }
+
+    const int entryState = qMax(0, previousBlockState());
+    const uint textHash = qHash(text);
+    AlteLineRecord* line = AlteTokenStore::record(currentBlock());
+    const bool cached = line && line->generation == m_generation
+                        && line->textHash == textHash && line->entryState == entryState;
+    if (!cached) {
+        if (!withinSynchronousBudget()) {
+            // Leave the block to the background tokenizer and the backfill.
+            m_deferredBlocks = true;
+            if (line) {
+                line->generation = 0;
+                line->formatEpoch = 0;
             }
+            return;
         }
+        const int exitState = m_grammar->tokenizeLine(text, entryState, m_scratchTokens);
+        line = m_store.setLine(currentBlock(), m_scratchTokens, textHash, entryState, exitState, m_generation);
+        updateStructure(currentBlock());
+        indexIdentifiers(currentBlock(), text);
     }
-    return format;
+
+    applyFormats(line);
+    setCurrentBlockState(line->exitState);
 }
 
-void AlteSyntaxHighlighter::loadRulesForLanguage(const QString& languageName, AlteThemeManager *themeManager) {
-    qDebug() << ">>> loadRulesForLanguage V3 executing <<<";
-    qDebug() << "AlteSyntaxHighlighter::loadRulesForLanguage - Loading rules for language:" << languageName;
-    m_highlightingRules.clear();
-    QJsonObject langRules = themeManager->getSyntaxRulesForLanguage(languageName);
-    qDebug() << "AlteSyntaxHighlighter::loadRulesForLanguage - Received langRules from ThemeManager:" << langRules;
+void AlteSyntaxHighlighter::applyFormats(AlteLineRecord* line) {
+    for (const AlteToken& token : m_store.tokens(line)) {
+        if (token.style < m_formats.size()) {
+            setFormat(int(token.start), int(token.length), m_formats[token.style]);
+        }
+    }
+    line->formatEpoch = m_formatEpoch;
+}
 
-    if (langRules.isEmpty()) {
-        qWarning() << "AlteSyntaxHighlighter: No syntax rules found for language" << languageName << "(langRules object is empty).";
-        return;
+// Long-line mode: only a window around the part of the line that is on screen is
+// tokenized and formatted. The exit state comes from the multi-line rules alone
+// and is kept while only the window moves.
+void AlteSyntaxHighlighter::highlightLongLine(const QString &text) {
+    const int entryState = qMax(0, previousBlockState());
+    const uint textHash = qHash(text);
+    int needFrom = 0;
+    int needTo = qMin(int(text.length()), kLongLineMargin);
+    if (m_longLineFocusBlock == currentBlock().blockNumber()) {
+        needFrom = qBound(0, m_longLineFocusFrom, int(text.length()));
+        needTo = qBound(needFrom, m_longLineFocusTo, int(text.length()));
     }
 
-    QFont documentFont;
-    if (document()) {
-        documentFont = document()->defaultFont();
+    AlteLineRecord* line = AlteTokenStore::record(currentBlock());
+    const bool sameLine = line && line->generation == m_generation
+                          && line->textHash == textHash && line->entryState == entryState;
+    if (!sameLine || !line->windowed || int(line->windowStart) > needFrom || int(line->windowEnd) < needTo) {
+        if (!withinSynchronousBudget()) {
+            m_deferredBlocks = true;
+            if (line) {
+                line->generation = 0;
+                line->formatEpoch = 0;
+            }
+            return;
+        }
+        const int exitState = sameLine ? line->exitState : m_grammar->scanBlockState(text, entryState);
+        const int from = qMax(0, needFrom - kLongLineMargin);
+        const int to = qMin(int(text.length()), needTo + kLongLineMargin);
+        // A window in the middle of the line starts in the spans left open before
+        // it. Scrolling to the right only scans from the previous window on.
+        int scanFrom = 0;
+        int windowEntryState = entryState;
+        if (sameLine && line->windowed && int(line->windowStart) <= from) {
+            scanFrom = int(line->windowStart);
+            windowEntryState = line->windowEntryState;
+        }
+        if (from > scanFrom) {
+            windowEntryState = m_grammar->scanBlockState(text.mid(scanFrom, from - scanFrom), windowEntryState);
+        }
+        m_grammar->tokenizeLine(text.mid(from, to - from), windowEntryState, m_scratchTokens);
+        for (AlteToken& token : m_scratchTokens) {
+            token.start += quint32(from);
+        }
+        line = m_store.setLine(currentBlock(), m_scratchTokens, textHash, entryState, exitState, m_generation);
+        line->windowed = true;
+        line->windowStart = quint32(from);
+        line->windowEnd = quint32(to);
+        line->windowEntryState = windowEntryState;
+        updateStructure(currentBlock());
+        indexIdentifiers(currentBlock(), text);
+    }
+
+    applyFormats(line);
+    setCurrentBlockState(line->exitState);
+}
+
+// Records which part of a long block is on screen. Returns true if its stored
+// window does not cover that part, i.e. the block has to be highlighted again.
+bool AlteSyntaxHighlighter::updateLongLineFocus(const QTextBlock& block) {
+    m_longLineFocusBlock = block.blockNumber();
+    if (qobject_cast<AlteLongLineLayout*>(document()->documentLayout())) {
+        // Unwrapped: the block is one row and the visible part is the columns on screen.
+        const int y = int(document()->documentLayout()->blockBoundingRect(block).center().y())
+                      - m_editor->verticalScrollBar()->value();
+        m_longLineFocusFrom = m_editor->cursorForPosition(QPoint(0, y)).positionInBlock();
+        m_longLineFocusTo = m_editor->cursorForPosition(QPoint(m_editor->viewport()->width(), y)).positionInBlock();
     } else {
-        documentFont = QApplication::font();
-        qWarning() << "AlteSyntaxHighlighter: QTextDocument is null during rule loading. Using application default font.";
+        const QTextCursor top = m_editor->cursorForPosition(QPoint(0, 0));
+        const QTextCursor bottom = m_editor->cursorForPosition(QPoint(m_editor->viewport()->width(),
+                                                                      m_editor->viewport()->height()));
+        m_longLineFocusFrom = top.block() == block ? top.positionInBlock() : 0;
+        m_longLineFocusTo = bottom.block() == block ? bottom.positionInBlock() : block.length() - 1;
     }
 
-    QJsonObject dummyColors;
+    const AlteLineRecord* line = AlteTokenStore::record(block);
+    return !line || !line->windowed || int(line->windowStart) > m_longLineFocusFrom
+           || int(line->windowEnd) < m_longLineFocusTo;
+}
+
+std::span<const AlteToken> AlteSyntaxHighlighter::blockTokens(const QTextBlock& block) const {
+    const AlteLineRecord* line = AlteTokenStore::record(block);
+    if (!line || line->generation != m_generation) return {};
+    return m_store.tokens(line);
+}
+
+QTextCharFormat AlteSyntaxHighlighter::styleFormat(quint16 style) const {
+    return style < m_formats.size() ? m_formats[style] : QTextCharFormat();
+}
+
+void AlteSyntaxHighlighter::releaseTokens() {
+    m_identifiers.clear(document());
+    m_store.clear(document());
+    m_stateWatermark = -1;
+}
 
-    if (!langRules.contains("highlighting_rules") || !langRules.value("highlighting_rules").isArray()) {
-        qWarning() << "AlteSyntaxHighlighter: 'highlighting_rules' array not found or not an array for language" << languageName << "Def:" << langRules;
+AlteLineShape AlteSyntaxHighlighter::lineShape(const QTextBlock& block) const {
+    const QString text = block.text();
+    if (text.length() > m_longLineThreshold) {
+        // Brackets of long lines are not tracked; scanning them on every edit
+        // would undo long-line mode.
+        return AlteStructureIndex::shapeOf(text, {});
+    }
+    AlteStructureIndex::scanBrackets(text, blockTokens(block), m_grammar.data(), m_scratchBrackets);
+    return AlteStructureIndex::shapeOf(text, m_scratchBrackets);
+}
+
+void AlteSyntaxHighlighter::updateStructure(const QTextBlock& block) {
+    if (block.document()->revision() != m_lastRevision) {
+        // contentsChange has not reached us yet and the index still has the old
+        // line numbering; the line is updated once it has.
+        m_structurePendingFrom = qMin(m_structurePendingFrom, block.blockNumber());
+        m_structurePendingTo = qMax(m_structurePendingTo, block.blockNumber());
         return;
     }
-    QJsonArray rulesArray = langRules.value("highlighting_rules").toArray();
+    m_structure.setLine(block.blockNumber(), lineShape(block));
+}
 
-    for (const QJsonValue& ruleValue : rulesArray) {
-        QJsonObject ruleDef = ruleValue.toObject();
-        QString ruleName = ruleDef.value("name").toString("Unnamed Rule");
+void AlteSyntaxHighlighter::indexIdentifiers(const QTextBlock& block, const QString& text) {
+    // Words of long lines are not indexed, like their brackets.
+    m_identifiers.updateLine(block, text.length() > m_longLineThreshold ? QString() : text, blockTokens(block),
+                             m_grammar.data());
+}
 
-        HighlightingRule baseRuleSetup;
-        baseRuleSetup.format = createFormatFromRule(ruleDef, dummyColors, documentFont, themeManager);
-        baseRuleSetup.isBlockRule = false;
+void AlteSyntaxHighlighter::rebuildStructure(QTextDocument* doc) {
+    QVector<AlteLineShape> shapes;
+    shapes.reserve(doc->blockCount());
+    for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+        shapes.append(lineShape(block));
+    }
+    m_structure.clear();
+    m_structure.replaceLines(0, 0, shapes);
+}
 
-        QString ruleType = ruleDef.value("type").toString();
+int AlteSyntaxHighlighter::matchingBracket(int position) const {
+    if (!document() || m_structure.lineCount() != document()->blockCount()) return -1;
+    const QTextBlock block = document()->findBlock(position);
+    if (!block.isValid() || block.length() - 1 > m_longLineThreshold) return -1;
 
-        if (ruleType.isEmpty()) {
-            qWarning() << "AlteSyntaxHighlighter: Rule" << ruleName << "is missing 'type' field. Def:" << ruleDef;
-            continue;
+    QVector<AlteStructureIndex::Bracket> brackets;
+    AlteStructureIndex::scanBrackets(block.text(), blockTokens(block), m_grammar.data(), brackets);
+    const int column = position - block.position();
+    const int self = int(std::find_if(brackets.cbegin(), brackets.cend(), [column](const AlteStructureIndex::Bracket& bracket) {
+        return bracket.position == column;
+    }) - brackets.cbegin());
+    if (self == brackets.size()) return -1;
+    const QChar wanted = AlteStructureIndex::counterpart(brackets[self].character);
+    const bool opening = brackets[self].opening;
+
+    // Same line first, then let the index find the line and scan only that one.
+    int depth = 0;
+    if (opening) {
+        for (int i = self; i < brackets.size(); ++i) {
+            depth += brackets[i].opening ? 1 : -1;
+            if (depth == 0) return brackets[i].character == wanted ? block.position() + brackets[i].position : -1;
+        }
+    } else {
+        for (int i = self; i >= 0; --i) {
+            depth += brackets[i].opening ? -1 : 1;
+            if (depth == 0) return brackets[i].character == wanted ? block.position() + brackets[i].position : -1;
         }
+    }
+    const int line = opening ? m_structure.findClosingLine(block.blockNumber() + 1, depth)
+                             : m_structure.findOpeningLine(block.blockNumber() - 1, depth);
+    if (line < 0) return -1;
 
-        if (ruleType == "keywords") {
-            if (!ruleDef.contains("list")) {
-                qWarning() << "AlteSyntaxHighlighter: 'keywords' rule" << ruleName << "is missing 'list' field. Def:" << ruleDef;
-                continue;
-            }
-            QJsonArray patternsArray = ruleDef.value("list").toArray();
-            for (const QJsonValue& val : patternsArray) {
-                HighlightingRule specificRule = baseRuleSetup;
-                QString patternString = "\\b" + QRegularExpression::escape(val.toString()) + "\\b";
-                specificRule.pattern = QRegularExpression(patternString);
-                if (specificRule.pattern.isValid()) {
-                    m_highlightingRules.append(specificRule);
-                } else {
-                    qWarning() << "AlteSyntaxHighlighter: Invalid regex from keyword in list" << val.toString() << "for rule" << ruleName;
-                }
-            }
-        } else if (ruleType == "line_comment") {
-            if (!ruleDef.contains("start_delimiter")) {
-                qWarning() << "AlteSyntaxHighlighter: 'line_comment' rule" << ruleName << "is missing 'start_delimiter' field. Def:" << ruleDef;
-                continue;
-            }
-            HighlightingRule specificRule = baseRuleSetup;
-            QString delimiter = ruleDef.value("start_delimiter").toString();
-            if (!delimiter.isEmpty()) {
-                specificRule.pattern = QRegularExpression(QRegularExpression::escape(delimiter) + ".*");
-                if (specificRule.pattern.isValid()) {
-                    m_highlightingRules.append(specificRule);
-                } else {
-                    qWarning() << "AlteSyntaxHighlighter: Invalid regex from line_comment rule" << ruleName << "for delimiter" << delimiter;
-                }
-            } else {
-                qWarning() << "AlteSyntaxHighlighter: Empty delimiter for line_comment rule" << ruleName;
-            }
-        } else if (ruleType == "multi_line_string") {
-            if (!ruleDef.contains("start_pattern")) {
-                qWarning() << "AlteSyntaxHighlighter: 'multi_line_string' rule" << ruleName << "is missing 'start_pattern' field. Def:" << ruleDef;
-                continue;
-            }
-            if (!ruleDef.contains("end_pattern")) {
-                qWarning() << "AlteSyntaxHighlighter: 'multi_line_string' rule" << ruleName << "is missing 'end_pattern' field. Def:" << ruleDef;
-                continue;
-            }
-            HighlightingRule blockRule = baseRuleSetup;
-            blockRule.isBlockRule = true;
-            blockRule.pattern = QRegularExpression(ruleDef.value("start_pattern").toString());
-            blockRule.endPattern = QRegularExpression(ruleDef.value("end_pattern").toString());
-            if (blockRule.pattern.isValid() && blockRule.endPattern.isValid()) {
-                m_highlightingRules.append(blockRule);
-            } else {
-                qWarning() << "AlteSyntaxHighlighter: Invalid regex for 'multi_line_string' rule" << ruleName
-                           << ": Start:" << ruleDef.value("start_pattern").toString()
-                           << "End:" << ruleDef.value("end_pattern").toString();
-            }
-        } else if (ruleType == "pattern") {
-            if (!ruleDef.contains("pattern")) {
-                qWarning() << "AlteSyntaxHighlighter: 'pattern' rule" << ruleName << "is missing 'pattern' field. Def:" << ruleDef;
-                continue;
-            }
-            HighlightingRule singlePatternRule = baseRuleSetup;
-            QString patternStr = ruleDef.value("pattern").toString();
-            if (patternStr.isEmpty()){
-                 qWarning() << "AlteSyntaxHighlighter: Empty pattern string for 'pattern' rule" << ruleName;
-                 continue;
-            }
-            singlePatternRule.pattern = QRegularExpression(patternStr);
-            if (singlePatternRule.pattern.isValid()) {
-                m_highlightingRules.append(singlePatternRule);
-            } else {
-                qWarning() << "AlteSyntaxHighlighter: Invalid regex for 'pattern' rule" << ruleName << ":" << patternStr;
-            }
-        } else if (ruleDef.contains("patterns")) { // Legacy path, if still needed
-            // This can be kept for backward compatibility or removed if all JSONs are updated.
-            // For now, let's assume it's similar to "keywords" with "list" but uses "patterns" key.
-            qWarning() << "AlteSyntaxHighlighter: Rule" << ruleName << "uses legacy 'patterns' key. Consider updating to 'list' under 'keywords' type.";
-            if (!ruleDef.contains("patterns")) { // Should not happen if previous 'contains' is true
-                 qWarning() << "AlteSyntaxHighlighter: 'patterns' rule" << ruleName << "is missing 'patterns' field. Def:" << ruleDef;
-                 continue;
-            }
-            QJsonArray patternsArray = ruleDef.value("patterns").toArray();
-            for (const QJsonValue& val : patternsArray) {
-                HighlightingRule specificRule = baseRuleSetup;
-                QString patternString = "\\b" + QRegularExpression::escape(val.toString()) + "\\b";
-                specificRule.pattern = QRegularExpression(patternString);
-                if (specificRule.pattern.isValid()) {
-                    m_highlightingRules.append(specificRule);
-                } else {
-                    qWarning() << "AlteSyntaxHighlighter: Invalid regex from legacy 'patterns' list" << val.toString() << "for rule" << ruleName;
-                }
+    const QTextBlock target = document()->findBlockByNumber(line);
+    AlteStructureIndex::scanBrackets(target.text(), blockTokens(target), m_grammar.data(), brackets);
+    if (opening) {
+        for (int i = 0; i < brackets.size(); ++i) {
+            depth += brackets[i].opening ? 1 : -1;
+            if (depth == 0) return brackets[i].character == wanted ? target.position() + brackets[i].position : -1;
+        }
+    } else {
+        for (int i = int(brackets.size()) - 1; i >= 0; --i) {
+            depth += brackets[i].opening ? -1 : 1;
+            if (depth == 0) return brackets[i].character == wanted ? target.position() + brackets[i].position : -1;
+        }
+    }
+    return -1;
+}
+
+int AlteSyntaxHighlighter::foldEnd(const QTextBlock& block) const {
+    if (!document() || !block.isValid() || m_structure.lineCount() != document()->blockCount()) return -1;
+    const int number = block.blockNumber();
+
+    int open = 0;
+    if (block.length() - 1 <= m_longLineThreshold) {
+        AlteStructureIndex::scanBrackets(block.text(), blockTokens(block), m_grammar.data(), m_scratchBrackets);
+        for (const AlteStructureIndex::Bracket& bracket : m_scratchBrackets) {
+            if (bracket.opening) {
+                ++open;
+            } else if (open > 0) {
+                --open;
             }
-        } else {
-            if (!ruleName.startsWith("_comment_")) {
-                 qWarning() << "AlteSyntaxHighlighter: Rule" << ruleName << "has unknown type'" << ruleType << "' or is malformed. Def:" << ruleDef;
+        }
+    }
+    if (open > 0) {
+        // The closing line stays visible.
+        const int line = m_structure.findClosingLine(number + 1, open);
+        return line - 1 > number ? line - 1 : -1;
+    }
+
+    const AlteLineShape shape = AlteStructureIndex::shapeOf(block.text(), {});
+    if (shape.indent < 0) return -1;
+    int end = m_structure.findDedentLine(number + 1, shape.indent);
+    if (end < 0) end = document()->blockCount();
+    // Blank lines before the next region stay visible.
+    int last = end - 1;
+    for (QTextBlock trailing = document()->findBlockByNumber(last);
+         last > number && trailing.text().trimmed().isEmpty(); trailing = trailing.previous()) {
+        --last;
+    }
+    return last > number ? last : -1;
+}
+
+bool AlteSyntaxHighlighter::fold(const QTextBlock& block) {
+    const int end = foldEnd(block);
+    if (end < 0) return false;
+    const QTextBlock first = block.next();
+    const QTextBlock last = document()->findBlockByNumber(end);
+    for (QTextBlock hidden = first; hidden.isValid() && hidden.blockNumber() <= end; hidden = hidden.next()) {
+        hidden.setVisible(false);
+    }
+    // The layout skips invisible blocks, so a folded region is never laid out.
+    document()->markContentsDirty(first.position(), last.position() + last.length() - first.position());
+    return true;
+}
+
+bool AlteSyntaxHighlighter::unfold(const QTextBlock& block) {
+    if (!document() || !block.isValid()) return false;
+    QTextBlock hidden = block.next();
+    if (!hidden.isValid() || hidden.isVisible()) return false;
+    const int from = hidden.position();
+    int to = from;
+    for (; hidden.isValid() && !hidden.isVisible(); hidden = hidden.next()) {
+        hidden.setVisible(true);
+        to = hidden.position() + hidden.length();
+    }
+    document()->markContentsDirty(from, to - from);
+    return true;
+}
+
+void AlteSyntaxHighlighter::unfoldAll() {
+    if (!document()) return;
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        if (!block.isVisible()) {
+            block.setVisible(true);
+        }
+    }
+    document()->markContentsDirty(0, document()->characterCount());
+}
+
+// Tokenizes a block into the store without touching its layout. Formats are
+// applied once the block is about to be shown.
+void AlteSyntaxHighlighter::tokenizeIntoStore(QTextBlock& block) {
+    const QTextBlock previous = block.previous();
+    const int entryState = previous.isValid() ? qMax(0, previous.userState()) : 0;
+    const QString text = block.text();
+    int exitState = 0;
+    if (text.length() > m_longLineThreshold) {
+        // Only the state; the window is tokenized once the line is shown.
+        m_scratchTokens.clear();
+        exitState = m_grammar->scanBlockState(text, entryState);
+    } else {
+        exitState = m_grammar->tokenizeLine(text, entryState, m_scratchTokens);
+    }
+    m_store.setLine(block, m_scratchTokens, qHash(text), entryState, exitState, m_generation);
+    block.setUserState(exitState);
+    updateStructure(block);
+    indexIdentifiers(block, text);
+}
+
+bool AlteSyntaxHighlighter::hasCurrentTokens(const QTextBlock& block) const {
+    const AlteLineRecord* line = AlteTokenStore::record(block);
+    if (!line || line->generation != m_generation) return false;
+    const QTextBlock previous = block.previous();
+    const int entryState = previous.isValid() ? qMax(0, previous.userState()) : 0;
+    return line->entryState == entryState;
+}
+
+void AlteSyntaxHighlighter::onContentsChange(int position, int charsRemoved, int charsAdded) {
+    QTextDocument* doc = qobject_cast<QTextDocument*>(sender());
+    if (!doc) return;
+    if (doc->revision() == m_lastRevision && charsRemoved == charsAdded) {
+        return; // Only formats changed
+    }
+    m_lastRevision = doc->revision();
+
+    // Replace the shapes of the lines the edit touched; the index still holds the
+    // old line count, so the difference tells how many lines it replaced.
+    const int firstLine = doc->findBlock(position).blockNumber();
+    const int lastLine = doc->findBlock(qMin(position + charsAdded, doc->characterCount() - 1)).blockNumber();
+    const int removed = lastLine - firstLine + 1 - (doc->blockCount() - m_structure.lineCount());
+    if (removed > lastLine - firstLine + 1) {
+        // Deleted blocks took their records along; their identifiers are still
+        // counted and their runs still take up the arena.
+        m_identifierRecountTimer->start();
+    }
+    if (firstLine < 0 || lastLine < firstLine || removed < 1 || firstLine + removed > m_structure.lineCount()) {
+        rebuildStructure(doc);
+    } else {
+        QVector<AlteLineShape> shapes;
+        shapes.reserve(lastLine - firstLine + 1);
+        for (QTextBlock block = doc->findBlockByNumber(firstLine); block.isValid() && block.blockNumber() <= lastLine;
+             block = block.next()) {
+            shapes.append(lineShape(block));
+        }
+        m_structure.replaceLines(firstLine, removed, shapes);
+        // Lines highlighted while the edit was applied, e.g. a block whose state changed.
+        for (int line = m_structurePendingFrom; line <= m_structurePendingTo; ++line) {
+            if (line < firstLine || line > lastLine) {
+                m_structure.setLine(line, lineShape(doc->findBlockByNumber(line)));
             }
         }
     }
+    m_structurePendingFrom = INT_MAX;
+    m_structurePendingTo = -1;
+
+    m_stateWatermark = qMin(m_stateWatermark, doc->findBlock(position).blockNumber() - 1);
+    ++m_version;
+    if (m_worker) {
+        m_worker->setLatestVersion(m_version);
+    }
+    if (m_jobInFlight) {
+        // The running snapshot is outdated; take a new one once typing settles.
+        m_restartTimer->start();
+    }
 }
 
-void AlteSyntaxHighlighter::highlightBlock(const QString &text) {
-    for (const HighlightingRule &rule : m_highlightingRules) {
-        if (rule.isBlockRule) continue;
+void AlteSyntaxHighlighter::ensureWorker() {
+    if (m_workerThread) return;
+    m_workerThread = new QThread(this);
+    m_worker = new AlteTokenizerWorker;
+    m_worker->moveToThread(m_workerThread);
+    m_worker->setLongLineThreshold(m_longLineThreshold);
+    connect(m_workerThread, &QThread::finished, m_worker, &QObject::deleteLater);
+    connect(m_worker, &AlteTokenizerWorker::linesTokenized, this, &AlteSyntaxHighlighter::onLinesTokenized);
+    connect(m_worker, &AlteTokenizerWorker::finished, this, &AlteSyntaxHighlighter::onTokenizeFinished);
+    m_workerThread->start(QThread::LowPriority);
+}
+
+void AlteSyntaxHighlighter::startBackgroundTokenize() {
+    if (!m_grammar || m_grammar->isEmpty() || !document()) return;
+    if (m_jobInFlight && m_jobVersion == m_version) return;
 
-        QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
-        while (matchIterator.hasNext()) {
-            QRegularExpressionMatch match = matchIterator.next();
-            setFormat(match.capturedStart(), match.capturedLength(), rule.format);
+    ensureWorker();
+    m_worker->setLatestVersion(m_version);
+    m_jobInFlight = true;
+    m_jobVersion = m_version;
+
+    AlteTokenizerWorker* worker = m_worker;
+    const quint64 version = m_version;
+    const QSharedPointer<const AlteGrammar> grammar = m_grammar;
+    const QString rawText = document()->toRawText();
+    const int blockCount = document()->blockCount();
+    QMetaObject::invokeMethod(worker, [worker, version, grammar, rawText, blockCount]() {
+        worker->tokenize(version, grammar, rawText, blockCount);
+    }, Qt::QueuedConnection);
+}
+
+void AlteSyntaxHighlighter::onLinesTokenized(quint64 version, int firstLine, const QVector<AlteLineTokens>& lines) {
+    ALTE_TRACE_ZONE("highlight", "applyTokens");
+    if (version != m_version || !document()) return;
+
+    if (firstLine <= m_stateWatermark + 1) {
+        m_stateWatermark = qMax(m_stateWatermark, firstLine + int(lines.size()) - 1);
+    }
+    QTextBlock block = document()->findBlockByNumber(firstLine);
+    for (const AlteLineTokens& line : lines) {
+        if (!block.isValid()) break;
+        const AlteLineRecord* record = AlteTokenStore::record(block);
+        const bool current = record && record->generation == m_generation
+                             && record->textHash == line.textHash && record->entryState == line.entryState;
+        if (!current) {
+            m_store.setLine(block, line.tokens, line.textHash, line.entryState, line.exitState, m_generation);
+            // Keep the block state chain right even for blocks that are not formatted yet.
+            block.setUserState(line.exitState);
+            updateStructure(block);
+            indexIdentifiers(block, block.text());
         }
+        block = block.next();
     }
 
-    int blockRuleIndex = previousBlockState();
-
-    if (blockRuleIndex > 0) {
-        int ruleIdx = blockRuleIndex - 1;
-        if (ruleIdx < m_highlightingRules.size() && m_highlightingRules[ruleIdx].isBlockRule) {
-            const HighlightingRule& currentBlockRule = m_highlightingRules[ruleIdx];
-            QRegularExpressionMatch endMatch = currentBlockRule.endPattern.match(text, 0);
-            int endIndex = endMatch.capturedStart();
-            int length;
-
-            if (endIndex == -1) {
-                setCurrentBlockState(blockRuleIndex);
-                length = text.length();
-                setFormat(0, length, currentBlockRule.format);
-                return;
-            } else {
-                length = endIndex + endMatch.capturedLength();
-                setFormat(0, length, currentBlockRule.format);
-                setCurrentBlockState(0);
+    // Recolour the visible blocks of this batch; the backfill picks up the rest.
+    if (m_editor && m_editor->document() == document()) {
+        const int firstVisible = m_editor->cursorForPosition(QPoint(0, 0)).blockNumber();
+        const int lastVisible = m_editor->cursorForPosition(QPoint(0, m_editor->viewport()->height())).blockNumber();
+        const int from = qMax(firstLine, firstVisible);
+        const int to = qMin(firstLine + int(lines.size()) - 1, lastVisible);
+        QTextBlock visible = document()->findBlockByNumber(from);
+        for (int number = from; visible.isValid() && number <= to; ++number, visible = visible.next()) {
+            if (needsHighlight(visible)) {
+                rehighlightBlock(visible);
             }
+        }
+    }
+    if (!m_backfillTimer->isActive()) {
+        m_backfillTimer->start();
+    }
+}
+
+void AlteSyntaxHighlighter::onTokenizeFinished(quint64 version) {
+    if (version == m_jobVersion) {
+        m_jobInFlight = false;
+    }
+}
+
+bool AlteSyntaxHighlighter::needsHighlight(const QTextBlock& block) const {
+    const AlteLineRecord* line = AlteTokenStore::record(block);
+    return !line || line->formatEpoch != m_formatEpoch || !hasCurrentTokens(block);
+}
+
+// Brings the stored block states up to date down to blockNumber, so any block
+// after it can be highlighted on its own. Only the multi-line rules are run.
+void AlteSyntaxHighlighter::ensureStatesUpTo(int blockNumber) {
+    if (blockNumber <= m_stateWatermark || !m_grammar || !document()) return;
+
+    QTextBlock block;
+    int state = 0;
+    if (m_stateWatermark >= 0) {
+        block = document()->findBlockByNumber(m_stateWatermark);
+        state = qMax(0, block.userState());
+        block = block.next();
+    } else {
+        block = document()->begin();
+    }
+    int number = m_stateWatermark + 1;
+    for (; block.isValid() && number <= blockNumber; ++number, block = block.next()) {
+        const QString text = block.text();
+        const AlteLineRecord* line = AlteTokenStore::record(block);
+        if (line && line->generation == m_generation && line->entryState == state
+            && line->textHash == qHash(text)) {
+            state = line->exitState;
         } else {
-             setCurrentBlockState(0);
+            state = m_grammar->scanBlockState(text, state);
         }
+        block.setUserState(state);
     }
+    m_stateWatermark = number - 1;
+}
 
-    for (int i = 0; i < m_highlightingRules.size(); ++i) {
-        const HighlightingRule &rule = m_highlightingRules[i];
-        if (!rule.isBlockRule) continue;
+void AlteSyntaxHighlighter::highlightViewport() {
+    ALTE_TRACE_ZONE("highlight", "highlightViewport");
+    if (!m_grammar || m_grammar->isEmpty() || !document()) return;
+    if (!m_editor || m_editor->document() != document()) return;
 
-        QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
-        while (matchIterator.hasNext()) {
-            QRegularExpressionMatch startMatch = matchIterator.next();
+    const int scrollValue = m_editor->verticalScrollBar()->value();
+    if (scrollValue != m_lastScrollValue) {
+        m_scrollDirection = scrollValue > m_lastScrollValue ? 1 : -1;
+        m_lastScrollValue = scrollValue;
+    }
 
-            if (currentBlockState() != 0 && startMatch.capturedStart() == 0) {
-                continue;
-            }
+    const int firstVisible = m_editor->cursorForPosition(QPoint(0, 0)).blockNumber();
+    const int lastVisible = m_editor->cursorForPosition(QPoint(0, m_editor->viewport()->height())).blockNumber();
+    const int first = qMax(0, firstVisible - kViewportMargin);
+    const int last = qMin(document()->blockCount() - 1, lastVisible + kViewportMargin);
 
+    AlteGrammar::ProfileBatch profileBatch(*m_grammar);
+    ensureStatesUpTo(first - 1);
+    QTextBlock block = document()->findBlockByNumber(first);
+    for (int number = first; block.isValid() && number <= last; ++number, block = block.next()) {
+        const bool visibleLongLine = number >= firstVisible && number <= lastVisible
+                                     && block.length() - 1 > m_longLineThreshold;
+        if ((visibleLongLine && updateLongLineFocus(block)) || needsHighlight(block)) {
+            rehighlightBlock(block);
+        }
+        if (number == m_stateWatermark + 1 && !needsHighlight(block)) {
+            m_stateWatermark = number;
+        }
+    }
 
-            QRegularExpressionMatch endMatch = rule.endPattern.match(text, startMatch.capturedEnd());
-            int length;
-            if (endMatch.capturedStart() == -1) {
-                setCurrentBlockState(i + 1);
-                length = text.length() - startMatch.capturedStart();
-                setFormat(startMatch.capturedStart(), length, rule.format);
-                return;
-            } else {
-                length = endMatch.capturedEnd() - startMatch.capturedStart();
-                setFormat(startMatch.capturedStart(), length, rule.format);
+    m_backfillDown = last + 1;
+    m_backfillUp = first - 1;
+    m_backfillTimer->start();
+}
+
+void AlteSyntaxHighlighter::backfillSlice() {
+    ALTE_TRACE_ZONE("highlight", "backfillSlice");
+    if (!m_grammar || m_grammar->isEmpty() || !document()) return;
+
+    QElapsedTimer slice;
+    slice.start();
+    // Continue ahead of the scroll direction first, then behind it.
+    for (int pass = 0; pass < 2; ++pass) {
+        const bool down = (pass == 0) == (m_scrollDirection > 0);
+        if (down) {
+            if (m_backfillDown >= document()->blockCount()) continue;
+            ensureStatesUpTo(m_backfillDown - 1);
+            for (QTextBlock block = document()->findBlockByNumber(m_backfillDown); block.isValid(); block = block.next()) {
+                if (slice.elapsed() >= kBackfillSliceMs) {
+                    m_backfillTimer->start();
+                    return;
+                }
+                if (!hasCurrentTokens(block)) {
+                    tokenizeIntoStore(block);
+                }
+                if (m_backfillDown == m_stateWatermark + 1) {
+                    m_stateWatermark = m_backfillDown;
+                }
+                ++m_backfillDown;
+            }
+        } else {
+            if (m_backfillUp < 0) continue;
+            for (QTextBlock block = document()->findBlockByNumber(m_backfillUp); block.isValid(); block = block.previous()) {
+                if (slice.elapsed() >= kBackfillSliceMs) {
+                    m_backfillTimer->start();
+                    return;
+                }
+                if (!hasCurrentTokens(block)) {
+                    tokenizeIntoStore(block);
+                }
+                --m_backfillUp;
             }
         }
     }
@@ -1,92 +1,188 @@
 #include "AlteTheme.h"
-#include <QFile>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
+#include "AlteLog.h"
+#include <QHash>
+#include <QReadLocker>
+#include <QReadWriteLock>
+#include <QWriteLocker>
 #include <QDebug>
-#include <QCoreApplication>
-#include <QDir>
-
-AlteTheme::AlteTheme() {
-    QTextCharFormat defaultFormat;
-    defaultFormat.setForeground(Qt::black);
-    syntaxFormats.insert("default", defaultFormat);
-    editorColors.insert("text", Qt::black);
-    editorColors.insert("background", Qt::white);
-}
-
-bool AlteTheme::loadThemeFromFile(const QString &filePath) {
-    QFile file(filePath);
-    if (!file.exists()) {
-        qWarning() << "Theme file does not exist:" << filePath;
-        return false;
-    }
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Could not open theme file:" << filePath;
-        return false;
-    }
 
-    QByteArray jsonData = file.readAll();
-    file.close();
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(jsonData, &error);
+namespace {
+// Names are only added while a theme compiles or a caller registers the ones it
+// keeps ids of; every other lookup just reads.
+struct NameTable {
+    QReadWriteLock lock;
+    QHash<QString, int> ids;
+};
+
+int intern(NameTable& table, const QString& name) {
+    QWriteLocker locker(&table.lock);
+    const auto it = table.ids.constFind(name);
+    if (it != table.ids.constEnd()) return it.value();
+    const int id = int(table.ids.size());
+    table.ids.insert(name, id);
+    return id;
+}
+
+int find(NameTable& table, const QString& name) {
+    QReadLocker locker(&table.lock);
+    return table.ids.value(name, -1);
+}
+
+NameTable& colorNames() {
+    static NameTable table;
+    return table;
+}
+
+NameTable& styleNames() {
+    static NameTable table;
+    return table;
+}
 
-    if (doc.isNull()) {
-        qWarning() << "Failed to parse theme JSON from" << filePath << ":" << error.errorString();
-        return false;
+template <typename T>
+void setAt(QVector<T>& vector, int id, const T& value) {
+    if (id >= vector.size()) {
+        vector.resize(id + 1);
     }
+    vector[id] = value;
+}
+}
+
+int AlteTheme::colorId(const QString& name) {
+    return find(colorNames(), name);
+}
+
+int AlteTheme::styleId(const QString& styleKey) {
+    return find(styleNames(), styleKey);
+}
+
+int AlteTheme::registerColorName(const QString& name) {
+    return intern(colorNames(), name);
+}
+
+int AlteTheme::registerStyleKey(const QString& styleKey) {
+    return intern(styleNames(), styleKey);
+}
+
+// Style entries name their colors either directly ("#CC7832") or by a key of "colors".
+QColor AlteTheme::resolveColor(const QString& value) const {
+    if (value.startsWith(QLatin1Char('#'))) return QColor(value);
+    const QColor named = color(colorId(value), QColor());
+    return named.isValid() ? named : QColor(value);
+}
 
-    QJsonObject rootObj = doc.object();
-    name = rootObj["name"].toString("Untitled Theme");
-    themeType = rootObj["type"].toString("dark");
+QSharedPointer<const AlteTheme> AlteTheme::compile(const QJsonObject& themeData, const QByteArray& fingerprint) {
+    QSharedPointer<AlteTheme> theme(new AlteTheme);
+    theme->m_name = themeData.value("name").toString();
+    theme->m_fingerprint = fingerprint;
+    theme->m_fontInfo = themeData.value("font").toObject();
 
-    QJsonObject globalColorsObj = rootObj["colors"].toObject();
-    for (auto it = globalColorsObj.begin(); it != globalColorsObj.end(); ++it) {
-        editorColors.insert(it.key(), QColor(it.value().toString()));
+    const QJsonObject colors = themeData.value("colors").toObject();
+    for (auto it = colors.constBegin(); it != colors.constEnd(); ++it) {
+        const QColor value(it.value().toString());
+        if (!value.isValid()) {
+            qCWarning(lcTheme) << "AlteTheme: Color" << it.key() << "has an invalid value" << it.value().toString();
+        }
+        const int id = intern(colorNames(), it.key());
+        setAt(theme->m_colors, id, value);
+        setAt(theme->m_colorValues, id, it.value().toString());
     }
 
-    QJsonObject tokenStylesObj = rootObj["token_styles"].toObject();
-    if (tokenStylesObj.isEmpty()) {
-        qWarning() << "Theme JSON" << filePath << "is missing 'token_styles' object. Syntax highlighting may be unstyled.";
+    const QJsonObject syntaxColors = themeData.value("syntax").toObject();
+    for (auto it = syntaxColors.constBegin(); it != syntaxColors.constEnd(); ++it) {
+        setAt(theme->m_syntaxColors, intern(styleNames(), it.key()), QColor(it.value().toString()));
     }
 
-    for (auto it = tokenStylesObj.begin(); it != tokenStylesObj.end(); ++it) {
-        QString style_key = it.key();
-        QJsonObject formatDetails = it.value().toObject();
-        QTextCharFormat charFormat;
-
-        if (formatDetails.contains("color")) {
-            QString colorValue = formatDetails["color"].toString();
-            if (editorColors.contains(colorValue)) {
-                charFormat.setForeground(editorColors.value(colorValue));
-            } else {
-                charFormat.setForeground(QColor(colorValue));
-            }
+    QJsonObject styleFormats = themeData.value("syntax_formats").toObject();
+    if (styleFormats.isEmpty()) {
+        styleFormats = themeData.value("token_styles").toObject();
+    }
+    for (auto it = styleFormats.constBegin(); it != styleFormats.constEnd(); ++it) {
+        const QJsonObject details = it.value().toObject();
+        const int id = intern(styleNames(), it.key());
+        QTextCharFormat format;
+        const QColor syntaxColor = theme->syntaxColor(id, QColor());
+        if (syntaxColor.isValid()) {
+            format.setForeground(syntaxColor);
+        } else if (details.contains("color")) {
+            format.setForeground(theme->resolveColor(details.value("color").toString()));
         }
-        if (formatDetails.contains("background_color")) {
-            QString bgColorValue = formatDetails["background_color"].toString();
-            if (editorColors.contains(bgColorValue)) {
-                charFormat.setBackground(editorColors.value(bgColorValue));
-            } else {
-                charFormat.setBackground(QColor(bgColorValue));
-            }
+        if (details.contains("background_color")) {
+            format.setBackground(theme->resolveColor(details.value("background_color").toString()));
         }
-        if (formatDetails.contains("font_weight") && formatDetails["font_weight"].toString() == "bold") {
-            charFormat.setFontWeight(QFont::Bold);
+        if (details.value("font_weight").toString() == "bold") {
+            format.setFontWeight(QFont::Bold);
         }
-        if (formatDetails.contains("font_style") && formatDetails["font_style"].toString() == "italic") {
-            charFormat.setFontItalic(true);
+        if (details.value("font_style").toString() == "italic") {
+            format.setFontItalic(true);
         }
-        syntaxFormats.insert(style_key, charFormat);
+        setAt(theme->m_styleFormats, id, format);
+        setAt(theme->m_hasStyle, id, true);
     }
-    qDebug() << "Theme loaded:" << name << ". Parsed" << editorColors.count() << "global colors and" << syntaxFormats.count() << "token styles.";
-    return true;
+
+    theme->renderStyleSheets(themeData.value("styles").toObject());
+    return theme;
 }
 
-QTextCharFormat AlteTheme::getFormat(const QString &type) const {
-    return syntaxFormats.value(type, syntaxFormats.value("default"));
+// Splits a "styles" template at its %%name%% placeholders.
+QVector<AlteTheme::StyleSegment> AlteTheme::tokenizeStyle(const QString& style) {
+    QVector<StyleSegment> segments;
+    qsizetype pos = 0;
+    while (pos < style.size()) {
+        const qsizetype open = style.indexOf(QLatin1String("%%"), pos);
+        const qsizetype close = open < 0 ? -1 : style.indexOf(QLatin1String("%%"), open + 2);
+        if (close < 0) break;
+        if (open > pos) {
+            segments.append({style.mid(pos, open - pos), -1});
+        }
+        // The placeholder text is kept to be written back for names the theme lacks;
+        // those were never interned, as every color of the theme is by now.
+        segments.append({style.mid(open, close + 2 - open), colorId(style.mid(open + 2, close - open - 2))});
+        pos = close + 2;
+    }
+    if (pos < style.size()) {
+        segments.append({style.mid(pos), -1});
+    }
+    return segments;
 }
 
-QColor AlteTheme::getColor(const QString &type) const {
-    return editorColors.value(type, type == "background" ? Qt::white : Qt::black);
+qsizetype AlteTheme::renderedLength(const QVector<StyleSegment>& segments) const {
+    qsizetype length = 0;
+    for (const StyleSegment& segment : segments) {
+        const bool known = segment.colorId >= 0 && segment.colorId < m_colorValues.size()
+                           && !m_colorValues[segment.colorId].isNull();
+        length += known ? m_colorValues[segment.colorId].size() : segment.text.size();
+    }
+    return length;
+}
+
+void AlteTheme::renderStyle(const QVector<StyleSegment>& segments, QString& out) const {
+    for (const StyleSegment& segment : segments) {
+        const bool known = segment.colorId >= 0 && segment.colorId < m_colorValues.size()
+                           && !m_colorValues[segment.colorId].isNull();
+        out.append(known ? m_colorValues[segment.colorId] : segment.text);
+    }
+}
+
+// Tokenizes each template once and renders it with one append pass, so the cost
+// follows the length of the templates rather than templates times colors.
+void AlteTheme::renderStyleSheets(const QJsonObject& styles) {
+    QVector<QPair<QString, QVector<StyleSegment>>> templates;
+    templates.reserve(styles.size());
+    qsizetype globalLength = 0;
+    for (auto it = styles.constBegin(); it != styles.constEnd(); ++it) {
+        templates.append({it.key(), tokenizeStyle(it.value().toString())});
+        globalLength += it.key().size() + renderedLength(templates.last().second) + 6;
+    }
+
+    m_globalStyleSheet.reserve(globalLength);
+    for (const auto& entry : templates) {
+        QString rendered;
+        rendered.reserve(renderedLength(entry.second));
+        renderStyle(entry.second, rendered);
+        if (!m_globalStyleSheet.isEmpty()) {
+            m_globalStyleSheet.append(QLatin1Char('\n'));
+        }
+        m_globalStyleSheet.append(entry.first).append(QLatin1String(" { ")).append(rendered).append(QLatin1String(" }"));
+        m_styleSheets.insert(entry.first, rendered);
+    }
 }
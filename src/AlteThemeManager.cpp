@@ -3,214 +3,235 @@
 #include <QTextStream>
 #include <QStyleFactory>
 #include <QFontDatabase>
-#include <cstdio>
 #include <QDir>
 #include <QFileInfo>
 #include <QRegularExpression>
 #include <QFileInfoList> // Added for getAvailableThemes
 #include <QCoreApplication> // Added for applicationDirPath in getAvailableThemes
+#include <QCryptographicHash>
+#include <QJsonArray>
+#include <QSet>
+#include <QDateTime>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QRunnable>
+#include "AlteBuiltins.h"
+#include "AlteLog.h"
+#include "AlteTrace.h"
 // QDir, QFileInfo, QJsonDocument, QJsonObject, QJsonParseError are included via AlteThemeManager.h or already present
 
-AlteThemeManager::AlteThemeManager() {
-    // Consider a default path or a path from settings later
-    // For now, let's assume syntax definitions are in a known relative path
-    // This path should be relative to where the application expects resources.
-    // For development, this might be relative to the build directory or source directory.
-    // For deployment, it should be a path within the installed application bundle.
-    // Let's use a path that might work if "resources" is alongside the executable.
-    // Alternatively, it could be ":/syntax/" if using Qt Resource System.
-    loadLanguageDefinitions("resources/syntax/");
+namespace {
+const quint32 kThemeCatalogMagic = 0x414C5443; // "ALTC"
+const quint32 kThemeCatalogVersion = 1;
+// Bytes of a theme file searched for its "name" before the whole file is parsed.
+const qint64 kThemeHeaderBytes = 4096;
+const quint32 kLanguageManifestMagic = 0x414C544C; // "ALTL"
+const quint32 kLanguageManifestVersion = 1;
+// Path prefix of the languages and themes compiled into the binary, followed by the file name.
+const QString kBuiltinPrefix = QStringLiteral("builtin:");
+
+#ifdef ALTE_BUILTIN_RESOURCES
+QStringList toStringList(const char* const* items, int count) {
+    QStringList list;
+    list.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        list.append(QString::fromUtf8(items[i]));
+    }
+    return list;
+}
+#endif
+
+// The compiled-in theme of that file name, or null.
+const AlteBuiltinTheme* findBuiltinTheme(const QString& fileName) {
+#ifdef ALTE_BUILTIN_RESOURCES
+    for (const AlteBuiltinTheme& theme : alteBuiltinThemes()) {
+        if (fileName == QLatin1String(theme.fileName)) return &theme;
+    }
+#else
+    Q_UNUSED(fileName);
+#endif
+    return nullptr;
+}
+
+// Palette roles taken from the theme's "colors".
+struct PaletteColor {
+    QPalette::ColorGroup group;
+    QPalette::ColorRole role;
+    int colorId;
+    QColor defaultValue;
+};
+
+// Ids are registered on first use and kept for every later theme.
+const QVector<PaletteColor>& paletteColors() {
+    static const QVector<PaletteColor> colors = {
+        {QPalette::All, QPalette::Window, AlteTheme::registerColorName("windowBackground"), Qt::white},
+        {QPalette::All, QPalette::WindowText, AlteTheme::registerColorName("text"), Qt::black},
+        {QPalette::All, QPalette::Base, AlteTheme::registerColorName("base"), Qt::white},
+        {QPalette::All, QPalette::AlternateBase, AlteTheme::registerColorName("alternateBase"), Qt::lightGray},
+        {QPalette::All, QPalette::ToolTipBase, AlteTheme::registerColorName("tooltipBase"), Qt::white},
+        {QPalette::All, QPalette::ToolTipText, AlteTheme::registerColorName("tooltipText"), Qt::black},
+        {QPalette::All, QPalette::Text, AlteTheme::registerColorName("text"), Qt::black},
+        {QPalette::Disabled, QPalette::Text, AlteTheme::registerColorName("textDisabled"), Qt::darkGray},
+        {QPalette::All, QPalette::Button, AlteTheme::registerColorName("button"), Qt::lightGray},
+        {QPalette::All, QPalette::ButtonText, AlteTheme::registerColorName("buttonText"), Qt::black},
+        {QPalette::Disabled, QPalette::ButtonText, AlteTheme::registerColorName("textDisabled"), Qt::darkGray},
+        {QPalette::All, QPalette::Link, AlteTheme::registerColorName("accent"), Qt::blue},
+        {QPalette::All, QPalette::Highlight, AlteTheme::registerColorName("highlight"), Qt::blue},
+        {QPalette::All, QPalette::HighlightedText, AlteTheme::registerColorName("highlightedText"), Qt::white},
+    };
+    return colors;
+}
+}
+
+AlteThemeManager::AlteThemeManager()
+    : m_theme(AlteTheme::compile(QJsonObject(), QByteArray())) {
+    // Languages are not needed for the first frame; main() calls
+    // loadLanguageDefinitions() once the window is on screen.
 }
 
 bool AlteThemeManager::loadTheme(const QString& filePath) {
-    qDebug() << "Attempting to load theme from:" << filePath;
+    ALTE_TRACE_ZONE("theme", "loadTheme");
+    qCDebug(lcTheme) << "Attempting to load theme from:" << filePath;
+    QByteArray jsonData;
+    QByteArray fingerprint;
+    QString loadedPath = QFileInfo(filePath).absoluteFilePath();
     QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qWarning() << "Could not open theme file:" << filePath << file.errorString();
-        qDebug() << "QFile error:" << file.errorString();
-        return false;
+    if (!filePath.startsWith(kBuiltinPrefix) && file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        jsonData = file.readAll();
+        file.close();
+        fingerprint = QCryptographicHash::hash(jsonData, QCryptographicHash::Sha1);
+    } else {
+        // A missing file falls back to the bundled theme of the same name.
+        const QString fileName = filePath.startsWith(kBuiltinPrefix) ? filePath.mid(kBuiltinPrefix.size())
+                                                                     : QFileInfo(filePath).fileName();
+        const AlteBuiltinTheme* builtin = findBuiltinTheme(fileName);
+        if (!builtin) {
+            qCWarning(lcTheme) << "Could not open theme file:" << filePath << file.errorString();
+            return false;
+        }
+        qCDebug(lcTheme) << "Using the built-in theme" << fileName;
+        jsonData = QByteArray::fromRawData(builtin->definition, int(qstrlen(builtin->definition)));
+        fingerprint = QByteArray(builtin->fingerprint, 20);
+        loadedPath = kBuiltinPrefix + fileName;
     }
 
-    QByteArray jsonData = file.readAll();
-    file.close();
-
     QJsonParseError parseError;
     QJsonDocument doc = QJsonDocument::fromJson(jsonData, &parseError);
 
     if (parseError.error != QJsonParseError::NoError) {
-        qWarning() << "Error parsing theme JSON:" << parseError.errorString() << "at offset" << parseError.offset;
+        qCWarning(lcTheme) << "Error parsing theme JSON:" << parseError.errorString() << "at offset" << parseError.offset;
         return false;
     }
 
     if (!doc.isObject()) {
-        qWarning() << "Theme JSON is not an object.";
-        qDebug() << "Theme JSON content:" << jsonData;
+        qCWarning(lcTheme) << "Theme JSON is not an object.";
+        qCDebug(lcTheme) << "Theme JSON content:" << jsonData;
         return false;
     }
 
-    themeData = doc.object();
-    qDebug() << "Theme JSON parsed successfully. Name:" << themeData.value("name").toString();
-
-    colors = themeData.value("colors").toObject();
-    qDebug() << "Loaded colors keys:" << colors.keys();
-
-    syntaxColors = themeData.value("syntax").toObject();
-    qDebug() << "Loaded syntaxColors keys:" << syntaxColors.keys();
-
-    styles = themeData.value("styles").toObject();
-    qDebug() << "Loaded styles keys:" << styles.keys();
-
-    syntaxHighlightingRules = themeData.value("syntax_highlighting").toObject();
-    qDebug() << "Loaded syntaxHighlightingRules keys:" << syntaxHighlightingRules.keys();
-
-    fontInfo = themeData.value("font").toObject();
-    qDebug() << "Loaded fontInfo keys:" << fontInfo.keys();
-
-    qInfo() << "Theme loaded successfully:" << themeData.value("name").toString();
+    // Compile first and swap the pointer, so a theme is never seen half loaded.
+    m_theme = AlteTheme::compile(doc.object(), fingerprint);
+    m_themeFilePath = loadedPath;
+    qCInfo(lcTheme) << "Theme loaded successfully:" << m_theme->name();
     return true;
 }
 
 void AlteThemeManager::applyTheme(QApplication* app) const {
-    fprintf(stderr, "[applyTheme] Entered function (fprintf).\n");
-    fflush(stderr);
-
+    ALTE_TRACE_ZONE("theme", "applyTheme");
     if (!app) {
-        qWarning() << "QApplication instance is null. Cannot apply theme.";
-        fprintf(stderr, "[applyTheme] QApplication instance is null. Cannot apply theme (fprintf).\n");
-        fflush(stderr);
+        qCWarning(lcTheme) << "QApplication instance is null. Cannot apply theme.";
         return;
     }
 
-    fprintf(stderr, "[applyTheme] Setting Fusion style (fprintf).\n");
-    fflush(stderr);
     app->setStyle(QStyleFactory::create("Fusion"));
 
-    fprintf(stderr, "[applyTheme] About to call getApplicationFont (fprintf).\n");
-    fflush(stderr);
-    fprintf(stderr, "[applyTheme] Test color 'text' before getApplicationFont: %s (fprintf).\n", getColor("text", Qt::magenta).name().toUtf8().constData());
-    fflush(stderr);
-
     QFont appFont = getApplicationFont(app->font());
-    fprintf(stderr, "[applyTheme] Called getApplicationFont. Setting app font (fprintf).\n");
-    fflush(stderr);
     app->setFont(appFont);
-    qDebug() << "Application font set to:" << appFont.family() << "Size:" << appFont.pointSize();
-
-    fprintf(stderr, "[applyTheme] About to set global palette (fprintf).\n");
-    fflush(stderr);
-    fprintf(stderr, "[applyTheme] Test color 'windowBackground' before palette: %s (fprintf).\n", getColor("windowBackground", Qt::magenta).name().toUtf8().constData());
-    fflush(stderr);
+    qCDebug(lcTheme) << "Application font set to:" << appFont.family() << "Size:" << appFont.pointSize();
 
     QPalette globalPalette;
-    globalPalette.setColor(QPalette::Window, getColor("windowBackground", Qt::white));
-    globalPalette.setColor(QPalette::WindowText, getColor("text", Qt::black));
-    globalPalette.setColor(QPalette::Base, getColor("base", Qt::white));
-    globalPalette.setColor(QPalette::AlternateBase, getColor("alternateBase", Qt::lightGray));
-    globalPalette.setColor(QPalette::ToolTipBase, getColor("tooltipBase", Qt::white));
-    globalPalette.setColor(QPalette::ToolTipText, getColor("tooltipText", Qt::black));
-    globalPalette.setColor(QPalette::Text, getColor("text", Qt::black));
-    globalPalette.setColor(QPalette::Disabled, QPalette::Text, getColor("textDisabled", Qt::darkGray));
-    globalPalette.setColor(QPalette::Button, getColor("button", Qt::lightGray));
-    globalPalette.setColor(QPalette::ButtonText, getColor("buttonText", Qt::black));
-    globalPalette.setColor(QPalette::Disabled, QPalette::ButtonText, getColor("textDisabled", Qt::darkGray));
+    for (const PaletteColor& entry : paletteColors()) {
+        globalPalette.setColor(entry.group, entry.role, color(entry.colorId, entry.defaultValue));
+    }
     globalPalette.setColor(QPalette::BrightText, Qt::red);
-    globalPalette.setColor(QPalette::Link, getColor("accent", Qt::blue));
-    globalPalette.setColor(QPalette::Highlight, getColor("highlight", Qt::blue));
-    globalPalette.setColor(QPalette::HighlightedText, getColor("highlightedText", Qt::white));
-
-    fprintf(stderr, "[applyTheme] Palette colors assigned. Applying palette to app (fprintf).\n");
-    fflush(stderr);
     app->setPalette(globalPalette);
-    qDebug() << "Global palette applied. Window background:" << globalPalette.color(QPalette::Window).name();
-
-    fprintf(stderr, "[applyTheme] About to call generateGlobalStyleSheet (fprintf).\n");
-    fflush(stderr);
-    // Test: print a color to see if 'this->colors' is accessible just before generateGlobalStyleSheet
-    fprintf(stderr, "[applyTheme] Test color 'accent' before generateGlobalStyleSheet: %s (fprintf).\n", getColor("accent", Qt::magenta).name().toUtf8().constData());
-    fflush(stderr);
+    qCDebug(lcTheme) << "Global palette applied. Window background:" << globalPalette.color(QPalette::Window).name();
 
     QString globalStyleSheet = generateGlobalStyleSheet();
-    fprintf(stderr, "[applyTheme] Called generateGlobalStyleSheet. Result length: %lld (fprintf).\n", static_cast<long long>(globalStyleSheet.length()));
-    fflush(stderr);
-
     if (!globalStyleSheet.isEmpty()) {
-        qDebug() << "Global stylesheet generated. Length:" << globalStyleSheet.length();
-        if (globalStyleSheet.length() < 3000) {
-            qDebug().noquote() << "Full Global Stylesheet Content:\n" << globalStyleSheet;
-        } else {
-            qDebug().noquote() << "Global Stylesheet Content (first 1500 chars):\n" << globalStyleSheet.left(1500);
-        }
+        qCDebug(lcTheme) << "Global stylesheet generated. Length:" << globalStyleSheet.length();
         app->setStyleSheet(globalStyleSheet);
     } else {
-        qWarning() << "Generated global stylesheet is empty. Check theme JSON 'styles' section.";
+        qCWarning(lcTheme) << "Generated global stylesheet is empty. Check theme JSON 'styles' section.";
     }
-
 }
 
 QColor AlteThemeManager::getColor(const QString& name, const QColor& defaultValue) const {
-    return QColor(colors.value(name).toString(defaultValue.name()));
+    return m_theme->color(AlteTheme::colorId(name), defaultValue);
 }
 
 QColor AlteThemeManager::getSyntaxColor(const QString& name, const QColor& defaultValue) const {
-     return QColor(syntaxColors.value(name).toString(defaultValue.name()));
+    return m_theme->syntaxColor(AlteTheme::styleId(name), defaultValue);
 }
 
 QString AlteThemeManager::getStyleSheet(const QString& widgetName) const {
-    return styles.value(widgetName).toString("");
+    return m_theme->styleSheet(widgetName);
 }
 
 QString AlteThemeManager::generateGlobalStyleSheet() const {
-    qDebug() << ">>> generateGlobalStyleSheet V3 executing <<<";
-
-    QStringList globalStylesList;
-
-    if (styles.isEmpty()) {
-        qWarning() << "No styles found in theme JSON's 'styles' section to generate global stylesheet.";
+    // Rendered once when the theme was compiled.
+    if (m_theme->styleSheetCount() == 0) {
+        qCWarning(lcTheme) << "No styles found in theme JSON's 'styles' section to generate global stylesheet.";
     }
-
-    for (const QString& widgetName : styles.keys()) {
-        QString originalStyleValue = styles.value(widgetName).toString();
-        QString processedStyleValue = originalStyleValue;
-        for (auto it = colors.constBegin(); it != colors.constEnd(); ++it) {
-            QString placeholderToReplace = QString("%%%1%%").arg(it.key());
-            QString colorValue = it.value().toString();
-            processedStyleValue.replace(placeholderToReplace, colorValue);
-        }
-        QString styleEntry = QString("%1 { %2 }").arg(widgetName, processedStyleValue);
-        globalStylesList.append(styleEntry);
-    }
-
-    QString finalStyleSheet = globalStylesList.join("\n");
-    return finalStyleSheet;
+    return m_theme->globalStyleSheet();
 }
 
 QJsonObject AlteThemeManager::getSyntaxRulesForLanguage(const QString& languageName) const {
-    if (m_languageDefinitions.contains(languageName)) {
-        // The stored QJsonObject IS the language definition itself,
-        // which contains "highlighting_rules", "file_extensions", etc.
-        // AlteSyntaxHighlighter expects the object that *contains* "highlighting_rules" array.
-        return m_languageDefinitions.value(languageName);
+    const auto loaded = m_languageDefinitions.constFind(languageName);
+    if (loaded != m_languageDefinitions.constEnd()) {
+        return loaded.value();
+    }
+    const auto language = m_languages.constFind(languageName);
+    if (language == m_languages.constEnd()) {
+        qCWarning(lcLanguage) << "Syntax rules (language definition) not found for language:" << languageName;
+        return QJsonObject();
+    }
+    ALTE_TRACE_ZONE("language", "parseDefinition");
+    if (language->definition) {
+        const QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(language->definition, int(qstrlen(language->definition))));
+        m_languageDefinitions.insert(languageName, doc.object());
+        return doc.object();
+    }
+
+    // Startup only reads the manifest; the full definition is parsed on first use.
+    QFile langFile(language->filePath);
+    if (!langFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCWarning(lcLanguage) << "Could not open language file:" << language->filePath;
+        return QJsonObject();
+    }
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(langFile.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        qCWarning(lcLanguage) << "Error parsing language JSON" << language->filePath << ":" << parseError.errorString();
+        return QJsonObject();
     }
-    qWarning() << "Syntax rules (language definition) not found for language:" << languageName << "in m_languageDefinitions.";
-    // Attempt to fallback to theme's embedded rules if still desired (though goal is to remove them)
-    // For this refactoring step, we strictly use m_languageDefinitions.
-    // If a language definition (e.g. "cpp.json") was not loaded into m_languageDefinitions,
-    // or if languageName is something like "C++" but the file was "cpp.json" and loaded as "cpp",
-    // then it won't be found. This is expected.
-    return QJsonObject();
+    m_languageDefinitions.insert(languageName, doc.object());
+    return doc.object();
 }
 
 QFont AlteThemeManager::getApplicationFont(const QFont& defaultFont) const {
     QFont font(defaultFont);
-    QString requestedFamily = fontInfo.value("applicationFontFamily").toString(defaultFont.family());
-    int size = fontInfo.value("applicationFontSize").toInt(defaultFont.pointSize());
+    QString requestedFamily = m_theme->fontInfo().value("applicationFontFamily").toString(defaultFont.family());
+    int size = m_theme->fontInfo().value("applicationFontSize").toInt(defaultFont.pointSize());
     if (size <= 0) size = defaultFont.pointSize();
 
     QFontDatabase fontDatabase;
     QFont testFont(requestedFamily);
     if (testFont.family().compare(requestedFamily, Qt::CaseInsensitive) != 0 &&
         !fontDatabase.families().contains(requestedFamily, Qt::CaseInsensitive)) {
-        qWarning() << "Application font" << requestedFamily << "not found. Attempting fallbacks.";
+        qCWarning(lcTheme) << "Application font" << requestedFamily << "not found. Attempting fallbacks.";
         QStringList fallbacks;
         fallbacks << "Monospace" << "DejaVu Sans Mono" << "Courier New" << "Courier";
         font.setFamilies(fallbacks);
@@ -218,21 +239,21 @@ QFont AlteThemeManager::getApplicationFont(const QFont& defaultFont) const {
         font.setFamily(requestedFamily);
     }
     font.setPointSize(size);
-    qDebug() << "Application font set to family:" << font.family() << "size:" << font.pointSize() << "(requested:" << requestedFamily << ")";
+    qCDebug(lcTheme) << "Application font set to family:" << font.family() << "size:" << font.pointSize() << "(requested:" << requestedFamily << ")";
     return font;
 }
 
 QFont AlteThemeManager::getEditorFont(const QFont& defaultFont) const {
     QFont font(defaultFont);
-    QString requestedFamily = fontInfo.value("editorFontFamily").toString(defaultFont.family());
-    int size = fontInfo.value("editorFontSize").toInt(defaultFont.pointSize());
+    QString requestedFamily = m_theme->fontInfo().value("editorFontFamily").toString(defaultFont.family());
+    int size = m_theme->fontInfo().value("editorFontSize").toInt(defaultFont.pointSize());
     if (size <= 0) size = defaultFont.pointSize();
 
     QFontDatabase fontDatabase;
     QFont testFont(requestedFamily);
     if (testFont.family().compare(requestedFamily, Qt::CaseInsensitive) != 0 &&
         !fontDatabase.families().contains(requestedFamily, Qt::CaseInsensitive)) {
-        qWarning() << "Editor font" << requestedFamily << "not found. Attempting fallbacks.";
+        qCWarning(lcTheme) << "Editor font" << requestedFamily << "not found. Attempting fallbacks.";
         QStringList fallbacks;
         fallbacks << "Monospace" << "DejaVu Sans Mono" << "Courier New" << "Courier";
         font.setFamilies(fallbacks);
@@ -240,103 +261,367 @@ QFont AlteThemeManager::getEditorFont(const QFont& defaultFont) const {
         font.setFamily(requestedFamily);
     }
     font.setPointSize(size);
-    qDebug() << "Editor font set to family:" << font.family() << "size:" << font.pointSize() << "(requested:" << requestedFamily << ")";
+    qCDebug(lcTheme) << "Editor font set to family:" << font.family() << "size:" << font.pointSize() << "(requested:" << requestedFamily << ")";
     return font;
 }
 
 int AlteThemeManager::getStylesObjectSizeForDebug() const {
-    return styles.size();
+    return m_theme->styleSheetCount();
 }
 
 void AlteThemeManager::loadLanguageDefinitions(const QString& directoryPath) {
+    ALTE_TRACE_ZONE("language", "loadLanguageDefinitions");
+    m_languages.clear();
     m_languageDefinitions.clear();
+#ifdef ALTE_BUILTIN_RESOURCES
+    // Bundled languages need no file at all; files below replace them by name.
+    for (const AlteBuiltinLanguage& builtin : alteBuiltinLanguages()) {
+        LanguageManifestEntry entry;
+        readBuiltinLanguage(QString::fromUtf8(builtin.fileName), QByteArray(), entry);
+        m_languages.insert(entry.name, entry);
+    }
+#endif
     QDir syntaxDir(directoryPath);
     if (!syntaxDir.exists()) {
-        qWarning() << "Syntax definition directory does not exist:" << directoryPath;
+        qCWarning(lcLanguage) << "Syntax definition directory does not exist:" << directoryPath;
         // Try a path relative to the application executable for deployed scenarios
         QDir appDir(QApplication::applicationDirPath());
         QString fallbackPath = appDir.filePath(directoryPath);
-        qDebug() << "Attempting fallback syntax definition directory:" << fallbackPath;
+        qCDebug(lcLanguage) << "Attempting fallback syntax definition directory:" << fallbackPath;
         syntaxDir.setPath(fallbackPath);
         if (!syntaxDir.exists()) {
-            qWarning() << "Fallback syntax definition directory also does not exist:" << fallbackPath;
+            qCWarning(lcLanguage) << "Fallback syntax definition directory also does not exist:" << fallbackPath;
             // If using Qt resources, the path might be like ":/syntax/"
             // Check one more common location for development: relative to current working dir
             QDir currentDir(QDir::currentPath());
             QString devPath = currentDir.filePath(directoryPath);
-             qDebug() << "Attempting development syntax definition directory:" << devPath;
+             qCDebug(lcLanguage) << "Attempting development syntax definition directory:" << devPath;
             syntaxDir.setPath(devPath);
              if (!syntaxDir.exists()) {
-                qWarning() << "Development syntax definition directory also not found:" << devPath;
+                qCWarning(lcLanguage) << "Development syntax definition directory also not found:" << devPath;
                  // Try Qt resource system path
                 syntaxDir.setPath(":/syntax");
                 if(!syntaxDir.exists()){
-                    qWarning() << "Qt resource path ':/syntax' also not found. No language definitions will be loaded.";
+                    qCWarning(lcLanguage) << "Qt resource path ':/syntax' also not found. No language files will be read.";
+                    buildDetectionTables();
                     return;
                 } else {
-                     qDebug() << "Found syntax definitions in Qt resource path ':/syntax'";
+                     qCDebug(lcLanguage) << "Found syntax definitions in Qt resource path ':/syntax'";
                 }
             } else {
-                 qDebug() << "Found syntax definitions in development path:" << devPath;
+                 qCDebug(lcLanguage) << "Found syntax definitions in development path:" << devPath;
             }
         } else {
-            qDebug() << "Found syntax definitions in fallback path:" << fallbackPath;
+            qCDebug(lcLanguage) << "Found syntax definitions in fallback path:" << fallbackPath;
         }
     } else {
-         qDebug() << "Found syntax definitions in primary path:" << directoryPath;
+         qCDebug(lcLanguage) << "Found syntax definitions in primary path:" << directoryPath;
     }
 
 
-    QStringList filters;
-    filters << "*.json";
-    QFileInfoList fileList = syntaxDir.entryInfoList(filters, QDir::Files);
-
-    for (const QFileInfo& fileInfo : fileList) {
-        QFile langFile(fileInfo.filePath());
-        if (!langFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            qWarning() << "Could not open language file:" << fileInfo.filePath();
+    // Files unchanged since the manifest was written are not opened at all; the
+    // others are summarized in parallel.
+    const QHash<QString, LanguageManifestEntry> manifest = loadLanguageManifest();
+    const QFileInfoList fileList = syntaxDir.entryInfoList(QStringList() << "*.json", QDir::Files);
+    QVector<LanguageManifestEntry> entries(fileList.size());
+    QVector<int> stale;
+    for (int i = 0; i < fileList.size(); ++i) {
+        const QFileInfo& fileInfo = fileList.at(i);
+        const QString filePath = fileInfo.canonicalFilePath();
+        const qint64 modified = fileInfo.lastModified().toMSecsSinceEpoch();
+        const auto cached = manifest.constFind(filePath);
+        if (cached != manifest.constEnd() && cached->modified == modified && cached->size == fileInfo.size()) {
+            entries[i] = cached.value();
             continue;
         }
-        QByteArray langData = langFile.readAll();
-        langFile.close();
+        entries[i].filePath = filePath;
+        entries[i].modified = modified;
+        entries[i].size = fileInfo.size();
+        stale.append(i);
+    }
+    if (!stale.isEmpty()) {
+        // Each task writes its own entry only.
+        QThreadPool pool;
+        for (const int i : stale) {
+            LanguageManifestEntry* entry = &entries[i];
+            pool.start(QRunnable::create([entry]() { readLanguageFile(*entry); }));
+        }
+        pool.waitForDone();
+    }
 
-        QJsonParseError parseError;
-        QJsonDocument doc = QJsonDocument::fromJson(langData, &parseError);
-        if (parseError.error != QJsonParseError::NoError) {
-            qWarning() << "Error parsing language JSON" << fileInfo.fileName() << ":" << parseError.errorString();
-            continue;
+    for (const LanguageManifestEntry& entry : entries) {
+        if (entry.name.isEmpty()) continue;
+        // A copy of a bundled file keeps the compiled-in definition.
+        const auto builtin = m_languages.constFind(entry.name);
+        if (builtin != m_languages.constEnd() && builtin->definition && builtin->fingerprint == entry.fingerprint) continue;
+        m_languages.insert(entry.name, entry);
+    }
+    if (!stale.isEmpty() || manifest.size() != entries.size()) {
+        saveLanguageManifest(entries);
+    }
+    buildDetectionTables();
+    if (m_languages.isEmpty()) {
+        qCWarning(lcLanguage) << "No language definitions loaded. Syntax highlighting might not work as expected.";
+    } else {
+        qCDebug(lcLanguage) << "Languages available:" << m_languages.size() << "(" << stale.size() << "files read)";
+    }
+}
+
+// Summarizes one language file into entry; the name is left empty if the file
+// is not a usable definition. Runs on pool threads.
+void AlteThemeManager::readLanguageFile(LanguageManifestEntry& entry) {
+    const QString fileName = QFileInfo(entry.filePath).fileName();
+    QFile langFile(entry.filePath);
+    if (!langFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCWarning(lcLanguage) << "Could not open language file:" << entry.filePath;
+        return;
+    }
+    const QByteArray langData = langFile.readAll();
+    langFile.close();
+    const QByteArray fingerprint = QCryptographicHash::hash(langData, QCryptographicHash::Sha1);
+    // An unmodified bundled file was validated and summarized at build time.
+    if (readBuiltinLanguage(fileName, fingerprint, entry)) return;
+
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(langData, &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        qCWarning(lcLanguage) << "Error parsing language JSON" << fileName << ":" << parseError.errorString();
+        return;
+    }
+    if (!doc.isObject()) {
+        qCWarning(lcLanguage) << "Language JSON is not an object:" << fileName;
+        return;
+    }
+
+    const QJsonObject langObject = doc.object();
+    QString langName = langObject.value("language_name").toString();
+    if (langName.isEmpty()) {
+        langName = QFileInfo(entry.filePath).baseName(); // Fallback to filename without extension
+        qCWarning(lcLanguage) << "Language file" << fileName << "is missing 'language_name'. Using filename '" << langName << "' as language name.";
+    }
+
+    // Ensure essential keys are present
+    if (!langObject.contains("file_extensions") || !langObject.value("file_extensions").isArray()) {
+        qCWarning(lcLanguage) << "Language" << langName << "is missing 'file_extensions' array. Skipping.";
+        return;
+    }
+
+    entry.extensions.clear();
+    for (const QJsonValue& extVal : langObject.value("file_extensions").toArray()) {
+        entry.extensions.append(extVal.toString());
+    }
+    entry.firstLinePatterns.clear();
+    for (const QJsonValue& patternVal : langObject.value("first_line_patterns").toArray()) {
+        entry.firstLinePatterns.append(patternVal.toString());
+    }
+    entry.keywords.clear();
+    for (const QJsonValue& ruleVal : langObject.value("highlighting_rules").toArray()) {
+        const QJsonObject rule = ruleVal.toObject();
+        if (rule.value("type").toString() != "keywords") continue;
+        for (const QJsonValue& keyword : rule.value("list").toArray()) {
+            entry.keywords.append(keyword.toString());
         }
-        if (!doc.isObject()) {
-            qWarning() << "Language JSON is not an object:" << fileInfo.fileName();
-            continue;
+    }
+    entry.contentTokens.clear();
+    for (const QJsonValue& token : langObject.value("content_tokens").toArray()) {
+        entry.contentTokens.append(token.toString());
+    }
+    entry.fingerprint = fingerprint;
+    entry.name = langName;
+}
+
+// Fills entry from the compiled-in language of that file name, if there is one
+// and its source hashed to fingerprint (any source if fingerprint is empty).
+bool AlteThemeManager::readBuiltinLanguage(const QString& fileName, const QByteArray& fingerprint, LanguageManifestEntry& entry) {
+#ifdef ALTE_BUILTIN_RESOURCES
+    for (const AlteBuiltinLanguage& builtin : alteBuiltinLanguages()) {
+        if (fileName != QLatin1String(builtin.fileName)) continue;
+        const QByteArray builtinFingerprint(builtin.fingerprint, 20);
+        if (!fingerprint.isEmpty() && fingerprint != builtinFingerprint) return false;
+        if (entry.filePath.isEmpty()) {
+            entry.filePath = kBuiltinPrefix + fileName;
+            entry.size = builtin.sourceSize;
         }
+        entry.name = QString::fromUtf8(builtin.name);
+        entry.extensions = toStringList(builtin.extensions, builtin.extensionCount);
+        entry.firstLinePatterns = toStringList(builtin.firstLinePatterns, builtin.firstLinePatternCount);
+        entry.keywords = toStringList(builtin.keywords, builtin.keywordCount);
+        entry.contentTokens = toStringList(builtin.contentTokens, builtin.contentTokenCount);
+        entry.fingerprint = builtinFingerprint;
+        entry.definition = builtin.definition;
+        return true;
+    }
+#else
+    Q_UNUSED(fileName);
+    Q_UNUSED(fingerprint);
+    Q_UNUSED(entry);
+#endif
+    return false;
+}
+
+QString AlteThemeManager::languageManifestPath() {
+    const QString cachePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (cachePath.isEmpty() || !QDir().mkpath(cachePath)) {
+        return QString();
+    }
+    return QDir(cachePath).filePath("languages.manifest");
+}
 
-        QJsonObject langObject = doc.object();
-        QString langName = langObject.value("language_name").toString();
-        if (langName.isEmpty()) {
-            langName = fileInfo.baseName(); // Fallback to filename without extension
-            qWarning() << "Language file" << fileInfo.fileName() << "is missing 'language_name'. Using filename '" << langName << "' as language name.";
+QHash<QString, AlteThemeManager::LanguageManifestEntry> AlteThemeManager::loadLanguageManifest() {
+    QHash<QString, LanguageManifestEntry> manifest;
+    QFile file(languageManifestPath());
+    if (!file.open(QIODevice::ReadOnly)) return manifest;
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_15);
+    quint32 magic = 0;
+    quint32 formatVersion = 0;
+    qint32 count = 0;
+    in >> magic >> formatVersion >> count;
+    if (magic != kLanguageManifestMagic || formatVersion != kLanguageManifestVersion) return manifest;
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        LanguageManifestEntry entry;
+        in >> entry.filePath >> entry.modified >> entry.size >> entry.name >> entry.extensions
+           >> entry.firstLinePatterns >> entry.keywords >> entry.contentTokens >> entry.fingerprint;
+        manifest.insert(entry.filePath, entry);
+    }
+    if (in.status() != QDataStream::Ok) {
+        qCWarning(lcLanguage) << "AlteThemeManager: Ignoring corrupt language manifest" << file.fileName();
+        return QHash<QString, LanguageManifestEntry>();
+    }
+    return manifest;
+}
+
+void AlteThemeManager::saveLanguageManifest(const QVector<LanguageManifestEntry>& entries) {
+    const QString manifestPath = languageManifestPath();
+    if (manifestPath.isEmpty()) return;
+    QSaveFile file(manifestPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcLanguage) << "AlteThemeManager: Could not write language manifest" << manifestPath << ":" << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_15);
+    out << kLanguageManifestMagic << kLanguageManifestVersion << qint32(entries.size());
+    // Broken files are kept with an empty name, so they are only read (and
+    // reported) again once they change.
+    for (const LanguageManifestEntry& entry : entries) {
+        out << entry.filePath << entry.modified << entry.size << entry.name << entry.extensions
+            << entry.firstLinePatterns << entry.keywords << entry.contentTokens << entry.fingerprint;
+    }
+    if (!file.commit()) {
+        qCWarning(lcLanguage) << "AlteThemeManager: Could not write language manifest" << manifestPath << ":" << file.errorString();
+    }
+}
+
+// Builds the lookup tables detectLanguage() uses, so detection does not walk
+// every definition or compile a regex per call.
+void AlteThemeManager::buildDetectionTables() {
+    m_extensionLanguages.clear();
+    m_firstLineMatchers.clear();
+    m_sniffLanguages.clear();
+    m_sniffVocabularySizes.clear();
+    m_sniffTokens.clear();
+
+    for (auto it = m_languages.constBegin(); it != m_languages.constEnd(); ++it) {
+        for (const QString& extension : it->extensions) {
+            const QString ext = extension.mid(1); // Remove leading "." e.g. ".py" -> "py"
+            // Shared extensions (".h") keep going to the first language in name order.
+            if (!ext.isEmpty() && !m_extensionLanguages.contains(ext)) {
+                m_extensionLanguages.insert(ext, it.key());
+            }
         }
 
-        // Ensure essential keys are present
-        if (!langObject.contains("file_extensions") || !langObject.value("file_extensions").isArray()) {
-            qWarning() << "Language" << langName << "is missing 'file_extensions' array. Skipping.";
-            continue;
+        for (const QString& patternStr : it->firstLinePatterns) {
+            if (patternStr.isEmpty()) continue;
+            QRegularExpression regex(patternStr);
+            if (!regex.isValid()) {
+                qCWarning(lcLanguage) << "Invalid first line pattern for" << it.key() << ":" << patternStr << regex.errorString();
+                continue;
+            }
+            regex.optimize();
+            m_firstLineMatchers.append({it.key(), regex});
         }
 
-        m_languageDefinitions.insert(langName, langObject);
-        qDebug() << "Loaded language definition:" << langName << "from" << fileInfo.fileName();
+        // Keyword lists plus optional "content_tokens" are the vocabulary content is scored against.
+        QSet<QString> vocabulary(it->keywords.cbegin(), it->keywords.cend());
+        for (const QString& token : it->contentTokens) {
+            vocabulary.insert(token);
+        }
+        vocabulary.remove(QString());
+        if (vocabulary.isEmpty()) continue;
+        const int language = m_sniffLanguages.size();
+        m_sniffLanguages.append(it.key());
+        m_sniffVocabularySizes.append(vocabulary.size());
+        for (const QString& token : vocabulary) {
+            m_sniffTokens[token].append({language, 1.0f});
+        }
     }
-    if(m_languageDefinitions.isEmpty()){
-        qWarning() << "No language definitions loaded. Syntax highlighting might not work as expected.";
-    } else {
-        qDebug() << "Total languages loaded:" << m_languageDefinitions.count();
+
+    // A token used by n languages says 1/n as much about each of them.
+    for (auto it = m_sniffTokens.begin(); it != m_sniffTokens.end(); ++it) {
+        for (SniffWeight& entry : it.value()) {
+            entry.weight = 1.0f / it.value().size();
+        }
     }
 }
 
-QString AlteThemeManager::detectLanguage(const QString& filePath, const QString& firstLineContent) const {
-    if (m_languageDefinitions.isEmpty()) {
-        qWarning() << "No language definitions loaded. Cannot detect language.";
+namespace {
+// Characters of content scored by sniffLanguage().
+const int kSniffLength = 4096;
+// Occurrences of one token that count, so a repeated word cannot decide alone.
+const int kSniffMaxRepeats = 4;
+// Lowest score, and lowest score per word, that is taken as a detection. Prose
+// uses many keywords ("if", "for", "new") but far less densely than code.
+const float kSniffMinScore = 3.0f;
+const float kSniffMinDensity = 0.025f;
+
+bool isSniffWordChar(QChar c) {
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+}
+
+QString AlteThemeManager::sniffLanguage(const QString& content) const {
+    if (m_sniffTokens.isEmpty()) return QString();
+    const int length = qMin(int(content.size()), kSniffLength);
+    QVector<float> scores(m_sniffLanguages.size(), 0.0f);
+    QHash<const QVector<SniffWeight>*, int> repeats;
+
+    int words = 0;
+    int i = 0;
+    while (i < length) {
+        if (!isSniffWordChar(content.at(i))) {
+            ++i;
+            continue;
+        }
+        const int start = i;
+        while (i < length && isSniffWordChar(content.at(i))) {
+            ++i;
+        }
+        ++words;
+        const auto it = m_sniffTokens.constFind(content.mid(start, i - start));
+        if (it == m_sniffTokens.constEnd() || ++repeats[&it.value()] > kSniffMaxRepeats) continue;
+        for (const SniffWeight& entry : it.value()) {
+            scores[entry.language] += entry.weight;
+        }
+    }
+
+    int best = -1;
+    for (int language = 0; language < scores.size(); ++language) {
+        // On a tie the smaller vocabulary is the more specific language (C over C++).
+        if (best < 0 || scores[language] > scores[best]
+            || (scores[language] == scores[best] && m_sniffVocabularySizes[language] < m_sniffVocabularySizes[best])) {
+            best = language;
+        }
+    }
+    if (best < 0 || scores[best] < kSniffMinScore || scores[best] < kSniffMinDensity * words) return QString();
+    return m_sniffLanguages[best];
+}
+
+QString AlteThemeManager::detectLanguage(const QString& filePath, const QString& firstLineContent,
+                                         const QString& content) const {
+    ALTE_TRACE_ZONE("language", "detectLanguage");
+    if (m_languages.isEmpty()) {
+        qCWarning(lcLanguage) << "No language definitions loaded. Cannot detect language.";
         return QString(); // Or "Plain Text"
     }
 
@@ -345,127 +630,259 @@ QString AlteThemeManager::detectLanguage(const QString& filePath, const QString&
     QString completeSuffix = fileInfo.completeSuffix(); // e.g., "tar.gz" - useful for multi-part extensions
 
     // Pass 1: Match by file extension
-    for (auto it = m_languageDefinitions.constBegin(); it != m_languageDefinitions.constEnd(); ++it) {
-        const QJsonObject& langDef = it.value();
-        QJsonArray extensions = langDef.value("file_extensions").toArray();
-        for (const QJsonValue& extVal : extensions) {
-            QString ext = extVal.toString().mid(1); // Remove leading "." e.g. ".py" -> "py"
-            if (!ext.isEmpty() && (ext == fileSuffix || ext == completeSuffix)) {
-                qDebug() << "Detected language by extension:" << it.key() << "for file:" << filePath;
-                return it.key();
-            }
+    for (const QString& suffix : {completeSuffix, fileSuffix}) {
+        const auto it = m_extensionLanguages.constFind(suffix);
+        if (!suffix.isEmpty() && it != m_extensionLanguages.constEnd()) {
+            qCDebug(lcLanguage) << "Detected language by extension:" << it.value() << "for file:" << filePath;
+            return it.value();
         }
     }
 
     // Pass 2: Match by first line content (if not empty)
     if (!firstLineContent.isEmpty()) {
-        for (auto it = m_languageDefinitions.constBegin(); it != m_languageDefinitions.constEnd(); ++it) {
-            const QJsonObject& langDef = it.value();
-            if (langDef.contains("first_line_patterns")) {
-                QJsonArray patterns = langDef.value("first_line_patterns").toArray();
-                for (const QJsonValue& patternVal : patterns) {
-                    QString patternStr = patternVal.toString();
-                    if (patternStr.isEmpty()) continue;
-                    QRegularExpression regex(patternStr);
-                    if (regex.isValid() && regex.match(firstLineContent).hasMatch()) {
-                        qDebug() << "Detected language by first line pattern:" << it.key() << "for file:" << filePath;
-                        return it.key();
-                    }
-                }
+        for (const FirstLineMatcher& matcher : m_firstLineMatchers) {
+            if (matcher.pattern.match(firstLineContent).hasMatch()) {
+                qCDebug(lcLanguage) << "Detected language by first line pattern:" << matcher.language << "for file:" << filePath;
+                return matcher.language;
             }
         }
     }
 
-    qDebug() << "Language not detected for:" << filePath << ". Defaulting to Plain Text or empty.";
+    // Pass 3: Score the start of the content against each language's keywords
+    if (!content.isEmpty()) {
+        const QString sniffed = sniffLanguage(content);
+        if (!sniffed.isEmpty()) {
+            qCDebug(lcLanguage) << "Detected language by content:" << sniffed << "for file:" << filePath;
+            return sniffed;
+        }
+    }
+
+    qCDebug(lcLanguage) << "Language not detected for:" << filePath << ". Defaulting to Plain Text or empty.";
     // Fallback: if a "Plain Text" language is defined, use it for .txt or unknown
-    if ( (fileSuffix == "txt" || completeSuffix == "txt") && m_languageDefinitions.contains("Plain Text")) {
+    if ( (fileSuffix == "txt" || completeSuffix == "txt") && m_languages.contains("Plain Text")) {
         return "Plain Text";
     }
     // Return specific default if defined, otherwise empty
-    return m_languageDefinitions.contains("Plain Text") ? "Plain Text" : QString();
+    return m_languages.contains("Plain Text") ? "Plain Text" : QString();
 }
 
 QStringList AlteThemeManager::getAvailableLanguages() const {
-    return m_languageDefinitions.keys();
+    return m_languages.keys();
 }
 
 QStringList AlteThemeManager::getExtensionsForLanguage(const QString& languageName) const {
-    QStringList extensionsList;
-    if (m_languageDefinitions.contains(languageName)) {
-        const QJsonObject& langDef = m_languageDefinitions.value(languageName);
-        QJsonArray extensions = langDef.value("file_extensions").toArray();
-        for (const QJsonValue& extVal : extensions) {
-            extensionsList.append(extVal.toString());
-        }
-    }
-    return extensionsList;
+    return m_languages.value(languageName).extensions;
+}
+
+QStringList AlteThemeManager::getKeywordsForLanguage(const QString& languageName) const {
+    return m_languages.value(languageName).keywords;
 }
 
 QMap<QString, QString> AlteThemeManager::getAvailableThemes(const QString& directoryPath) const {
+    ALTE_TRACE_ZONE("theme", "listThemes");
     QMap<QString, QString> availableThemes;
     QDir themesDir;
+#ifdef ALTE_BUILTIN_RESOURCES
+    // Theme files of the same name replace these below.
+    for (const AlteBuiltinTheme& theme : alteBuiltinThemes()) {
+        availableThemes.insert(QString::fromUtf8(theme.name), kBuiltinPrefix + QLatin1String(theme.fileName));
+    }
+#endif
 
     // Attempt to find the themes directory using a similar fallback strategy as loadLanguageDefinitions
-    QString effectivePath = directoryPath;
-    if (!QFileInfo::exists(effectivePath)) {
-        qDebug() << "Primary theme directory not found:" << effectivePath;
-        effectivePath = QCoreApplication::applicationDirPath() + "/" + directoryPath;
+    // The directory found for a path is remembered, so it is only probed once.
+    QString effectivePath = m_themeDirectories.value(directoryPath);
+    if (effectivePath.isEmpty() || !QFileInfo::exists(effectivePath)) {
+        effectivePath = directoryPath;
         if (!QFileInfo::exists(effectivePath)) {
-            qDebug() << "Theme directory relative to app path not found:" << effectivePath;
-            effectivePath = QDir::currentPath() + "/" + directoryPath;
+            qCDebug(lcTheme) << "Primary theme directory not found:" << effectivePath;
+            effectivePath = QCoreApplication::applicationDirPath() + "/" + directoryPath;
             if (!QFileInfo::exists(effectivePath)) {
-                qDebug() << "Theme directory relative to current working dir not found:" << effectivePath;
-                // Qt resource path for themes (e.g. ":/themes")
-                // This assumes themes are also added to qrc if this path is to be used
-                effectivePath = ":/themes";
+                qCDebug(lcTheme) << "Theme directory relative to app path not found:" << effectivePath;
+                effectivePath = QDir::currentPath() + "/" + directoryPath;
                 if (!QFileInfo::exists(effectivePath)) {
-                   qWarning() << "Theme directory not found in standard locations including Qt resources ':/themes'. Cannot load available themes.";
-                   return availableThemes;
+                    qCDebug(lcTheme) << "Theme directory relative to current working dir not found:" << effectivePath;
+                    // Qt resource path for themes (e.g. ":/themes")
+                    // This assumes themes are also added to qrc if this path is to be used
+                    effectivePath = ":/themes";
+                    if (!QFileInfo::exists(effectivePath)) {
+                       qCWarning(lcTheme) << "Theme directory not found in standard locations including Qt resources ':/themes'. Cannot load available themes.";
+                       return availableThemes;
+                    } else {
+                       qCDebug(lcTheme) << "Found themes in Qt resource path ':/themes'";
+                    }
                 } else {
-                   qDebug() << "Found themes in Qt resource path ':/themes'";
+                    qCDebug(lcTheme) << "Found themes in CWD path:" << effectivePath;
                 }
             } else {
-                qDebug() << "Found themes in CWD path:" << effectivePath;
+                qCDebug(lcTheme) << "Found themes in app path:" << effectivePath;
             }
         } else {
-            qDebug() << "Found themes in app path:" << effectivePath;
+            qCDebug(lcTheme) << "Found themes in primary path:" << effectivePath;
         }
-    } else {
-        qDebug() << "Found themes in primary path:" << effectivePath;
+        m_themeDirectories.insert(directoryPath, QFileInfo(effectivePath).absoluteFilePath());
     }
     themesDir.setPath(effectivePath);
 
     if (!themesDir.exists()) {
-        qWarning() << "Themes directory does not exist after all checks:" << themesDir.path();
+        qCWarning(lcTheme) << "Themes directory does not exist after all checks:" << themesDir.path();
         return availableThemes;
     }
 
-    QStringList filters;
-    filters << "*.json";
-    QFileInfoList fileList = themesDir.entryInfoList(filters, QDir::Files);
-
+    // Names come from the catalog; only new or changed files are read, and
+    // only as far as their "name".
+    loadThemeCatalog();
+    bool catalogChanged = false;
+    QSet<QString> present;
+    const QFileInfoList fileList = themesDir.entryInfoList(QStringList() << "*.json", QDir::Files);
     for (const QFileInfo& fileInfo : fileList) {
-        QFile themeFile(fileInfo.filePath());
-        if (!themeFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            qWarning() << "Could not open theme file for reading name:" << fileInfo.filePath();
-            continue;
-        }
-        QByteArray jsonData = themeFile.readAll();
-        themeFile.close();
-
-        QJsonParseError parseError;
-        QJsonDocument doc = QJsonDocument::fromJson(jsonData, &parseError);
-        if (parseError.error == QJsonParseError::NoError && doc.isObject()) {
-            QString themeName = doc.object().value("name").toString();
-            if (!themeName.isEmpty()) {
-                availableThemes.insert(themeName, fileInfo.canonicalFilePath());
-                qDebug() << "Discovered theme:" << themeName << "at" << fileInfo.canonicalFilePath();
-            } else {
-                qWarning() << "Theme file" << fileInfo.fileName() << "is missing 'name' property.";
+        const QString filePath = fileInfo.canonicalFilePath();
+        const qint64 modified = fileInfo.lastModified().toMSecsSinceEpoch();
+        present.insert(filePath);
+        auto entry = m_themeCatalog.find(filePath);
+        if (entry == m_themeCatalog.end() || entry->modified != modified || entry->size != fileInfo.size()) {
+            entry = m_themeCatalog.insert(filePath, {modified, fileInfo.size(), readThemeName(filePath)});
+            catalogChanged = true;
+            if (!entry->name.isEmpty()) {
+                qCDebug(lcTheme) << "Discovered theme:" << entry->name << "at" << filePath;
             }
+        }
+        if (!entry->name.isEmpty()) {
+            availableThemes.insert(entry->name, filePath);
+        }
+    }
+    // Forget files of this directory that are gone.
+    const QString canonicalDirectory = themesDir.canonicalPath();
+    for (auto it = m_themeCatalog.begin(); it != m_themeCatalog.end();) {
+        if (!present.contains(it.key()) && QFileInfo(it.key()).path() == canonicalDirectory) {
+            it = m_themeCatalog.erase(it);
+            catalogChanged = true;
         } else {
-            qWarning() << "Error parsing theme file" << fileInfo.fileName() << ":" << parseError.errorString();
+            ++it;
         }
     }
+    if (catalogChanged) {
+        saveThemeCatalog();
+    }
     return availableThemes;
 }
+
+// Reads the top-level "name" of a theme from the start of the file, where themes
+// keep it. The whole file is only parsed when the name is not found there.
+QString AlteThemeManager::readThemeName(const QString& filePath) {
+    QFile themeFile(filePath);
+    if (!themeFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCWarning(lcTheme) << "Could not open theme file for reading name:" << filePath;
+        return QString();
+    }
+    QByteArray jsonData = themeFile.read(kThemeHeaderBytes);
+
+    // Index of the quote closing the string opened at from, or -1.
+    const auto stringEnd = [&jsonData](int from) {
+        for (int i = from + 1; i < jsonData.size(); ++i) {
+            if (jsonData.at(i) == '\\') {
+                ++i;
+            } else if (jsonData.at(i) == '"') {
+                return i;
+            }
+        }
+        return -1;
+    };
+    const auto skipSpace = [&jsonData](int i) {
+        while (i < jsonData.size() && QChar::isSpace(uchar(jsonData.at(i)))) {
+            ++i;
+        }
+        return i;
+    };
+    int depth = 0;
+    for (int i = 0; i < jsonData.size(); ++i) {
+        const char c = jsonData.at(i);
+        if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            --depth;
+        } else if (c == '"') {
+            const int end = stringEnd(i);
+            if (end < 0) break;
+            if (depth == 1 && jsonData.mid(i, end - i + 1) == "\"name\"") {
+                int value = skipSpace(end + 1);
+                if (value < jsonData.size() && jsonData.at(value) == ':') {
+                    value = skipSpace(value + 1);
+                    const int valueEnd = value < jsonData.size() && jsonData.at(value) == '"' ? stringEnd(value) : -1;
+                    if (valueEnd >= 0) {
+                        // Let the JSON parser undo the escapes of the string.
+                        const QJsonDocument name = QJsonDocument::fromJson("[" + jsonData.mid(value, valueEnd - value + 1) + "]");
+                        return name.array().at(0).toString();
+                    }
+                }
+            }
+            i = end;
+        }
+    }
+
+    jsonData += themeFile.readAll();
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(jsonData, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        qCWarning(lcTheme) << "Error parsing theme file" << QFileInfo(filePath).fileName() << ":" << parseError.errorString();
+        return QString();
+    }
+    const QString themeName = doc.object().value("name").toString();
+    if (themeName.isEmpty()) {
+        qCWarning(lcTheme) << "Theme file" << QFileInfo(filePath).fileName() << "is missing 'name' property.";
+    }
+    return themeName;
+}
+
+QString AlteThemeManager::themeCatalogPath() {
+    const QString cachePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (cachePath.isEmpty() || !QDir().mkpath(cachePath)) {
+        return QString();
+    }
+    return QDir(cachePath).filePath("themes.catalog");
+}
+
+void AlteThemeManager::loadThemeCatalog() const {
+    if (m_themeCatalogLoaded) return;
+    m_themeCatalogLoaded = true;
+    QFile file(themeCatalogPath());
+    if (!file.open(QIODevice::ReadOnly)) return;
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_15);
+    quint32 magic = 0;
+    quint32 formatVersion = 0;
+    qint32 count = 0;
+    in >> magic >> formatVersion >> count;
+    if (magic != kThemeCatalogMagic || formatVersion != kThemeCatalogVersion) return;
+    QHash<QString, ThemeCatalogEntry> catalog;
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString filePath;
+        ThemeCatalogEntry entry;
+        in >> filePath >> entry.modified >> entry.size >> entry.name;
+        catalog.insert(filePath, entry);
+    }
+    if (in.status() != QDataStream::Ok) {
+        qCWarning(lcTheme) << "AlteThemeManager: Ignoring corrupt theme catalog" << file.fileName();
+        return;
+    }
+    m_themeCatalog = catalog;
+}
+
+void AlteThemeManager::saveThemeCatalog() const {
+    const QString catalogPath = themeCatalogPath();
+    if (catalogPath.isEmpty()) return;
+    QSaveFile file(catalogPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcTheme) << "AlteThemeManager: Could not write theme catalog" << catalogPath << ":" << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_15);
+    out << kThemeCatalogMagic << kThemeCatalogVersion << qint32(m_themeCatalog.size());
+    for (auto it = m_themeCatalog.constBegin(); it != m_themeCatalog.constEnd(); ++it) {
+        out << it.key() << it->modified << it->size << it->name;
+    }
+    if (!file.commit()) {
+        qCWarning(lcTheme) << "AlteThemeManager: Could not write theme catalog" << catalogPath << ":" << file.errorString();
+    }
+}
@@ -0,0 +1,93 @@
+#include "AlteTokenStore.h"
+#include <QTextBlock>
+#include <QTextDocument>
+#include <algorithm>
+
+namespace {
+// The arena is compacted once at least this many runs are dead and they make up
+// more than half of it.
+const qsizetype kCompactMinGarbage = 64 * 1024;
+}
+
+AlteLineRecord* AlteTokenStore::record(const QTextBlock& block) {
+    return static_cast<AlteLineRecord*>(block.userData());
+}
+
+AlteLineRecord* AlteTokenStore::setLine(const QTextBlock& block, const QVector<AlteToken>& tokens,
+                                        uint textHash, int entryState, int exitState, quint32 generation) {
+    QTextBlock target = block;
+    AlteLineRecord* line = record(target);
+    if (!line) {
+        line = new AlteLineRecord;
+        target.setUserData(line);
+    }
+
+    const quint32 count = quint32(tokens.size());
+    if (line->runCount > 0 && count <= line->runCount) {
+        // Fits in place: most edits keep or shrink the number of runs.
+        std::copy(tokens.cbegin(), tokens.cend(), m_runs.begin() + line->firstRun);
+        m_garbage += line->runCount - count;
+    } else {
+        m_garbage += line->runCount;
+        line->firstRun = quint32(m_runs.size());
+        m_runs.append(tokens);
+    }
+    line->runCount = count;
+    line->textHash = textHash;
+    line->entryState = entryState;
+    line->exitState = exitState;
+    line->generation = generation;
+    line->formatEpoch = 0;
+    line->windowed = false;
+
+    if (m_garbage >= kCompactMinGarbage && m_garbage * 2 > m_runs.size()) {
+        compact(block.document());
+    }
+    return line;
+}
+
+std::span<const AlteToken> AlteTokenStore::tokens(const AlteLineRecord* record) const {
+    if (!record || record->runCount == 0) return {};
+    return std::span<const AlteToken>(m_runs.constData() + record->firstRun, record->runCount);
+}
+
+void AlteTokenStore::clear(QTextDocument* document) {
+    if (document) {
+        for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+            block.setUserData(nullptr);
+        }
+    }
+    m_runs = QVector<AlteToken>();
+    m_garbage = 0;
+}
+
+void AlteTokenStore::collectGarbage(QTextDocument* document) {
+    if (!document) return;
+    qsizetype live = 0;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        if (const AlteLineRecord* line = record(block)) {
+            live += line->runCount;
+        }
+    }
+    m_garbage = m_runs.size() - live;
+    if (m_garbage >= kCompactMinGarbage && m_garbage * 2 > m_runs.size()) {
+        compact(document);
+    }
+}
+
+void AlteTokenStore::compact(QTextDocument* document) {
+    if (!document) return;
+    // Runs of replaced and deleted lines are simply not copied.
+    QVector<AlteToken> live;
+    live.reserve(m_runs.size() - m_garbage);
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        AlteLineRecord* line = record(block);
+        if (!line || line->runCount == 0) continue;
+        const qsizetype firstRun = live.size();
+        live.resize(firstRun + line->runCount);
+        std::copy_n(m_runs.constBegin() + line->firstRun, line->runCount, live.begin() + firstRun);
+        line->firstRun = quint32(firstRun);
+    }
+    m_runs = live;
+    m_garbage = 0;
+}
@@ -0,0 +1,130 @@
+#include "AlteTokenizerWorker.h"
+#include "AlteTrace.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QScopedArrayPointer>
+#include <climits>
+
+namespace {
+// Lines per published batch: large enough to keep queued signals cheap, small
+// enough that the visible part of the document is coloured early.
+const int kBatchLines = 2000;
+// Snapshots with fewer lines are tokenized sequentially; splitting them is not worth it.
+const int kParallelMinLines = 50000;
+// Smallest chunk handed to a pool thread.
+const int kMinChunkLines = 10000;
+}
+
+AlteTokenizerWorker::AlteTokenizerWorker(QObject* parent)
+    : QObject(parent), m_pool(this), m_latestVersion(0), m_longLineThreshold(INT_MAX) {
+}
+
+int AlteTokenizerWorker::tokenizeLine(const AlteGrammar& grammar, const QString& text, int entryState,
+                                      QVector<AlteToken>& tokens) const {
+    if (text.length() > m_longLineThreshold.loadRelaxed()) {
+        tokens.clear();
+        return grammar.scanBlockState(text, entryState);
+    }
+    return grammar.tokenizeLine(text, entryState, tokens);
+}
+
+bool AlteTokenizerWorker::tokenizeRange(quint64 version, const AlteGrammar& grammar, const QString& rawText,
+                                        const QVector<LineSpan>& spans, int first, int last, int entryState,
+                                        QVector<AlteLineTokens>& out) const {
+    ALTE_TRACE_ZONE("highlight", "tokenizeRange");
+    AlteGrammar::ProfileBatch profileBatch(grammar);
+    out.clear();
+    out.reserve(last - first);
+    int state = entryState;
+    for (int line = first; line < last; ++line) {
+        if ((line - first) % kBatchLines == 0 && m_latestVersion.loadRelaxed() != version) {
+            return false;
+        }
+        const QString text = rawText.mid(spans[line].start, spans[line].length);
+        AlteLineTokens lineTokens;
+        lineTokens.textHash = qHash(text);
+        lineTokens.entryState = state;
+        state = tokenizeLine(grammar, text, state, lineTokens.tokens);
+        lineTokens.exitState = state;
+        out.append(lineTokens);
+    }
+    return true;
+}
+
+void AlteTokenizerWorker::tokenize(quint64 version, QSharedPointer<const AlteGrammar> grammar, const QString& rawText, int blockCount) {
+    ALTE_TRACE_ZONE("highlight", "tokenize");
+    if (!grammar || m_latestVersion.loadRelaxed() != version) {
+        emit finished(version);
+        return;
+    }
+
+    QVector<LineSpan> spans;
+    spans.reserve(blockCount);
+    int lineStart = 0;
+    while (spans.size() < blockCount && lineStart <= rawText.size()) {
+        int lineEnd = rawText.indexOf(QChar::ParagraphSeparator, lineStart);
+        if (lineEnd < 0) lineEnd = rawText.size();
+        spans.append({lineStart, lineEnd - lineStart});
+        lineStart = lineEnd + 1;
+    }
+
+    const int chunkCount = qMin(int(spans.size()) / kMinChunkLines, m_pool.maxThreadCount());
+    if (spans.size() < kParallelMinLines || chunkCount < 2) {
+        // Sequential: publish each batch as soon as it is done, top of the file first.
+        QVector<AlteLineTokens> batch;
+        int state = 0;
+        for (int first = 0; first < spans.size(); first += kBatchLines) {
+            const int last = qMin(first + kBatchLines, int(spans.size()));
+            if (!tokenizeRange(version, *grammar, rawText, spans, first, last, state, batch)) break;
+            state = batch.last().exitState;
+            emit linesTokenized(version, first, batch);
+        }
+        emit finished(version);
+        return;
+    }
+
+    // Parallel: every chunk but the first starts from a guessed entry state of 0.
+    QVector<QVector<AlteLineTokens>> results(chunkCount);
+    QVector<int> chunkStarts(chunkCount + 1);
+    for (int i = 0; i <= chunkCount; ++i) {
+        chunkStarts[i] = int(qint64(spans.size()) * i / chunkCount);
+    }
+    QScopedArrayPointer<QSemaphore> chunkDone(new QSemaphore[chunkCount]);
+    for (int i = 0; i < chunkCount; ++i) {
+        m_pool.start(QRunnable::create([&, i]() {
+            tokenizeRange(version, *grammar, rawText, spans, chunkStarts[i], chunkStarts[i + 1], 0, results[i]);
+            chunkDone[i].release();
+        }));
+    }
+
+    // Reconcile in order, as each chunk comes in: where a chunk's guess differs
+    // from the real entry state, re-run it until a line is entered in the same
+    // state the guessed run used; from there on the guessed results are exact.
+    // The first chunk started from the real state and is published as is.
+    AlteGrammar::ProfileBatch profileBatch(*grammar);
+    int state = 0;
+    for (int i = 0; i < chunkCount; ++i) {
+        chunkDone[i].acquire();
+        if (m_latestVersion.loadRelaxed() != version) break;
+        QVector<AlteLineTokens>& chunk = results[i];
+        for (int k = 0; k < chunk.size() && chunk[k].entryState != state; ++k) {
+            const LineSpan& span = spans[chunkStarts[i] + k];
+            const QString text = rawText.mid(span.start, span.length);
+            chunk[k].entryState = state;
+            state = tokenizeLine(*grammar, text, state, chunk[k].tokens);
+            chunk[k].exitState = state;
+        }
+        if (chunk.isEmpty()) break; // Abandoned while tokenizing
+        state = chunk.last().exitState;
+
+        for (int first = 0; first < chunk.size(); first += kBatchLines) {
+            emit linesTokenized(version, chunkStarts[i] + first, chunk.mid(first, kBatchLines));
+        }
+        chunk.clear();
+    }
+    // Chunks still running refer to this frame; they stop at their next batch
+    // once the version is stale.
+    m_pool.waitForDone();
+    emit finished(version);
+}
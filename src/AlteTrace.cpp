@@ -0,0 +1,157 @@
+#include "AlteTrace.h"
+#include "AlteLog.h"
+#include <QCoreApplication>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+std::atomic<bool> AlteTrace::s_enabled{false};
+
+namespace {
+// Events kept per thread, so a recording left running cannot take all memory.
+const int kMaxEventsPerThread = 1 << 20;
+
+struct Event {
+    const char* category;
+    const char* name;
+    qint64 startNs;
+    qint64 endNs;
+};
+
+struct ThreadBuffer {
+    QMutex mutex; // Only contended while a recording is written out
+    QVector<Event> events;
+    quint64 recording = 0; // The recording the events belong to
+    int threadId = 0;
+    QString threadName;
+};
+
+const auto s_epoch = std::chrono::steady_clock::now();
+std::atomic<quint64> s_recording{0};
+QMutex s_registryMutex;
+// Shared with the owning thread, so the events of finished threads can still be written.
+std::vector<std::shared_ptr<ThreadBuffer>> s_buffers;
+int s_nextThreadId = 1;
+
+ThreadBuffer& threadBuffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer) {
+        buffer = std::make_shared<ThreadBuffer>();
+        QThread* thread = QThread::currentThread();
+        QCoreApplication* app = QCoreApplication::instance();
+        buffer->threadName = app && thread == app->thread() ? QStringLiteral("main") : thread->objectName();
+        QMutexLocker locker(&s_registryMutex);
+        buffer->threadId = s_nextThreadId++;
+        if (buffer->threadName.isEmpty()) {
+            buffer->threadName = QStringLiteral("thread %1").arg(buffer->threadId);
+        }
+        s_buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+void appendJsonString(QByteArray& out, const QByteArray& text) {
+    out += '"';
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (uchar(c) < 0x20) {
+            out += "\\u00";
+            out += QByteArray::number(uchar(c), 16).rightJustified(2, '0');
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+}
+
+qint64 AlteTrace::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch).count();
+}
+
+void AlteTrace::setEnabled(bool enabled) {
+    if (enabled && !isEnabled()) {
+        // Buffers see the new recording number on their next event and drop the old ones.
+        s_recording.fetch_add(1, std::memory_order_relaxed);
+        QMutexLocker locker(&s_registryMutex);
+        s_buffers.erase(std::remove_if(s_buffers.begin(), s_buffers.end(),
+                                       [](const std::shared_ptr<ThreadBuffer>& buffer) { return buffer.use_count() == 1; }),
+                        s_buffers.end());
+    }
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void AlteTrace::record(const char* category, const char* name, qint64 startNs, qint64 endNs) {
+    ThreadBuffer& buffer = threadBuffer();
+    const quint64 recording = s_recording.load(std::memory_order_relaxed);
+    QMutexLocker locker(&buffer.mutex);
+    if (buffer.recording != recording) {
+        buffer.events.clear();
+        buffer.recording = recording;
+    }
+    if (buffer.events.size() < kMaxEventsPerThread) {
+        buffer.events.append({category, name, startNs, endNs});
+    }
+}
+
+bool AlteTrace::writeJson(const QString& filePath) {
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcTrace) << "AlteTrace: Could not write trace" << filePath << ":" << file.errorString();
+        return false;
+    }
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    const quint64 recording = s_recording.load(std::memory_order_relaxed);
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    const auto separate = [&out, &first]() {
+        if (!first) out += ",\n";
+        first = false;
+    };
+
+    QMutexLocker registryLocker(&s_registryMutex);
+    int eventCount = 0;
+    for (const std::shared_ptr<ThreadBuffer>& buffer : s_buffers) {
+        QMutexLocker locker(&buffer->mutex);
+        if (buffer->recording != recording || buffer->events.isEmpty()) continue;
+        const QByteArray tid = QByteArray::number(buffer->threadId);
+        separate();
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"name\":";
+        appendJsonString(out, buffer->threadName.toUtf8());
+        out += "}}";
+        for (const Event& event : buffer->events) {
+            separate();
+            out += "{\"name\":";
+            appendJsonString(out, event.name);
+            out += ",\"cat\":";
+            appendJsonString(out, event.category);
+            // Timestamps are in microseconds.
+            out += ",\"ph\":\"X\",\"ts\":" + QByteArray::number(event.startNs / 1000.0, 'f', 3)
+                 + ",\"dur\":" + QByteArray::number((event.endNs - event.startNs) / 1000.0, 'f', 3)
+                 + ",\"pid\":" + pid + ",\"tid\":" + tid + "}";
+        }
+        eventCount += buffer->events.size();
+        if (out.size() > (1 << 20)) {
+            file.write(out);
+            out.clear();
+        }
+    }
+    registryLocker.unlock();
+
+    out += "]}\n";
+    file.write(out);
+    if (!file.commit()) {
+        qCWarning(lcTrace) << "AlteTrace: Could not write trace" << filePath << ":" << file.errorString();
+        return false;
+    }
+    qCInfo(lcTrace) << "AlteTrace: Wrote" << eventCount << "events to" << filePath;
+    return true;
+}
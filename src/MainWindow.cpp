@@ -13,55 +13,91 @@
 #include <QMessageBox>  // For QMessageBox
 #include <QFileInfo>    // For QFileInfo
 #include <QDir>         // For QDir
-#include <QDebug>       // For qWarning, qDebug
-#include <QTimer>       // For m_focusTimer
+#include <QDebug>       // For qCWarning, qCDebug
+#include <QTimer>       // For m_reloadTimer
 #include <QFont>        // For QFont in constructor
 #include <QMimeData>    // For QDragEnterEvent, QDropEvent
 #include <QUrl>         // For QDragEnterEvent, QDropEvent
 #include <QDragEnterEvent> // For dragEnterEvent parameter
 #include <QDropEvent>   // For dropEvent parameter
 #include <QScrollBar>   // For textEdit->verticalScrollBar()
+#include <QFileSystemWatcher> // For reloading files changed outside Alte
+#include <QTabWidget>   // For the document tabs
+#include <QTextBlock>   // For folding at the cursor
+#include <QCompleter>   // For word completion
+#include <QStringListModel>
+#include <QAbstractItemView>
+#include <QActionGroup>
+#include "AlteDocumentDiff.h"
+#include "AlteDocumentManager.h"
+#include "AlteHighlighterProfileDialog.h"
+#include "AlteProjectIndex.h"
+#include "AlteFocusGlow.h"
+#include "AlteLongLineLayout.h"
+#include "AlteTrace.h"
+#include "AlteLog.h"
+#include <QStatusBar>
 
 // Constructor Implementation
 MainWindow::MainWindow(AlteThemeManager* p_themeManager, QWidget *parent)
-    : QMainWindow(parent), m_themeManager(p_themeManager), m_focusTimer(nullptr), typewriterModeEnabled(false) {
-    setWindowTitle("Alte Editor"); // Will be updated by newFile()
+    : QMainWindow(parent), textEdit(nullptr), highlighter(nullptr), m_themeManager(p_themeManager),
+      typewriterModeEnabled(false), m_fileWatcher(nullptr), m_reloadTimer(nullptr),
+      m_themeWatcher(nullptr), m_themeReloadTimer(nullptr), m_tabWidget(nullptr),
+      m_documentManager(nullptr), m_profileDialog(nullptr), m_completer(nullptr), m_completionModel(nullptr),
+      m_projectIndex(nullptr), m_firstFramePainted(false) {
+    setWindowTitle("Alte Editor - " + tr("Untitled"));
     setWindowIcon(QIcon(":/icons/alte_icon.png")); // Set window icon from QRC
 
-    textEdit = new QTextEdit(this);
-    setCentralWidget(textEdit);
-
-    // Initialize highlighter with theme manager and a default language
+    m_glowColorId = AlteTheme::registerColorName("cyberPulse");
+    m_bracketColorId = AlteTheme::registerColorName("selection_background");
+    m_borderColorId = AlteTheme::registerColorName("border");
     if (m_themeManager) {
-        // Apply editor-specific font
-        QFont editorFont = m_themeManager->getEditorFont(textEdit->font());
-        textEdit->setFont(editorFont);
-
-        // Default to "python" or "cpp" for testing
-        highlighter = new AlteSyntaxHighlighter(textEdit->document(), m_themeManager, "python");
-
-        m_originalTextEditStyleSheet = resolveTextEditStyleSheet(false); // false for not using glow color
-        textEdit->setStyleSheet(m_originalTextEditStyleSheet); // Apply it once to be sure
-
+        m_textEditStyleSheet = resolveTextEditStyleSheet();
     } else {
-        qWarning() << "MainWindow: ThemeManager is null, syntax highlighter and focus glow might not work correctly.";
-        // Fallback if themeManager is somehow null - ensure highlighter is still created
-        highlighter = new AlteSyntaxHighlighter(textEdit->document(), nullptr, ""); // Pass nullptr for themeManager
+        qCWarning(lcTheme) << "MainWindow: ThemeManager is null, syntax highlighter and focus glow might not work correctly.";
     }
 
-    textEdit->installEventFilter(this);
-    m_focusTimer = new QTimer(this);
-    m_focusTimer->setSingleShot(true);
-    connect(m_focusTimer, &QTimer::timeout, this, &MainWindow::resetTextEditBorderSlot);
-    connect(textEdit, &QTextEdit::cursorPositionChanged, this, &MainWindow::updateTypewriterCenter);
+    // All documents of the window share one process, one theme and one memory budget.
+    m_documentManager = new AlteDocumentManager(this);
+    connect(m_documentManager, &AlteDocumentManager::changedOnDisk, this, &MainWindow::reloadDocumentFromDisk);
+    m_tabWidget = new QTabWidget(this);
+    m_tabWidget->setDocumentMode(true);
+    m_tabWidget->setTabsClosable(true);
+    m_tabWidget->setMovable(true);
+    setCentralWidget(m_tabWidget);
+    connect(m_tabWidget, &QTabWidget::tabCloseRequested, this, &MainWindow::closeTab);
+    connect(m_tabWidget, &QTabWidget::currentChanged, this, &MainWindow::onCurrentTabChanged);
+
+    // External modifications are coalesced: editors often write a file in several steps.
+    m_fileWatcher = new QFileSystemWatcher(this);
+    m_reloadTimer = new QTimer(this);
+    m_reloadTimer->setSingleShot(true);
+    m_reloadTimer->setInterval(100);
+    connect(m_fileWatcher, &QFileSystemWatcher::fileChanged, this, &MainWindow::onFileChangedOnDisk);
+    connect(m_reloadTimer, &QTimer::timeout, this, &MainWindow::reloadFromDisk);
+
+    // The theme file is reloaded when it changes, for designing themes live.
+    m_themeWatcher = new QFileSystemWatcher(this);
+    m_themeReloadTimer = new QTimer(this);
+    m_themeReloadTimer->setSingleShot(true);
+    m_themeReloadTimer->setInterval(100);
+    connect(m_themeWatcher, &QFileSystemWatcher::fileChanged, m_themeReloadTimer, qOverload<>(&QTimer::start));
+    connect(m_themeReloadTimer, &QTimer::timeout, this, [this]() {
+        if (m_themeManager) switchTheme(m_themeManager->themeFilePath());
+    });
+    watchThemeFile();
+
+    // Opt-in: nothing is indexed until a folder is chosen.
+    m_projectIndex = new AlteProjectIndex(m_themeManager, this);
+    connect(m_projectIndex, &AlteProjectIndex::filesIndexed, this, [this](int fileCount) {
+        statusBar()->showMessage(tr("Project index: %1 files").arg(fileCount), 3000);
+    });
+
+    createEditor(); // First, untitled document
 
     setAcceptDrops(true); // Enable Drag & Drop
     createActions();
     createMenus();
-
-    currentFilePath = QString();
-    // newFile() will be called after show, which sets the initial title and content
-    // textEdit->document()->setModified(false); // Set in newFile
 }
 
 // Destructor Implementation
@@ -73,100 +109,108 @@ MainWindow::~MainWindow() {
     // document (and subsequently textEdit via its own parentage to MainWindow) is destroyed.
     // Explicitly deleting it here would likely cause a double free.
 
-    // m_focusTimer is parented to this, will be deleted by Qt.
-    // textEdit is parented to this, will be deleted by Qt.
+    // Editors are owned by m_tabWidget, which is parented to this.
     // All QAction members are parented to this, will be deleted by Qt.
 }
 
 // closeEvent Implementation
 void MainWindow::closeEvent(QCloseEvent *event) {
-    if (maybeSave()) {
-        event->accept();
-    } else {
-        event->ignore();
-    }
-}
-
-// eventFilter Implementation
-bool MainWindow::eventFilter(QObject *obj, QEvent *event) {
-    if (obj == textEdit) {
-        if (event->type() == QEvent::FocusIn) {
-            applyTextEditFocusGlow();
-            m_focusTimer->start(250); // Glow duration in ms
-        } else if (event->type() == QEvent::FocusOut) {
-            m_focusTimer->stop();
-            resetTextEditBorderSlot(); // Use the slot directly
+    for (int i = 0; i < m_tabWidget->count(); ++i) {
+        if (editorAt(i)->document()->isModified()) {
+            m_tabWidget->setCurrentIndex(i);
+            if (!maybeSave()) {
+                event->ignore();
+                return;
+            }
         }
     }
-    return QMainWindow::eventFilter(obj, event);
+    event->accept();
 }
 
-// resetTextEditBorderSlot Implementation
-void MainWindow::resetTextEditBorderSlot() {
-    if (m_themeManager && !m_originalTextEditStyleSheet.isEmpty()) {
-        textEdit->setStyleSheet(m_originalTextEditStyleSheet);
-    } else if (m_themeManager) { // Fallback if m_originalTextEditStyleSheet was empty
-        textEdit->setStyleSheet(resolveTextEditStyleSheet(false));
+void MainWindow::paintEvent(QPaintEvent *event) {
+    QMainWindow::paintEvent(event);
+    if (!m_firstFramePainted) {
+        m_firstFramePainted = true;
+        // Queued, so the frame is flushed to the screen first.
+        QTimer::singleShot(0, this, &MainWindow::firstFramePainted);
     }
-    // If m_themeManager is null, no easy way to reset to a themed style.
 }
 
 // newFile Implementation
 void MainWindow::newFile() {
-    if (maybeSave()) {
-        textEdit->clear();
-        currentFilePath.clear();
-        // Python sample code for testing syntax highlighting
-        textEdit->setPlainText(
-            "#!/usr/bin/env python3\n\n"
-            "class Greeter:\n"
-            "    \"\"\"A simple greeter class\"\"\"\n"
-            "    def __init__(self, name):\n"
-            "        self.name = name  # Instance variable\n\n"
-            "    def greet(self, loud=False):\n"
-            "        # This is a single line comment\n"
-            "        if loud:\n"
-            "            greeting = f'HELLO, {self.name.upper()}!'\n"
-            "        else:\n"
-            "            greeting = f'Hello, {self.name}'\n"
-            "        print(greeting) # Print the greeting\n"
-            "        return 0.0 # Return a float\n\n"
-            "# Main execution\n"
-            "if __name__ == \"__main__\":\n"
-            "    player = Greeter(\"Alte User\")\n"
-            "    player.greet()\n"
-            "    player.greet(loud=True)\n"
-            "    # Test numbers: 123, 0x1A, 0.45, 1e-3\n"
-            "    number_test = 123 + 0x1A - 0.45 * 1e-3\n"
-        );
-        setWindowTitle("Alte Editor - Untitled.py"); // Suggest .py for Python
-        textEdit->document()->setModified(false);
-        // If language switching is implemented later, call highlighter->setCurrentLanguage("python", themeManager);
+    // Reuse an untouched untitled tab, otherwise open a new one.
+    if (!currentFilePath.isEmpty() || textEdit->document()->isModified()) {
+        m_tabWidget->setCurrentWidget(createEditor());
     }
+    textEdit->clear();
+    currentFilePath.clear();
+    if (AlteDocumentManager::Document* document = m_documentManager->document(textEdit)) {
+        document->filePath.clear();
+    }
+    watchCurrentFile();
+    setWindowTitle("Alte Editor - " + tr("Untitled"));
+    textEdit->document()->setModified(false);
+    updateTabTitle(textEdit);
 }
 
 // openFile Implementation
 void MainWindow::openFile() {
-    if (maybeSave()) {
-        QString filePath = QFileDialog::getOpenFileName(this, tr("Open File"), QDir::homePath(), tr("Text Files (*.txt);;All Files (*)"));
-        if (!filePath.isEmpty()) {
-            QFile file(filePath);
-            if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-                QTextStream in(&file);
-                textEdit->setPlainText(in.readAll());
-                file.close();
-                currentFilePath = filePath;
-                setWindowTitle("Alte Editor - " + QFileInfo(filePath).fileName());
-                textEdit->document()->setModified(false);
-            } else {
-                QMessageBox::warning(this, tr("Error"), tr("Could not open file: ") + file.errorString());
-            }
+    QString filePath = QFileDialog::getOpenFileName(this, tr("Open File"), QDir::homePath(), tr("Text Files (*.txt);;All Files (*)"));
+    if (!filePath.isEmpty()) {
+        openFileInTab(filePath);
+    }
+}
+
+bool MainWindow::openFileInTab(const QString &filePath) {
+    ALTE_TRACE_ZONE("io", "open");
+    if (AlteDocumentManager::Document* existing = m_documentManager->documentForPath(filePath)) {
+        m_tabWidget->setCurrentWidget(existing->editor);
+        return true;
+    }
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QMessageBox::warning(this, tr("Error"), tr("Could not open file: ") + file.errorString());
+        return false;
+    }
+    QTextStream in(&file);
+    const QString content = in.readAll();
+    file.close();
+
+    // An untouched untitled tab is replaced instead of piling up next to the new one.
+    if (!currentFilePath.isEmpty() || textEdit->document()->isModified()) {
+        m_tabWidget->setCurrentWidget(createEditor());
+    }
+    AlteDocumentManager::Document* document = m_documentManager->document(textEdit);
+    const QString firstLine = content.left(content.indexOf(QLatin1Char('\n')));
+    if (m_themeManager && document) {
+        // Switch language on an empty document so only the new content is highlighted.
+        textEdit->clear();
+        document->languageName = m_themeManager->detectLanguage(filePath, firstLine, content);
+        highlighter->setCurrentLanguage(document->languageName, m_themeManager);
+        if (m_profileDialog) {
+            m_profileDialog->setGrammar(highlighter->grammar());
         }
     }
+    // Minified files and the like are laid out unwrapped, a visible slice at a time.
+    if (highlighter && AlteLongLineLayout::hasLongLine(content, highlighter->longLineThreshold())) {
+        AlteLongLineLayout::install(textEdit, highlighter->longLineThreshold());
+    }
+    textEdit->setPlainText(content);
+    currentFilePath = filePath;
+    if (document) {
+        document->filePath = filePath;
+    }
+    setWindowTitle("Alte Editor - " + QFileInfo(filePath).fileName());
+    textEdit->document()->setModified(false);
+    watchCurrentFile();
+    updateTabTitle(textEdit);
+    QTimer::singleShot(0, m_documentManager, &AlteDocumentManager::enforceBudget);
+    return true;
 }
 
 // saveFileInternal Implementation
 bool MainWindow::saveFileInternal(const QString &filePath) {
+    ALTE_TRACE_ZONE("io", "save");
     QFile file(filePath);
     // Ensure text mode for consistent line endings (LF on Unix, CRLF on Windows)
     if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
@@ -176,6 +220,12 @@ bool MainWindow::saveFileInternal(const QString &filePath) {
         currentFilePath = filePath;
         setWindowTitle("Alte Editor - " + QFileInfo(filePath).fileName());
         textEdit->document()->setModified(false);
+        if (AlteDocumentManager::Document* document = m_documentManager->document(textEdit)) {
+            document->filePath = filePath;
+        }
+        watchCurrentFile(); // Records the new mtime so our own write is not reloaded
+        m_projectIndex->refreshFile(filePath);
+        updateTabTitle(textEdit);
         return true;
     } else {
         QMessageBox::warning(this, tr("Error"), tr("Could not save file: ") + file.errorString());
@@ -243,38 +293,70 @@ void MainWindow::createActions() {
     saveAsAction->setShortcuts(QKeySequence::SaveAs);
     connect(saveAsAction, &QAction::triggered, this, &MainWindow::saveFileAs);
 
+    indexFolderAction = new QAction(tr("&Index Project Folder..."), this);
+    connect(indexFolderAction, &QAction::triggered, this, &MainWindow::indexProjectFolder);
+
+    closeTabAction = new QAction(tr("&Close"), this);
+    closeTabAction->setShortcuts(QKeySequence::Close);
+    connect(closeTabAction, &QAction::triggered, this, [this]() { closeTab(m_tabWidget->currentIndex()); });
+
     exitAction = new QAction(tr("E&xit"), this);
     exitAction->setShortcuts(QKeySequence::Quit);
     connect(exitAction, &QAction::triggered, qApp, &QApplication::closeAllWindows);
 
     undoAction = new QAction(tr("&Undo"), this);
     undoAction->setShortcuts(QKeySequence::Undo);
-    connect(undoAction, &QAction::triggered, textEdit, &QTextEdit::undo);
+    connect(undoAction, &QAction::triggered, this, [this]() { textEdit->undo(); });
 
     redoAction = new QAction(tr("&Redo"), this);
     redoAction->setShortcuts(QKeySequence::Redo);
-    connect(redoAction, &QAction::triggered, textEdit, &QTextEdit::redo);
+    connect(redoAction, &QAction::triggered, this, [this]() { textEdit->redo(); });
 
     cutAction = new QAction(tr("Cu&t"), this);
     cutAction->setShortcuts(QKeySequence::Cut);
-    connect(cutAction, &QAction::triggered, textEdit, &QTextEdit::cut);
+    connect(cutAction, &QAction::triggered, this, [this]() { textEdit->cut(); });
 
     copyAction = new QAction(tr("&Copy"), this);
     copyAction->setShortcuts(QKeySequence::Copy);
-    connect(copyAction, &QAction::triggered, textEdit, &QTextEdit::copy);
+    connect(copyAction, &QAction::triggered, this, [this]() { textEdit->copy(); });
 
     pasteAction = new QAction(tr("&Paste"), this);
     pasteAction->setShortcuts(QKeySequence::Paste);
-    connect(pasteAction, &QAction::triggered, textEdit, &QTextEdit::paste);
+    connect(pasteAction, &QAction::triggered, this, [this]() { textEdit->paste(); });
 
     selectAllAction = new QAction(tr("Select &All"), this);
     selectAllAction->setShortcuts(QKeySequence::SelectAll);
-    connect(selectAllAction, &QAction::triggered, textEdit, &QTextEdit::selectAll);
+    connect(selectAllAction, &QAction::triggered, this, [this]() { textEdit->selectAll(); });
 
     typewriterModeAction = new QAction(tr("Typewriter Mode"), this);
     typewriterModeAction->setCheckable(true);
     typewriterModeAction->setShortcut(QKeySequence("Ctrl+Shift+T"));
     connect(typewriterModeAction, &QAction::triggered, this, &MainWindow::toggleTypewriterMode);
+
+    highlighterProfileAction = new QAction(tr("Highlighter &Profile..."), this);
+    connect(highlighterProfileAction, &QAction::triggered, this, &MainWindow::showHighlighterProfile);
+
+    recordTraceAction = new QAction(tr("Record &Trace"), this);
+    recordTraceAction->setCheckable(true);
+    recordTraceAction->setChecked(AlteTrace::isEnabled());
+    connect(recordTraceAction, &QAction::toggled, this, &MainWindow::recordTrace);
+
+    foldAction = new QAction(tr("&Fold"), this);
+    foldAction->setShortcut(QKeySequence("Ctrl+Shift+["));
+    connect(foldAction, &QAction::triggered, this, &MainWindow::foldAtCursor);
+
+    unfoldAction = new QAction(tr("U&nfold"), this);
+    unfoldAction->setShortcut(QKeySequence("Ctrl+Shift+]"));
+    connect(unfoldAction, &QAction::triggered, this, &MainWindow::unfoldAtCursor);
+
+    completeWordAction = new QAction(tr("Complete &Word"), this);
+    completeWordAction->setShortcut(QKeySequence("Ctrl+Space"));
+    connect(completeWordAction, &QAction::triggered, this, &MainWindow::completeWord);
+
+    unfoldAllAction = new QAction(tr("Unfold &All"), this);
+    connect(unfoldAllAction, &QAction::triggered, this, [this]() {
+        if (highlighter) highlighter->unfoldAll();
+    });
 }
 
 // createMenus Implementation
@@ -284,6 +366,9 @@ void MainWindow::createMenus() {
     fileMenu->addAction(openAction);
     fileMenu->addAction(saveAction);
     fileMenu->addAction(saveAsAction);
+    fileMenu->addAction(closeTabAction);
+    fileMenu->addSeparator();
+    fileMenu->addAction(indexFolderAction);
     fileMenu->addSeparator();
     fileMenu->addAction(exitAction);
 
@@ -296,6 +381,8 @@ void MainWindow::createMenus() {
     editMenu->addAction(pasteAction);
     editMenu->addSeparator();
     editMenu->addAction(selectAllAction);
+    editMenu->addSeparator();
+    editMenu->addAction(completeWordAction);
 
     QMenu *viewMenu = menuBar()->addMenu(tr("&View"));
     QAction *zoomInAction = new QAction(tr("Zoom &In"), this);
@@ -311,38 +398,220 @@ void MainWindow::createMenus() {
     viewMenu->addAction(zoomOutAction);
     viewMenu->addSeparator(); // Optional: add a separator before the new action
     viewMenu->addAction(typewriterModeAction);
+    viewMenu->addSeparator();
+    viewMenu->addAction(foldAction);
+    viewMenu->addAction(unfoldAction);
+    viewMenu->addAction(unfoldAllAction);
+    viewMenu->addSeparator();
+    viewMenu->addAction(highlighterProfileAction);
+    viewMenu->addAction(recordTraceAction);
+
+    if (m_themeManager) {
+        // Listed when opened, so startup does not read the theme directory.
+        QMenu *themeMenu = viewMenu->addMenu(tr("&Theme"));
+        connect(themeMenu, &QMenu::aboutToShow, this, [this, themeMenu]() { populateThemeMenu(themeMenu); });
+    }
+}
+
+void MainWindow::populateThemeMenu(QMenu *themeMenu) {
+    themeMenu->clear();
+    QActionGroup *themeGroup = new QActionGroup(themeMenu);
+    const QString themePath = m_themeManager->themeFilePath();
+    // Bundled themes have no file to canonicalize.
+    const QString currentTheme = QFileInfo::exists(themePath) ? QFileInfo(themePath).canonicalFilePath() : themePath;
+    const QMap<QString, QString> themes = m_themeManager->getAvailableThemes();
+    for (auto it = themes.constBegin(); it != themes.constEnd(); ++it) {
+        QAction *themeAction = themeMenu->addAction(it.key());
+        themeAction->setCheckable(true);
+        themeAction->setChecked(it.value() == currentTheme);
+        themeGroup->addAction(themeAction);
+        const QString themeFilePath = it.value();
+        connect(themeAction, &QAction::triggered, this, [this, themeFilePath]() { switchTheme(themeFilePath); });
+    }
+    // The previous group, whose actions clear() deleted.
+    for (QActionGroup *group : themeMenu->findChildren<QActionGroup*>(QString(), Qt::FindDirectChildrenOnly)) {
+        if (group != themeGroup) group->deleteLater();
+    }
+}
+
+// Restyles the open documents without re-highlighting them: each highlighter
+// swaps its format table and formats again only what is on screen.
+void MainWindow::switchTheme(const QString &themeFilePath) {
+    ALTE_TRACE_ZONE("theme", "switchTheme");
+    if (!m_themeManager) return;
+    if (!m_themeManager->loadTheme(themeFilePath)) {
+        statusBar()->showMessage(tr("Could not load theme %1").arg(QFileInfo(themeFilePath).fileName()), 3000);
+        watchThemeFile(); // Still watch a theme that is being edited
+        return;
+    }
+    m_themeManager->applyTheme(qApp);
+    m_textEditStyleSheet = resolveTextEditStyleSheet();
+    const QColor glowColor = m_themeManager->color(m_glowColorId);
+    for (AlteDocumentManager::Document* document : m_documentManager->documents()) {
+        document->editor->setStyleSheet(m_textEditStyleSheet);
+        if (AlteFocusGlow* glow = document->editor->findChild<AlteFocusGlow*>()) {
+            glow->setColor(glowColor);
+        }
+        if (document->highlighter) {
+            document->highlighter->applyTheme(m_themeManager);
+        }
+    }
+    updateBracketMatch();
+    watchThemeFile();
+}
+
+void MainWindow::watchThemeFile() {
+    if (!m_themeWatcher->files().isEmpty()) {
+        m_themeWatcher->removePaths(m_themeWatcher->files());
+    }
+    // Editors that save by replacing the file drop the watch, so it is renewed after each load.
+    const QString themeFilePath = m_themeManager ? m_themeManager->themeFilePath() : QString();
+    if (!themeFilePath.isEmpty() && !themeFilePath.startsWith(QLatin1Char(':')) && QFileInfo::exists(themeFilePath)) {
+        m_themeWatcher->addPath(themeFilePath);
+    }
+}
+
+void MainWindow::showHighlighterProfile() {
+    if (!m_profileDialog) {
+        m_profileDialog = new AlteHighlighterProfileDialog(this);
+    }
+    m_profileDialog->setGrammar(highlighter ? highlighter->grammar() : QSharedPointer<const AlteGrammar>());
+    m_profileDialog->show();
+    m_profileDialog->raise();
+    m_profileDialog->activateWindow();
+}
+
+void MainWindow::updateBracketMatch() {
+    QTextEdit* editor = qobject_cast<QTextEdit*>(sender());
+    if (!editor) editor = textEdit;
+    const AlteDocumentManager::Document* document = m_documentManager->document(editor);
+    if (!editor || !document || !document->highlighter) return;
+
+    QList<QTextEdit::ExtraSelection> selections;
+    const QColor color = m_themeManager ? m_themeManager->color(m_bracketColorId, Qt::lightGray)
+                                        : QColor(Qt::lightGray);
+    const int position = editor->textCursor().position();
+    // A bracket after the cursor takes precedence over one before it.
+    for (const int candidate : {position, position - 1}) {
+        if (candidate < 0) continue;
+        const int match = document->highlighter->matchingBracket(candidate);
+        if (match < 0) continue;
+        for (const int bracket : {candidate, match}) {
+            QTextEdit::ExtraSelection selection;
+            selection.cursor = QTextCursor(editor->document());
+            selection.cursor.setPosition(bracket);
+            selection.cursor.setPosition(bracket + 1, QTextCursor::KeepAnchor);
+            selection.format.setBackground(color);
+            selections.append(selection);
+        }
+        break;
+    }
+    editor->setExtraSelections(selections);
+}
+
+void MainWindow::foldAtCursor() {
+    if (!textEdit || !highlighter) return;
+    QTextBlock block = textEdit->textCursor().block();
+    // Fold the innermost region that contains the cursor line.
+    for (; block.isValid(); block = block.previous()) {
+        const int end = highlighter->foldEnd(block);
+        if (end >= textEdit->textCursor().blockNumber() && block.next().isVisible()) break;
+    }
+    if (!block.isValid() || !highlighter->fold(block)) return;
+    // Keep the cursor out of the hidden lines.
+    QTextCursor cursor = textEdit->textCursor();
+    if (cursor.block() != block) {
+        cursor.setPosition(block.position() + block.length() - 1);
+        textEdit->setTextCursor(cursor);
+    }
+}
+
+void MainWindow::unfoldAtCursor() {
+    if (!textEdit || !highlighter) return;
+    highlighter->unfold(textEdit->textCursor().block());
+}
+
+void MainWindow::completeWord() {
+    if (!textEdit || !highlighter) return;
+    const QTextCursor cursor = textEdit->textCursor();
+    const QString text = cursor.block().text();
+    const int end = cursor.positionInBlock();
+    int start = end;
+    while (start > 0 && (text.at(start - 1).isLetterOrNumber() || text.at(start - 1) == QLatin1Char('_'))) {
+        --start;
+    }
+    m_completionPrefix = text.mid(start, end - start);
+    // Words of this document first, then those only other project files use.
+    QStringList candidates = highlighter->completions(m_completionPrefix, 50);
+    for (const QString& candidate : m_projectIndex->complete(m_completionPrefix, 50)) {
+        if (candidates.size() >= 50) break;
+        if (!candidates.contains(candidate)) {
+            candidates.append(candidate);
+        }
+    }
+    if (candidates.isEmpty()) return;
+
+    if (!m_completer) {
+        m_completionModel = new QStringListModel(this);
+        m_completer = new QCompleter(m_completionModel, this);
+        m_completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+        connect(m_completer, QOverload<const QString&>::of(&QCompleter::activated), this, &MainWindow::insertCompletion);
+    }
+    m_completionModel->setStringList(candidates);
+    m_completer->setWidget(textEdit);
+    QRect rect = textEdit->cursorRect();
+    rect.setWidth(m_completer->popup()->sizeHintForColumn(0) + m_completer->popup()->verticalScrollBar()->sizeHint().width());
+    m_completer->complete(rect);
+}
+
+// Stopping a recording asks where to write it, as Chrome trace JSON.
+void MainWindow::recordTrace(bool enabled) {
+    if (enabled) {
+        AlteTrace::setEnabled(true);
+        statusBar()->showMessage(tr("Recording trace"), 3000);
+        return;
+    }
+    AlteTrace::setEnabled(false);
+    const QString filePath = QFileDialog::getSaveFileName(this, tr("Save Trace"), QDir::homePath() + "/alte-trace.json",
+                                                          tr("Trace Files (*.json);;All Files (*)"));
+    if (filePath.isEmpty()) return;
+    if (AlteTrace::writeJson(filePath)) {
+        statusBar()->showMessage(tr("Trace saved to %1").arg(filePath), 3000);
+    } else {
+        QMessageBox::warning(this, tr("Error"), tr("Could not save trace to %1").arg(filePath));
+    }
+}
+
+void MainWindow::indexProjectFolder() {
+    const QString folder = QFileDialog::getExistingDirectory(this, tr("Index Project Folder"),
+                                                             m_projectIndex->folder().isEmpty() ? QDir::homePath() : m_projectIndex->folder());
+    if (!folder.isEmpty()) {
+        m_projectIndex->openFolder(folder);
+    }
+}
+
+void MainWindow::insertCompletion(const QString &completion) {
+    QTextEdit* editor = qobject_cast<QTextEdit*>(m_completer->widget());
+    if (!editor) return;
+    QTextCursor cursor = editor->textCursor();
+    cursor.insertText(completion.mid(m_completionPrefix.length()));
+    editor->setTextCursor(cursor);
 }
 
 // resolveTextEditStyleSheet Implementation
-QString MainWindow::resolveTextEditStyleSheet(bool useGlowColor) {
+QString MainWindow::resolveTextEditStyleSheet() {
     if (!m_themeManager) return "";
 
     QString baseStyle = m_themeManager->getStyleSheet("QPlainTextEdit, QTextEdit");
     if (baseStyle.isEmpty()) {
-        qWarning() << "resolveTextEditStyleSheet: Could not get base style for QPlainTextEdit, QTextEdit";
-        return QString("border: 1px solid %1;").arg(useGlowColor ? m_themeManager->getColor("cyberPulse").name() : m_themeManager->getColor("border").name());
+        qCWarning(lcTheme) << "resolveTextEditStyleSheet: Could not get base style for QPlainTextEdit, QTextEdit";
+        return QString("border: 1px solid %1;").arg(m_themeManager->color(m_borderColorId).name());
     }
 
-    QColor borderColorToUse = useGlowColor ? m_themeManager->getColor("cyberPulse") : m_themeManager->getColor("border");
-    baseStyle.replace("%%border%%", borderColorToUse.name());
-    baseStyle.replace("%%alternateBase%%", m_themeManager->getColor("alternateBase").name());
-    baseStyle.replace("%%lightMist%%", m_themeManager->getColor("lightMist").name());
-    baseStyle.replace("%%cyberPulse%%", m_themeManager->getColor("cyberPulse").name());
-    baseStyle.replace("%%highlightedText%%", m_themeManager->getColor("highlightedText").name());
-
+    // Placeholders were filled in when the theme was compiled.
     return baseStyle;
 }
 
-// applyTextEditFocusGlow Implementation
-void MainWindow::applyTextEditFocusGlow() {
-    if (!m_themeManager) return;
-    if (m_originalTextEditStyleSheet.isEmpty()) {
-         m_originalTextEditStyleSheet = resolveTextEditStyleSheet(false);
-    }
-    QString glowStyle = resolveTextEditStyleSheet(true);
-    textEdit->setStyleSheet(glowStyle);
-}
-
 void MainWindow::toggleTypewriterMode() {
     typewriterModeEnabled = !typewriterModeEnabled;
     typewriterModeAction->setChecked(typewriterModeEnabled);
@@ -397,31 +666,207 @@ void MainWindow::dragEnterEvent(QDragEnterEvent *event) {
 void MainWindow::dropEvent(QDropEvent *event) {
     const QMimeData *mimeData = event->mimeData();
     if (mimeData->hasUrls()) {
-        if (!maybeSave()) { // Use the existing maybeSave method
-             event->ignore();
-             return;
-        }
-        const QList<QUrl> urls = mimeData->urls();
-        if (!urls.isEmpty()) {
-            const QUrl url = urls.first(); // Process only the first file for simplicity
+        bool openedAny = false;
+        for (const QUrl &url : mimeData->urls()) {
             if (url.isLocalFile()) {
-                const QString filePath = url.toLocalFile();
-                QFile file(filePath);
-                if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-                    QTextStream in(&file);
-                    QString fileContent = in.readAll();
-                    textEdit->setPlainText(fileContent);
-                    currentFilePath = filePath; // Update currentFilePath
-                    // Update window title using the logic similar to openFile()
-                    setWindowTitle("Alte Editor - " + QFileInfo(filePath).fileName());
-                    textEdit->document()->setModified(false);
-                    file.close();
-                    event->acceptProposedAction();
-                } else {
-                     QMessageBox::warning(this, tr("Open File Error"), // Use tr() for translatable strings
-                                          tr("Could not open dropped file: %1").arg(file.errorString()));
-                }
+                openedAny = openFileInTab(url.toLocalFile()) || openedAny;
             }
         }
+        if (openedAny) {
+            event->acceptProposedAction();
+        }
+    }
+}
+
+QTextEdit* MainWindow::createEditor() {
+    QTextEdit* editor = new QTextEdit(m_tabWidget);
+    AlteSyntaxHighlighter* editorHighlighter = nullptr;
+    if (m_themeManager) {
+        // Apply editor-specific font
+        editor->setFont(m_themeManager->getEditorFont(editor->font()));
+        // New documents have no language until they are saved or opened as a file.
+        editorHighlighter = new AlteSyntaxHighlighter(editor->document(), m_themeManager, QString());
+        // Applied once; focus changes only repaint the glow overlay.
+        editor->setStyleSheet(m_textEditStyleSheet);
+        AlteFocusGlow* glow = new AlteFocusGlow(editor);
+        glow->setColor(m_themeManager->color(m_glowColorId));
+    } else {
+        editorHighlighter = new AlteSyntaxHighlighter(editor->document(), nullptr, ""); // Pass nullptr for themeManager
+    }
+    editorHighlighter->attachEditor(editor);
+    connect(editor, &QTextEdit::cursorPositionChanged, this, &MainWindow::updateTypewriterCenter);
+    connect(editor, &QTextEdit::cursorPositionChanged, this, &MainWindow::updateBracketMatch);
+    connect(editor->document(), &QTextDocument::modificationChanged, this, [this, editor]() { updateTabTitle(editor); });
+
+    AlteDocumentManager::Document* document = m_documentManager->addDocument(editor, editorHighlighter);
+    m_tabWidget->addTab(editor, tr("Untitled"));
+    if (!textEdit) {
+        textEdit = editor;
+        highlighter = editorHighlighter;
+        m_documentManager->activate(editor);
+    }
+    return editor;
+}
+
+QTextEdit* MainWindow::editorAt(int index) const {
+    return qobject_cast<QTextEdit*>(m_tabWidget->widget(index));
+}
+
+void MainWindow::updateTabTitle(QTextEdit *editor) {
+    const int index = m_tabWidget->indexOf(editor);
+    const AlteDocumentManager::Document* document = m_documentManager->document(editor);
+    if (index < 0 || !document) return;
+    QString title = document->filePath.isEmpty() ? tr("Untitled") : QFileInfo(document->filePath).fileName();
+    if (editor->document()->isModified()) {
+        title += "*";
+    }
+    m_tabWidget->setTabText(index, title);
+    m_tabWidget->setTabToolTip(index, document->filePath);
+}
+
+void MainWindow::onCurrentTabChanged(int index) {
+    QTextEdit* editor = editorAt(index);
+    AlteDocumentManager::Document* document = m_documentManager->document(editor);
+    if (!editor || !document) return;
+
+    m_documentManager->activate(editor);
+    textEdit = editor;
+    highlighter = document->highlighter;
+    currentFilePath = document->filePath;
+    setWindowTitle("Alte Editor - " + (currentFilePath.isEmpty() ? tr("Untitled") : QFileInfo(currentFilePath).fileName()));
+    if (typewriterModeEnabled) {
+        updateTypewriterCenter();
+    }
+    if (m_profileDialog) {
+        m_profileDialog->setGrammar(highlighter ? highlighter->grammar() : QSharedPointer<const AlteGrammar>());
+    }
+    // Shrinking other documents can wait until the switch has been painted.
+    QTimer::singleShot(0, m_documentManager, &AlteDocumentManager::enforceBudget);
+}
+
+void MainWindow::closeTab(int index) {
+    QTextEdit* editor = editorAt(index);
+    if (!editor) return;
+    if (editor->document()->isModified()) {
+        m_tabWidget->setCurrentIndex(index);
+        if (!maybeSave()) return;
+    }
+    if (m_tabWidget->count() == 1) {
+        // Keep one document open; closing the last tab leaves an empty untitled one.
+        createEditor();
+    }
+    AlteDocumentManager::Document* document = m_documentManager->document(editor);
+    if (document && !document->filePath.isEmpty()) {
+        m_fileWatcher->removePath(document->filePath);
+    }
+    m_documentManager->removeDocument(editor);
+    if (textEdit == editor) {
+        textEdit = nullptr;
+        highlighter = nullptr;
+    }
+    m_tabWidget->removeTab(m_tabWidget->indexOf(editor));
+    editor->deleteLater();
+    if (!textEdit) {
+        onCurrentTabChanged(m_tabWidget->currentIndex());
+    }
+}
+
+void MainWindow::watchCurrentFile() {
+    AlteDocumentManager::Document* document = m_documentManager->document(textEdit);
+    if (!document) return;
+    // Drop watches of paths no open document refers to any more (e.g. after Save As).
+    for (const QString &watchedPath : m_fileWatcher->files()) {
+        if (!m_documentManager->documentForPath(watchedPath)) {
+            m_fileWatcher->removePath(watchedPath);
+        }
+    }
+    document->diskModified = QDateTime();
+    document->diskSize = -1;
+    if (document->filePath.isEmpty()) return;
+
+    QFileInfo fileInfo(document->filePath);
+    document->diskModified = fileInfo.lastModified();
+    document->diskSize = fileInfo.size();
+    m_fileWatcher->addPath(document->filePath);
+}
+
+void MainWindow::onFileChangedOnDisk(const QString &filePath) {
+    if (!m_pendingReloads.contains(filePath)) {
+        m_pendingReloads.append(filePath);
+    }
+    m_reloadTimer->start();
+}
+
+void MainWindow::reloadFromDisk() {
+    const QStringList pending = m_pendingReloads;
+    m_pendingReloads.clear();
+    for (const QString &filePath : pending) {
+        if (AlteDocumentManager::Document* document = m_documentManager->documentForPath(filePath)) {
+            reloadDocumentFromDisk(document->editor);
+        }
+    }
+}
+
+void MainWindow::reloadDocumentFromDisk(QTextEdit *editor) {
+    AlteDocumentManager::Document* document = m_documentManager->document(editor);
+    if (!document || document->filePath.isEmpty()) return;
+    const QString filePath = document->filePath;
+
+    QFileInfo fileInfo(filePath);
+    if (!fileInfo.exists()) {
+        qCWarning(lcDocument) << "MainWindow: Watched file disappeared from disk:" << filePath;
+        return;
+    }
+    // Editors that save by renaming a temp file replace the inode, which drops the watch.
+    if (!m_fileWatcher->files().contains(filePath)) {
+        m_fileWatcher->addPath(filePath);
+    }
+    if (document->residency == AlteDocumentManager::Residency::Stub) {
+        return; // A stub re-reads the file when it is activated
+    }
+    if (fileInfo.lastModified() == document->diskModified && fileInfo.size() == document->diskSize) {
+        return; // Our own save, or a touch that did not change anything we track
+    }
+    document->diskModified = fileInfo.lastModified();
+    document->diskSize = fileInfo.size();
+
+    if (editor->document()->isModified()) {
+        m_tabWidget->setCurrentWidget(editor);
+        const QMessageBox::StandardButton ret =
+            QMessageBox::question(this, tr("Alte Editor"),
+                                  tr("\"%1\" was changed on disk.\n"
+                                     "Reload it and discard your unsaved changes?").arg(fileInfo.fileName()),
+                                  QMessageBox::Yes | QMessageBox::No);
+        if (ret != QMessageBox::Yes) {
+            return;
+        }
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCWarning(lcDocument) << "MainWindow: Could not reload" << filePath << ":" << file.errorString();
+        return;
+    }
+    QTextStream in(&file);
+    const QString newContent = in.readAll();
+    file.close();
+    if (document->highlighter
+        && AlteLongLineLayout::hasLongLine(newContent, document->highlighter->longLineThreshold())) {
+        AlteLongLineLayout::install(editor, document->highlighter->longLineThreshold());
+    }
+
+    // Only the changed lines are edited, so the layout, highlighting and cursor of
+    // untouched blocks survive. The scroll position is restored explicitly.
+    const int verticalScroll = editor->verticalScrollBar()->value();
+    const int horizontalScroll = editor->horizontalScrollBar()->value();
+    const int editCount = AlteDocumentDiff::reloadIncrementally(editor->document(), newContent);
+    if (editCount < 0) {
+        qCWarning(lcDocument) << "MainWindow: Incremental reload failed, reloading" << filePath << "in full.";
+        editor->setPlainText(newContent);
+    } else {
+        qCDebug(lcDocument) << "MainWindow: Reloaded" << filePath << "from disk with" << editCount << "edit(s).";
     }
+    editor->verticalScrollBar()->setValue(verticalScroll);
+    editor->horizontalScrollBar()->setValue(horizontalScroll);
+    editor->document()->setModified(false);
 }
@@ -24,10 +24,14 @@
 #include <QIcon>               // For QIcon (used in MainWindow constructor, now in MainWindow.cpp)
 #include <stdexcept>           // For std::exception
 #include <QDebug>              // For qDebug messages
-#include <cstdio>              // For fprintf
 #include <QFileInfo>           // For QFile::exists() and QFileInfo::exists()
 
 #include "MainWindow.h" // Include the new MainWindow header
+#include "AlteStartupTrace.h"
+#include "AlteApplication.h"
+#include "AlteLog.h"
+#include "AlteTrace.h"
+#include <QCommandLineParser>
 
 // Forward declare AlteThemeManager if its definition isn't needed in this header part
 // class AlteThemeManager; // Not needed here as AlteThemeManager.h is included by AlteThemeManager.h (indirectly if main needs it) or directly.
@@ -41,6 +45,8 @@
 // #include "main.moc" // Should be handled by build system for MainWindow. Q_OBJECT is not in main.cpp anymore.
 
 int main(int argc, char *argv[]) {
+    AlteStartupTrace::start();
+
     // Attempt to set a default surface format to promote hardware acceleration
     QSurfaceFormat fmt;
     fmt.setRenderableType(QSurfaceFormat::OpenGL); // Specify OpenGL
@@ -59,12 +65,29 @@ int main(int argc, char *argv[]) {
     // QApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
     // QApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
 
-    QApplication app(argc, argv);
+    AlteApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption startupTraceOption("startup-trace", "Print how long each startup phase took.");
+    QCommandLineOption splashOption("splash", "Play the splash animation over the window.");
+    QCommandLineOption traceOption("trace", "Record a Chrome trace of the session and write it to <file> on exit.", "file");
+    parser.addOption(startupTraceOption);
+    parser.addOption(splashOption);
+    parser.addOption(traceOption);
+    parser.process(app);
+    if (parser.isSet(traceOption)) {
+        AlteTrace::setEnabled(true);
+        const QString traceFilePath = parser.value(traceOption);
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [traceFilePath]() { AlteTrace::writeJson(traceFilePath); });
+    }
+    AlteStartupTrace::setEnabled(parser.isSet(startupTraceOption));
+    AlteStartupTrace::mark("application");
 
     // Log current working directory and application path
-    qDebug() << "Current working directory (PWD):" << QDir::currentPath();
+    qCDebug(lcStartup) << "Current working directory (PWD):" << QDir::currentPath();
     QString appPath = QCoreApplication::applicationDirPath();
-    qDebug() << "Application directory path (appPath):" << appPath;
+    qCDebug(lcStartup) << "Application directory path (appPath):" << appPath;
 
     // Set application language and layout direction for Persian
     QLocale persianLocale(QLocale::Persian, QLocale::Iran);
@@ -73,6 +96,7 @@ int main(int argc, char *argv[]) {
 
     // ThemeManager setup
     AlteThemeManager themeManager;
+    AlteStartupTrace::mark("theme manager");
 
     // QString appPath = QCoreApplication::applicationDirPath(); // Moved up
     // qDebug() << "Application directory path:" << appPath; // Moved up
@@ -88,29 +112,29 @@ int main(int argc, char *argv[]) {
 
     for (const QString& basePath : potentialBasePaths) {
         QString currentThemePath = basePath + "/themes/" + themeName;
-        qDebug() << "Attempting resource path:" << currentThemePath;
+        qCDebug(lcStartup) << "Attempting resource path:" << currentThemePath;
         QFileInfo fileInfo(currentThemePath);
         if (fileInfo.exists() && fileInfo.isFile()) {
             themeFilePath = currentThemePath;
-            qDebug() << "Theme file found at:" << themeFilePath;
+            qCDebug(lcStartup) << "Theme file found at:" << themeFilePath;
             break;
         } else {
-            qDebug() << "Theme file not found at:" << currentThemePath;
+            qCDebug(lcStartup) << "Theme file not found at:" << currentThemePath;
         }
     }
 
     if (themeFilePath.isEmpty()) {
-        qWarning() << "Could not find theme in standard locations. Trying directly relative to app executable.";
+        qCWarning(lcStartup) << "Could not find theme in standard locations. Trying directly relative to app executable.";
         QString directRelativePath = appPath + "/resources/themes/" + themeName;
         QFileInfo fileInfo(directRelativePath);
         if (fileInfo.exists() && fileInfo.isFile()) {
             themeFilePath = directRelativePath;
-            qDebug() << "Theme file found at direct relative path:" << themeFilePath;
+            qCDebug(lcStartup) << "Theme file found at direct relative path:" << themeFilePath;
         } else {
             // If even that fails, as a last resort, use the original problematic relative path
             // but warn more strongly.
             QString finalFallbackPath = "./resources/themes/" + themeName;
-            qWarning() << "Direct relative path failed (" << directRelativePath << "). Critical fallback to './resources/themes/'. This is very likely to fail unless CWD is project root:" << finalFallbackPath;
+            qCWarning(lcStartup) << "Direct relative path failed (" << directRelativePath << "). Critical fallback to './resources/themes/'. This is very likely to fail unless CWD is project root:" << finalFallbackPath;
             themeFilePath = finalFallbackPath;
         }
     }
@@ -119,105 +143,64 @@ int main(int argc, char *argv[]) {
     if (!themeFilePath.isEmpty()) {
         QFileInfo fileInfo(themeFilePath);
         themeFilePath = fileInfo.absoluteFilePath(); // Normalize the path
-        qDebug() << "Normalized theme file path to be used:" << themeFilePath;
+        qCDebug(lcStartup) << "Normalized theme file path to be used:" << themeFilePath;
     }
 
 
     if (themeManager.loadTheme(themeFilePath)) {
-        qDebug() << "MAIN: loadTheme call completed for:" << themeFilePath;
-
-        // Simplest possible fprintf test
-        fprintf(stderr, "MAIN: fprintf test immediately after loadTheme returns.\n");
-        fflush(stderr);
-
-        // Restore themeManager integrity checks
-        fprintf(stderr, "MAIN: Test after loadTheme, before applyTheme. Color 'text': %s\n",
-                themeManager.getColor("text", Qt::magenta).name().toUtf8().constData());
-        fflush(stderr);
-        fprintf(stderr, "MAIN: Test getting 'styles' object size: %d\n",
-                themeManager.getStylesObjectSizeForDebug());
-        fflush(stderr);
-
+        qCDebug(lcStartup) << "Theme loaded from" << themeFilePath << "with" << themeManager.getStylesObjectSizeForDebug() << "styles";
         themeManager.applyTheme(&app);
     } else {
-        qWarning() << "Failed to load theme from:" << themeFilePath << ". Using default Qt appearance.";
+        qCWarning(lcStartup) << "Failed to load theme from:" << themeFilePath << ". Using default Qt appearance.";
         // Potentially add more specific error info here if possible or if loadTheme provides it.
     }
+    AlteStartupTrace::mark("theme applied");
 
-    SplashScreen splash; // SplashScreen is now a QWidget, not QSplashScreen
-    // It's important that MainWindow is created *after* the theme is applied,
-    // so it picks up themed styles and palette during its construction.
+    // Build the window and put it on screen before anything it does not need
+    // for the first frame: languages are loaded, and themes listed, afterwards.
     MainWindow mainWindow(&themeManager); // Pass themeManager to MainWindow
+    AlteStartupTrace::mark("main window built");
 
-    // Show and center SplashScreen AFTER MainWindow is created but BEFORE it's shown.
-    // This ensures splash is on top.
-    splash.show();
     if (QScreen *screen = QApplication::primaryScreen()) {
-        QRect screenGeometry = screen->geometry();
-        splash.move((screenGeometry.width() - splash.width()) / 2,
-                    (screenGeometry.height() - splash.height()) / 2);
-    }
-
-    // Connect the splash screen's animationFinished signal to show main window
-    QObject::connect(&splash, &SplashScreen::animationFinished, &app, [&]() {
-    qDebug() << "Lambda connected to animationFinished: Started.";
-    try {
-        qDebug() << "Splash animation finished. Attempting to show main window...";
-
-        if (QScreen *screen = QApplication::primaryScreen()) {
-            QRect screenGeometry = screen->availableGeometry(); // Use availableGeometry for usable space
+        QRect screenGeometry = screen->availableGeometry(); // Use availableGeometry for usable space
 
-            // Calculate desired size (e.g., 70% of screen dimensions)
-            int desiredWidth = static_cast<int>(screenGeometry.width() * 0.70);
-            int desiredHeight = static_cast<int>(screenGeometry.height() * 0.70);
+        // Calculate desired size (e.g., 70% of screen dimensions)
+        int desiredWidth = static_cast<int>(screenGeometry.width() * 0.70);
+        int desiredHeight = static_cast<int>(screenGeometry.height() * 0.70);
 
-            // Calculate top-left position to center the window
-            int x = screenGeometry.x() + (screenGeometry.width() - desiredWidth) / 2;
-            int y = screenGeometry.y() + (screenGeometry.height() - desiredHeight) / 2;
+        // Calculate top-left position to center the window
+        int x = screenGeometry.x() + (screenGeometry.width() - desiredWidth) / 2;
+        int y = screenGeometry.y() + (screenGeometry.height() - desiredHeight) / 2;
 
-            mainWindow.setGeometry(x, y, desiredWidth, desiredHeight);
-            qDebug() << "Set main window geometry to:" << x << y << desiredWidth << desiredHeight;
-        } else {
-            // Fallback if primary screen is not available (should be rare)
-            qDebug() << "Primary screen not found, using fallback geometry for main window.";
-            mainWindow.setGeometry(100, 100, 1024, 768); // A slightly larger default
-        }
-        // The extra setGeometry and brace that were here have been removed.
-
-        qDebug() << "Before mainWindow.show()";
-        mainWindow.show();
-        qDebug() << "After mainWindow.show()";
-
-        qDebug() << "Before mainWindow.newFile()";
-        mainWindow.newFile(); // Initialize with newFile as before
-        qDebug() << "After mainWindow.newFile()";
-
-        qDebug() << "newFile() called. Activating window..."; // This existing log is fine
-        mainWindow.activateWindow(); // Ensure main window gets focus
-        qDebug() << "Main window activated."; // This existing log is fine
-
-        qDebug() << "Before splash.close()";
-        splash.close(); // Close the splash screen widget
-        qDebug() << "After splash.close()";
-        qDebug() << "Splash screen closed. Main window setup complete."; // This existing log is fine
-    } catch (const std::exception& e) {
-        qCritical() << "Std::exception caught during main window setup: " << e.what();
-    } catch (...) {
-        qCritical() << "Unknown exception caught during main window setup.";
+        mainWindow.setGeometry(x, y, desiredWidth, desiredHeight);
+    } else {
+        // Fallback if primary screen is not available (should be rare)
+        mainWindow.setGeometry(100, 100, 1024, 768);
     }
+    mainWindow.show();
+    mainWindow.activateWindow(); // Ensure main window gets focus
+    AlteStartupTrace::mark("window shown");
+
+    QObject::connect(&mainWindow, &MainWindow::firstFramePainted, &app, [&themeManager]() {
+        AlteStartupTrace::mark("first frame");
+        themeManager.loadLanguageDefinitions();
+        AlteStartupTrace::mark("languages loaded");
+        AlteStartupTrace::report();
     });
 
-    // splash.startAnimation(1500); // Old animation call
-    // splash.startCentralColumnAnimation(500); // Old direct call, remove this
-
-    // New: Show splash, then after a delay, start the glyph animation
-    // The glyph animation itself will take 'glyphAnimationDurationMs'
-    int initialBlackScreenMs = 750;
-    int glyphAnimationDurationMs = 900; // Duration for the glyph to draw and fade in
-
-    QTimer::singleShot(initialBlackScreenMs, &splash, [=, &splash]() {
-        splash.startGlyphAnimation(glyphAnimationDurationMs);
-    });
+    // The splash is optional and plays over the window instead of in front of it.
+    if (parser.isSet(splashOption)) {
+        SplashScreen* splash = new SplashScreen;
+        splash->setAttribute(Qt::WA_DeleteOnClose);
+        if (QScreen *screen = QApplication::primaryScreen()) {
+            QRect screenGeometry = screen->geometry();
+            splash->move((screenGeometry.width() - splash->width()) / 2,
+                         (screenGeometry.height() - splash->height()) / 2);
+        }
+        QObject::connect(splash, &SplashScreen::animationFinished, splash, &QWidget::close);
+        splash->show();
+        splash->startGlyphAnimation(900);
+    }
 
     return app.exec();
 }
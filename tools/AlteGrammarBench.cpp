@@ -0,0 +1,111 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QVector>
+#include <cstdio>
+#include "AlteGrammar.h"
+#include "AlteGrammarReference.h"
+#include "AlteThemeManager.h"
+
+// Tokenizer throughput of every language on its sample, measured the way the
+// background tokenizer runs: line by line, each line entered in the state the
+// previous one ended in. Each sample is run through AlteGrammarReference, the
+// per-rule overwrite algorithm tokenizeLine replaced, and through tokenizeLine
+// itself. A language's sample is the file sample<extension> in the samples
+// directory, for the first of its extensions that has one.
+namespace {
+// A sample is repeated to at least this many lines and timed for at least this long.
+const int kMinLines = 20000;
+const qint64 kMinDurationNs = qint64(500) * 1000 * 1000;
+
+QStringList readLines(const QString& filePath) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        fprintf(stderr, "Could not read %s: %s\n", qPrintable(filePath), qPrintable(file.errorString()));
+        return {};
+    }
+    return QString::fromUtf8(file.readAll()).split(QLatin1Char('\n'));
+}
+
+QString samplePath(const QDir& samples, const QStringList& extensions) {
+    for (const QString& extension : extensions) {
+        if (!extension.isEmpty() && samples.exists(QStringLiteral("sample") + extension)) {
+            return samples.filePath(QStringLiteral("sample") + extension);
+        }
+    }
+    return QString();
+}
+
+// Lines per second of tokenize(line, state, tokens) over lines, run from the
+// top until kMinDurationNs has passed.
+template <typename Tokenize>
+double linesPerSecond(const QStringList& lines, Tokenize tokenize) {
+    QVector<AlteToken> tokens;
+    qint64 tokenized = 0;
+    QElapsedTimer timer;
+    timer.start();
+    do {
+        int state = 0;
+        for (const QString& line : lines) {
+            state = tokenize(line, state, tokens);
+        }
+        tokenized += lines.size();
+    } while (timer.nsecsElapsed() < kMinDurationNs);
+    return tokenized / (timer.nsecsElapsed() / 1e9);
+}
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures AlteGrammar::tokenizeLine against the per-rule overwrite highlighting "
+                                     "on a sample of every language.");
+    parser.addHelpOption();
+    QCommandLineOption syntaxOption("syntax", "Directory of the language definitions.", "dir",
+                                    QStringLiteral(ALTE_SOURCE_DIR "/resources/syntax"));
+    QCommandLineOption samplesOption("samples", "Directory of the samples, named sample<extension>.", "dir",
+                                     QStringLiteral(ALTE_SOURCE_DIR "/tools/samples"));
+    parser.addOption(syntaxOption);
+    parser.addOption(samplesOption);
+    parser.process(app);
+
+    // Keeps the grammar and language caches of the editor out of it.
+    QStandardPaths::setTestModeEnabled(true);
+    AlteThemeManager themeManager;
+    themeManager.loadLanguageDefinitions(parser.value(syntaxOption));
+    const QDir samples(parser.value(samplesOption));
+
+    QStringList languages = themeManager.getAvailableLanguages();
+    languages.sort();
+    printf("%-16s %12s %12s %8s\n", "language", "old lines/s", "new lines/s", "speedup");
+    int measured = 0;
+    for (const QString& language : languages) {
+        const QSharedPointer<const AlteGrammar> grammar = AlteGrammar::load(language, &themeManager);
+        if (!grammar || grammar->isEmpty()) continue;
+        const QString path = samplePath(samples, themeManager.getExtensionsForLanguage(language));
+        if (path.isEmpty()) {
+            fprintf(stderr, "%s: no sample in %s\n", qPrintable(language), qPrintable(samples.path()));
+            continue;
+        }
+        const QStringList sample = readLines(path);
+        if (sample.isEmpty()) continue;
+        QStringList lines;
+        while (lines.size() < kMinLines) {
+            lines += sample;
+        }
+
+        const double before = linesPerSecond(lines, [&](const QString& line, int state, QVector<AlteToken>& tokens) {
+            return AlteGrammarReference::referenceTokenize(*grammar, line, state, tokens);
+        });
+        const double after = linesPerSecond(lines, [&](const QString& line, int state, QVector<AlteToken>& tokens) {
+            return grammar->tokenizeLine(line, state, tokens);
+        });
+        printf("%-16s %12.0f %12.0f %7.2fx\n", qPrintable(language), before, after, after / before);
+        ++measured;
+    }
+    return measured > 0 ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QVector>
+#include <cstdio>
+#include "AlteGrammar.h"
+#include "AlteGrammarReference.h"
+#include "AlteThemeManager.h"
+
+// Checks the single-pass walk of AlteGrammar::tokenizeLine against
+// AlteGrammarReference, the plain per-rule overwrite algorithm it replaced.
+// Runs on the samples in tools/samples, named sample<extension>.
+namespace {
+QString describe(const AlteGrammar& grammar, const QVector<AlteToken>& tokens, int index) {
+    if (index >= tokens.size()) return QStringLiteral("nothing");
+    const AlteToken& token = tokens[index];
+    return QStringLiteral("[%1, %2) %3").arg(token.start).arg(token.start + token.length).arg(AlteGrammarReference::ruleName(grammar, token.style));
+}
+
+// Index of the first token that differs, or -1 if both are the same.
+int firstDifference(const QVector<AlteToken>& a, const QVector<AlteToken>& b) {
+    for (int i = 0; i < qMax(a.size(), b.size()); ++i) {
+        if (i >= a.size() || i >= b.size() || a[i].start != b[i].start || a[i].length != b[i].length
+            || a[i].style != b[i].style) {
+            return i;
+        }
+    }
+    return -1;
+}
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compares AlteGrammar::tokenizeLine with the per-rule overwrite highlighting.");
+    parser.addHelpOption();
+    QCommandLineOption syntaxOption("syntax", "Directory of the language definitions.", "dir",
+                                    QStringLiteral(ALTE_SOURCE_DIR "/resources/syntax"));
+    QCommandLineOption samplesOption("samples", "Directory of the samples, named sample<extension>.", "dir",
+                                     QStringLiteral(ALTE_SOURCE_DIR "/tools/samples"));
+    parser.addOption(syntaxOption);
+    parser.addOption(samplesOption);
+    parser.process(app);
+
+    QStandardPaths::setTestModeEnabled(true);
+    AlteThemeManager themeManager;
+    themeManager.loadLanguageDefinitions(parser.value(syntaxOption));
+    const QDir samples(parser.value(samplesOption));
+
+    int checked = 0;
+    int failed = 0;
+    QStringList languages = themeManager.getAvailableLanguages();
+    languages.sort();
+    for (const QString& language : languages) {
+        const QSharedPointer<const AlteGrammar> grammar = AlteGrammar::load(language, &themeManager);
+        if (!grammar || grammar->isEmpty()) continue;
+        QString path;
+        for (const QString& extension : themeManager.getExtensionsForLanguage(language)) {
+            if (!extension.isEmpty() && samples.exists(QStringLiteral("sample") + extension)) {
+                path = samples.filePath(QStringLiteral("sample") + extension);
+                break;
+            }
+        }
+        if (path.isEmpty()) {
+            fprintf(stderr, "%s: no sample in %s\n", qPrintable(language), qPrintable(samples.path()));
+            continue;
+        }
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            fprintf(stderr, "Could not read %s: %s\n", qPrintable(path), qPrintable(file.errorString()));
+            ++failed;
+            continue;
+        }
+        const QStringList lines = QString::fromUtf8(file.readAll()).split(QLatin1Char('\n'));
+
+        ++checked;
+        bool differs = false;
+        QVector<AlteToken> tokens;
+        QVector<AlteToken> expected;
+        int state = 0;
+        int expectedState = 0;
+        for (int line = 0; line < lines.size(); ++line) {
+            state = grammar->tokenizeLine(lines[line], state, tokens);
+            expectedState = AlteGrammarReference::referenceTokenize(*grammar, lines[line], expectedState, expected);
+            const int difference = firstDifference(tokens, expected);
+            if (difference < 0 && state == expectedState) continue;
+            fprintf(stderr, "%s:%d: ", qPrintable(path), line + 1);
+            if (difference >= 0) {
+                fprintf(stderr, "got %s, expected %s\n", qPrintable(describe(*grammar, tokens, difference)),
+                        qPrintable(describe(*grammar, expected, difference)));
+            } else {
+                fprintf(stderr, "ends in state %d, expected %d\n", state, expectedState);
+            }
+            differs = true;
+            break;
+        }
+        if (differs) ++failed;
+        printf("%-16s %s\n", qPrintable(language), differs ? "differs" : "ok");
+    }
+    if (checked == 0) {
+        fprintf(stderr, "No language had a sample to check.\n");
+        return 1;
+    }
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+#include "AlteGrammarReference.h"
+#include <QHash>
+#include <QPair>
+#include <QStringList>
+#include <algorithm>
+
+int AlteGrammarReference::referenceTokenize(const AlteGrammar& grammar, const QString& text, int entryState,
+                                            QVector<AlteToken>& tokens) {
+    AlteGrammar::StateStack stack;
+    grammar.stackForState(entryState, stack);
+    QVector<int> owner(text.length(), -1);
+
+    int pos = 0;
+    for (;;) {
+        const int spanRule = stack.isEmpty() ? -1 : stack.last();
+        const int contextId = spanRule < 0 ? 0 : grammar.m_rules[spanRule].bodyContext;
+        const AlteGrammar::Context* context =
+            contextId >= 0 && contextId < grammar.m_contexts.size() ? &grammar.m_contexts[contextId] : nullptr;
+
+        int closeStart = -1;
+        int closeEnd = -1;
+        if (spanRule >= 0 && !grammar.findBlockEnd(grammar.m_rules[spanRule], text, pos, closeStart, closeEnd)) {
+            closeStart = -1;
+        }
+        int openRule = -1;
+        int openStart = closeStart >= 0 ? closeStart : text.length();
+        int openEnd = openStart;
+        if (context && stack.size() < kMaxStateDepth) {
+            for (const int ruleIndex : context->blockRules) {
+                int start = 0;
+                int end = 0;
+                if (grammar.findBlockStart(grammar.m_rules[ruleIndex], text, pos, start, end) && start < openStart) {
+                    openRule = ruleIndex;
+                    openStart = start;
+                    openEnd = end;
+                }
+            }
+        }
+
+        referenceColour(grammar, context, spanRule, text, pos, openStart, owner);
+        if (openRule >= 0) {
+            std::fill(owner.begin() + openStart, owner.begin() + openEnd, openRule);
+            stack.append(quint16(openRule));
+            pos = openEnd;
+        } else if (closeStart >= 0) {
+            std::fill(owner.begin() + closeStart, owner.begin() + closeEnd, spanRule);
+            stack.removeLast();
+            pos = closeEnd;
+        } else {
+            break;
+        }
+    }
+
+    tokens.clear();
+    for (int start = 0; start < owner.size();) {
+        int end = start + 1;
+        while (end < owner.size() && owner[end] == owner[start]) {
+            ++end;
+        }
+        if (owner[start] >= 0) {
+            tokens.append({quint32(start), quint32(end - start), quint16(owner[start])});
+        }
+        start = end;
+    }
+    return grammar.stateForStack(stack);
+}
+
+void AlteGrammarReference::referenceColour(const AlteGrammar& grammar, const AlteGrammar::Context* context,
+                                           int spanRule, const QString& text, int from, int to, QVector<int>& owner) {
+    if (from >= to) return;
+    const int fill = spanRule >= 0 && !grammar.m_rules[spanRule].embedsLanguage ? spanRule : -1;
+    std::fill(owner.begin() + from, owner.begin() + to, fill);
+    if (!context) return;
+
+    QVector<int> rules = context->patternRules;
+    for (const QVector<AlteGrammar::KeywordEntry>& bucket : context->keywordBuckets) {
+        for (const AlteGrammar::KeywordEntry& entry : bucket) {
+            if (!rules.contains(entry.ruleIndex)) rules.append(entry.ruleIndex);
+        }
+    }
+    std::sort(rules.begin(), rules.end());
+
+    for (const int ruleIndex : rules) {
+        const AlteGrammar::Rule& rule = grammar.m_rules[ruleIndex];
+        const QRegularExpression pattern = rule.isKeywordRule ? keywordPattern(*context, ruleIndex) : rule.pattern;
+        QRegularExpressionMatchIterator matches = pattern.globalMatch(text, from);
+        while (matches.hasNext()) {
+            const QRegularExpressionMatch match = matches.next();
+            if (match.capturedStart() >= to) break;
+            const int end = qMin(int(match.capturedEnd()), to);
+            std::fill(owner.begin() + match.capturedStart(), owner.begin() + end, ruleIndex);
+        }
+    }
+}
+
+QRegularExpression AlteGrammarReference::keywordPattern(const AlteGrammar::Context& context, int ruleIndex) {
+    static QHash<QPair<const void*, int>, QRegularExpression> patterns;
+    const QPair<const void*, int> key(&context, ruleIndex);
+    const auto it = patterns.constFind(key);
+    if (it != patterns.constEnd()) return it.value();
+
+    QStringList words;
+    for (const QVector<AlteGrammar::KeywordEntry>& bucket : context.keywordBuckets) {
+        for (const AlteGrammar::KeywordEntry& entry : bucket) {
+            if (entry.ruleIndex == ruleIndex) words.append(QRegularExpression::escape(entry.word));
+        }
+    }
+    const QRegularExpression pattern("\\b(?:" + words.join(QLatin1Char('|')) + ")\\b");
+    patterns.insert(key, pattern);
+    return pattern;
+}
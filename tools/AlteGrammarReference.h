@@ -0,0 +1,34 @@
+#ifndef ALTEGRAMMARREFERENCE_H
+#define ALTEGRAMMARREFERENCE_H
+
+#include <QRegularExpression>
+#include <QString>
+#include <QVector>
+#include "AlteGrammar.h"
+
+// The plain highlighting algorithm the single-pass walk of
+// AlteGrammar::tokenizeLine replaced: every pattern rule, and every keyword list
+// as one \b-bounded regex, searched over the whole span in rule order without
+// literal prefixes, each overwriting the characters of the rules before it.
+// Spans are opened and closed by the same block rules as in the walk, so a
+// difference is always in how the text inside a span is coloured. Used by
+// alte_grammar_parity as the expected result and by alte_grammar_bench as the
+// baseline.
+class AlteGrammarReference {
+public:
+    // Same nesting limit as AlteGrammar::walkLine().
+    static const int kMaxStateDepth = 16;
+
+    static int referenceTokenize(const AlteGrammar& grammar, const QString& text, int entryState,
+                                 QVector<AlteToken>& tokens);
+    static QString ruleName(const AlteGrammar& grammar, quint16 style) {
+        return style < grammar.m_rules.size() ? grammar.m_rules[style].name : QString::number(style);
+    }
+
+private:
+    static void referenceColour(const AlteGrammar& grammar, const AlteGrammar::Context* context, int spanRule,
+                                const QString& text, int from, int to, QVector<int>& owner);
+    static QRegularExpression keywordPattern(const AlteGrammar::Context& context, int ruleIndex);
+};
+
+#endif // ALTEGRAMMARREFERENCE_H
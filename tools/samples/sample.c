@@ -0,0 +1,58 @@
+/* Ring buffer of fixed-size records, as found in many embedded C code bases.
+ * The sample mixes comments, strings, numbers and preprocessor lines. */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define RING_CAPACITY 64
+#define RING_MASK (RING_CAPACITY - 1)
+
+typedef struct {
+    uint32_t id;
+    double value;
+    char label[16];
+} record_t;
+
+typedef struct {
+    record_t items[RING_CAPACITY];
+    size_t head;
+    size_t tail;
+} ring_t;
+
+static int ring_push(ring_t *ring, const record_t *record)
+{
+    if (ring->head - ring->tail == RING_CAPACITY) {
+        return -1; /* full */
+    }
+    ring->items[ring->head & RING_MASK] = *record;
+    ring->head++;
+    return 0;
+}
+
+static int ring_pop(ring_t *ring, record_t *out)
+{
+    if (ring->head == ring->tail) {
+        return -1;
+    }
+    *out = ring->items[ring->tail & RING_MASK];
+    ring->tail++;
+    return 0;
+}
+
+int main(void)
+{
+    ring_t ring;
+    memset(&ring, 0, sizeof ring);
+    for (uint32_t i = 0; i < 100u; ++i) {
+        record_t record = { i, i * 0.5e-3, "sample" };
+        if (ring_push(&ring, &record) != 0) {
+            fprintf(stderr, "ring full at %u (0x%08X)\n", i, i);
+            break;
+        }
+    }
+    record_t record;
+    while (ring_pop(&ring, &record) == 0) {
+        printf("%u: %f '%s' %c\n", record.id, record.value, record.label, '\t');
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+// Small LRU cache with a hash index, written in the style of modern C++.
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace cache {
+
+template <typename Key, typename Value>
+class LruCache {
+public:
+    explicit LruCache(std::size_t capacity) : m_capacity(capacity) {}
+
+    [[nodiscard]] std::optional<Value> get(const Key& key) {
+        const auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            return std::nullopt;
+        }
+        // Move the entry to the front: it is now the most recently used one.
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return it->second->second;
+    }
+
+    void put(const Key& key, Value value) {
+        if (auto it = m_index.find(key); it != m_index.end()) {
+            it->second->second = std::move(value);
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            return;
+        }
+        if (m_entries.size() == m_capacity) {
+            m_index.erase(m_entries.back().first);
+            m_entries.pop_back();
+        }
+        m_entries.emplace_front(key, std::move(value));
+        m_index[key] = m_entries.begin();
+    }
+
+    std::size_t size() const noexcept { return m_entries.size(); }
+
+private:
+    using Entry = std::pair<Key, Value>;
+    std::size_t m_capacity;
+    std::list<Entry> m_entries;
+    std::unordered_map<Key, typename std::list<Entry>::iterator> m_index;
+};
+
+} // namespace cache
+
+/*
+ * Exercise the cache with a few lookups.
+ */
+int main() {
+    cache::LruCache<std::string, int> lru(2);
+    lru.put("one", 1);
+    lru.put("two", 2);
+    static_cast<void>(lru.get("one"));
+    lru.put("three", 3); // evicts "two"
+    const auto raw = R"(raw "string" with \ backslashes)";
+    for (const char* key : {"one", "two", "three"}) {
+        const auto value = lru.get(key);
+        std::cout << key << ": " << (value ? std::to_string(*value) : "missing") << '\n';
+    }
+    std::cout << raw << " 0x" << std::hex << 0xFFu << " " << 3.14159f << std::endl;
+    return 0;
+}
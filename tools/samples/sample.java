@@ -0,0 +1,62 @@
+package org.example.inventory;
+
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.Optional;
+
+/**
+ * Keeps the stock of a small warehouse.
+ *
+ * @author Example
+ */
+public final class Inventory {
+    private static final int MAX_ITEMS = 1_000;
+    private final Map<String, Integer> stock = new HashMap<>();
+    private final List<String> log = new ArrayList<>();
+
+    @Override
+    public String toString() {
+        return "Inventory{" + "items=" + stock.size() + '}';
+    }
+
+    /** Adds count units of the item, failing once the warehouse is full. */
+    public synchronized void add(String item, int count) throws IllegalStateException {
+        if (count <= 0) {
+            throw new IllegalArgumentException("count must be positive: " + count);
+        }
+        int total = stock.values().stream().mapToInt(Integer::intValue).sum();
+        if (total + count > MAX_ITEMS) {
+            throw new IllegalStateException(String.format("full (%d/%d)", total, MAX_ITEMS));
+        }
+        stock.merge(item, count, Integer::sum);
+        log.add("+" + count + " " + item);
+    }
+
+    public Optional<Integer> remove(String item, int count) {
+        Integer current = stock.get(item);
+        if (current == null || current < count) {
+            return Optional.empty();
+        }
+        // Drop the entry entirely once the last unit is gone.
+        if (current == count) {
+            stock.remove(item);
+        } else {
+            stock.put(item, current - count);
+        }
+        log.add("-" + count + " " + item);
+        return Optional.of(current - count);
+    }
+
+    public static void main(String[] args) {
+        Inventory inventory = new Inventory();
+        inventory.add("bolts", 250);
+        inventory.add("nuts", 0x1F4);
+        double ratio = 0.75d;
+        long big = 123456789L;
+        char separator = '\t';
+        inventory.remove("bolts", 50).ifPresent(left -> System.out.println("left: " + left + separator + ratio + big));
+        System.out.println(inventory);
+    }
+}
@@ -0,0 +1,59 @@
+'use strict';
+/**
+ * Debounced search box with a small result cache.
+ */
+import { fetchResults } from './api.js';
+
+const DEBOUNCE_MS = 250;
+const cache = new Map();
+
+export class SearchBox {
+    #timer = null;
+
+    constructor(input, output) {
+        this.input = input;
+        this.output = output;
+        this.input.addEventListener('input', () => this.schedule());
+    }
+
+    schedule() {
+        clearTimeout(this.#timer);
+        this.#timer = setTimeout(() => this.run(this.input.value.trim()), DEBOUNCE_MS);
+    }
+
+    async run(query) {
+        if (query.length < 2) {
+            this.render([]);
+            return;
+        }
+        // Results of earlier queries are reused as they are.
+        let results = cache.get(query);
+        if (!results) {
+            try {
+                results = await fetchResults(query, { limit: 20, fuzzy: true });
+                cache.set(query, results);
+            } catch (error) {
+                console.warn(`search for "${query}" failed`, error);
+                results = [];
+            }
+        }
+        this.render(results);
+    }
+
+    render(results) {
+        const pattern = /\b(todo|fixme)\b/gi;
+        this.output.innerHTML = results
+            .filter(result => result?.title != null)
+            .map(({ title, score = 0 }) => `<li data-score="${score.toFixed(2)}">${title.replace(pattern, '<mark>$1</mark>')}</li>`)
+            .join('');
+    }
+}
+
+const Item = ({ title }) => <li className="item">{title}</li>;
+
+export default function attach(root = document) {
+    const boxes = [...root.querySelectorAll('[data-search]')];
+    return boxes.map(element => new SearchBox(element, element.nextElementSibling ?? element));
+}
+
+const answer = 0x2A + 1e3 - 0b1010 + 10n;
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Summarise a CSV of measurements by group.
+
+The sample mixes docstrings, f-strings, decorators and comments.
+"""
+from __future__ import annotations
+
+import csv
+import statistics
+import sys
+from dataclasses import dataclass, field
+from pathlib import Path
+
+
+@dataclass
+class Group:
+    name: str
+    values: list[float] = field(default_factory=list)
+
+    def add(self, value: float) -> None:
+        self.values.append(value)
+
+    @property
+    def mean(self) -> float:
+        return statistics.fmean(self.values) if self.values else 0.0
+
+
+def read_groups(path: Path) -> dict[str, Group]:
+    groups: dict[str, Group] = {}
+    with path.open(newline="", encoding="utf-8") as handle:
+        for row in csv.DictReader(handle):
+            try:
+                value = float(row["value"])
+            except (KeyError, ValueError) as error:
+                print(f"skipping row {row!r}: {error}", file=sys.stderr)
+                continue
+            groups.setdefault(row.get("group", "default"), Group(row.get("group", "default"))).add(value)
+    return groups
+
+
+class Report:
+    '''Formats the groups as an aligned table.'''
+
+    WIDTH = 24
+
+    def __init__(self, groups):
+        self.groups = sorted(groups.values(), key=lambda g: (-g.mean, g.name))
+
+    def __str__(self):
+        lines = [f"{'group':<{self.WIDTH}} {'n':>6} {'mean':>10}"]
+        for group in self.groups:
+            lines.append(f"{group.name:<{self.WIDTH}} {len(group.values):>6} {group.mean:>10.3f}")
+        return "\n".join(lines)
+
+
+def main(argv=None):
+    argv = argv if argv is not None else sys.argv[1:]
+    if not argv:
+        print("usage: summarise.py FILE.csv", file=sys.stderr)
+        return 2
+    print(Report(read_groups(Path(argv[0]))))
+    return 0 if True and not None else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())